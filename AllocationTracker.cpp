@@ -0,0 +1,213 @@
+#include "AllocationTracker.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <malloc.h>
+#include <mutex>
+#include <new>
+#include <sstream>
+
+struct PhaseCounters {
+    std::atomic<const char *> name{ nullptr };
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> frees{ 0 };
+    std::atomic<uint64_t> allocatedBytes{ 0 };
+    std::atomic<uint64_t> freedBytes{ 0 };
+    std::atomic<int64_t> peakBytes{ 0 };
+};
+
+// Nothing here may allocate, it runs inside operator new
+static PhaseCounters phases[AllocationTracker::MAX_PHASES];
+static std::atomic<uint32_t> phaseCount{ 1 };
+static std::mutex registration;
+static std::atomic<int64_t> liveBytes{ 0 };
+static std::atomic<int64_t> peakBytes{ 0 };
+static thread_local uint32_t currentPhase = AllocationTracker::OTHER;
+
+std::atomic<bool> AllocationTracker::enabled{ false };
+
+static void raise(std::atomic<int64_t> &peak, int64_t value) {
+    int64_t seen = peak.load(std::memory_order_relaxed);
+    while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+void AllocationTracker::enable() {
+    for (PhaseCounters &phase : phases) {
+        phase.allocations = 0;
+        phase.frees = 0;
+        phase.allocatedBytes = 0;
+        phase.freedBytes = 0;
+        phase.peakBytes = 0;
+    }
+    liveBytes = 0;
+    peakBytes = 0;
+    enabled = true;
+}
+
+void AllocationTracker::disable() {
+    enabled = false;
+}
+
+// Phases are found by name, the same name always gives the same phase. Names
+// beyond MAX_PHASES are charged to "other".
+uint32_t AllocationTracker::getPhase(const char *name) {
+    uint32_t count = phaseCount.load(std::memory_order_acquire);
+    for (uint32_t i = 1; i < count; ++i) {
+        const char *known = phases[i].name.load(std::memory_order_relaxed);
+        if (known == name || std::strcmp(known, name) == 0) {
+            return i;
+        }
+    }
+    std::lock_guard<std::mutex> lock(registration);
+    count = phaseCount.load(std::memory_order_relaxed);
+    for (uint32_t i = 1; i < count; ++i) {
+        if (std::strcmp(phases[i].name.load(std::memory_order_relaxed), name) == 0) {
+            return i;
+        }
+    }
+    if (count == MAX_PHASES) {
+        return OTHER;
+    }
+    phases[count].name.store(name, std::memory_order_relaxed);
+    phaseCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+std::vector<PhaseStatistics> AllocationTracker::getStatistics() {
+    std::vector<PhaseStatistics> statistics;
+    uint32_t count = phaseCount.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; ++i) {
+        const PhaseCounters &phase = phases[i];
+        if (phase.allocations == 0 && phase.frees == 0) {
+            continue;
+        }
+        statistics.push_back({ i == OTHER ? "other" : phase.name.load(), phase.allocations, phase.frees,
+            phase.allocatedBytes, phase.freedBytes, phase.peakBytes });
+    }
+    return statistics;
+}
+
+int64_t AllocationTracker::getLiveBytes() {
+    return liveBytes;
+}
+
+int64_t AllocationTracker::getPeakBytes() {
+    return peakBytes;
+}
+
+// Phases by peak, the ones that drive the high-water mark first
+std::string AllocationTracker::report() {
+    std::vector<PhaseStatistics> statistics = getStatistics();
+    std::stable_sort(statistics.begin(), statistics.end(), [](const PhaseStatistics &a, const PhaseStatistics &b) {
+        return a.peakBytes > b.peakBytes;
+    });
+    std::ostringstream oss;
+    oss << std::left << std::setw(18) << "Phase" << std::right << std::setw(12) << "Allocs" << std::setw(12) << "Frees"
+        << std::setw(16) << "Allocated (KiB)" << std::setw(16) << "Retained (KiB)" << std::setw(12) << "Peak (KiB)" << std::endl;
+    oss << std::fixed << std::setprecision(1);
+    for (const PhaseStatistics &phase : statistics) {
+        oss << std::left << std::setw(18) << phase.name << std::right << std::setw(12) << phase.allocations
+            << std::setw(12) << phase.frees << std::setw(16) << phase.allocatedBytes / 1024.0
+            << std::setw(16) << phase.getRetainedBytes() / 1024.0 << std::setw(12) << phase.peakBytes / 1024.0 << std::endl;
+    }
+    oss << "Live: " << getLiveBytes() / 1024.0 << " KiB, peak: " << getPeakBytes() / 1024.0 << " KiB" << std::endl;
+    return oss.str();
+}
+
+void AllocationTracker::onAllocate(size_t bytes) {
+    PhaseCounters &phase = phases[currentPhase];
+    phase.allocations.fetch_add(1, std::memory_order_relaxed);
+    phase.allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    int64_t live = liveBytes.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes);
+    raise(phase.peakBytes, live);
+    raise(peakBytes, live);
+}
+
+void AllocationTracker::onFree(size_t bytes) {
+    PhaseCounters &phase = phases[currentPhase];
+    phase.frees.fetch_add(1, std::memory_order_relaxed);
+    phase.freedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    liveBytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+}
+
+uint32_t AllocationTracker::enter(uint32_t phase) {
+    uint32_t previous = currentPhase;
+    currentPhase = phase;
+    return previous;
+}
+
+void AllocationTracker::leave(uint32_t previous) {
+    currentPhase = previous;
+}
+
+// The replaceable allocation functions. Over-aligned new and delete keep the
+// library versions; nothing in the tree needs them.
+static void *allocate(size_t size) {
+    void *pointer = std::malloc(size ? size : 1);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    if (AllocationTracker::isEnabled()) {
+        AllocationTracker::onAllocate(malloc_usable_size(pointer));
+    }
+    return pointer;
+}
+
+static void release(void *pointer) noexcept {
+    if (pointer && AllocationTracker::isEnabled()) {
+        AllocationTracker::onFree(malloc_usable_size(pointer));
+    }
+    std::free(pointer);
+}
+
+void *operator new(size_t size) {
+    return allocate(size);
+}
+
+void *operator new[](size_t size) {
+    return allocate(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return allocate(size);
+    }
+    catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return allocate(size);
+    }
+    catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *pointer) noexcept {
+    release(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    release(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    release(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+    release(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+    release(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept {
+    release(pointer);
+}
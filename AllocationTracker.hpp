@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Heap use charged to one phase. Bytes are the usable sizes malloc handed
+// out, so they match what the process really holds. A free is charged to the
+// phase it happens in, so retained, allocated minus freed, is what the phase
+// leaves to the phases after it. Peak is the highest live heap seen while the
+// phase was the innermost one.
+struct PhaseStatistics {
+    const char *name;
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t allocatedBytes;
+    uint64_t freedBytes;
+    int64_t peakBytes;
+
+    int64_t getRetainedBytes() const {
+        return static_cast<int64_t>(allocatedBytes) - static_cast<int64_t>(freedBytes);
+    }
+};
+
+// Opt-in heap accounting. The global operator new and delete count through
+// here while tracking is enabled; while it isn't they cost a relaxed load.
+// Allocations and frees are charged to the innermost AllocationScope of the
+// calling thread, the ones outside any scope to "other". Live and peak bytes
+// start from zero when tracking is enabled.
+class AllocationTracker {
+public:
+    static constexpr size_t MAX_PHASES = 32;
+    static constexpr uint32_t OTHER = 0;
+
+    static void enable();
+    static void disable();
+    static bool isEnabled() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+    static uint32_t getPhase(const char *name);
+    static std::vector<PhaseStatistics> getStatistics();
+    static int64_t getLiveBytes();
+    static int64_t getPeakBytes();
+    static std::string report();
+
+    static void onAllocate(size_t bytes);
+    static void onFree(size_t bytes);
+    static uint32_t enter(uint32_t phase);
+    static void leave(uint32_t previous);
+private:
+    static std::atomic<bool> enabled;
+};
+
+// Charges the allocations of its lifetime on this thread to a named phase.
+// Scopes nest; the innermost one is charged.
+class AllocationScope {
+public:
+    explicit AllocationScope(const char *name) : previous(AllocationTracker::enter(AllocationTracker::getPhase(name))) {}
+    AllocationScope(const AllocationScope &) = delete;
+    AllocationScope &operator=(const AllocationScope &) = delete;
+    ~AllocationScope() {
+        AllocationTracker::leave(previous);
+    }
+private:
+    uint32_t previous;
+};
@@ -0,0 +1,64 @@
+#include "Assembler.hpp"
+
+Assembler::Assembler(FileProvider provider) : provider(std::move(provider)) {}
+
+void Assembler::addIncludePath(const std::string &directory) {
+    includePaths.push_back(directory);
+}
+
+// Failures, a throwing provider included, end up in the errors of the result
+AssemblyResult Assembler::assemble(const std::string &rootName, bool encode) const {
+    AssemblyResult result;
+    try {
+        build(rootName, encode, result);
+    }
+    catch (const std::exception &exception) {
+        result = AssemblyResult();
+        result.errors.emplace_back(std::string("Assembly failed: ") + exception.what());
+    }
+    catch (...) {
+        result = AssemblyResult();
+        result.errors.emplace_back("Assembly failed");
+    }
+    return result;
+}
+
+void Assembler::build(const std::string &rootName, bool encode, AssemblyResult &result) const {
+    SourceManager sources(provider);
+    for (const std::string &path : includePaths) {
+        sources.addIncludePath(path);
+    }
+    Linker linker(rootName, sources);
+    if (!linker.link()) {
+        result.errors = linker.getErrors();
+        return;
+    }
+    result.commands = linker.getCommands();
+    result.symbolTable = linker.getSymbolTable();
+    result.sourceFiles = linker.getSourceFiles();
+    if (!encode) {
+        result.success = true;
+        return;
+    }
+
+    Program program(result.commands, result.symbolTable, result.sourceFiles);
+    if (!program.load()) {
+        result.errors = program.getErrors();
+        return;
+    }
+    result.image = program.getImage();
+    result.entry = program.getEntry();
+    result.success = true;
+}
+
+AssemblyResult Assembler::assembleSource(const std::string &source, bool encode) {
+    static const std::string ROOT_NAME = "source.asm";
+    Assembler assembler([&source](const std::string &path, std::string &content) {
+        if (path != ROOT_NAME) {
+            return false;
+        }
+        content = source;
+        return true;
+    });
+    return assembler.assemble(ROOT_NAME, encode);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Linker.hpp"
+#include "Program.hpp"
+
+// Everything one assembly produced. The image is empty unless the program
+// was encoded.
+struct AssemblyResult {
+    bool success = false;
+    std::vector<Command> commands;
+    std::unordered_map<std::string, uint32_t> symbolTable;
+    std::vector<std::string> sourceFiles;
+    std::vector<ImageSegment> image;
+    uint32_t entry = Program::NO_OP;    // op index of the start instruction
+    std::vector<Error> errors;
+};
+
+// Library entry point that assembles from memory. Sources, includes among
+// them, come from the file provider; nothing is read from or written to
+// disk. Every call builds its own source manager, linker and program, so one
+// Assembler can be used from any number of threads as long as its provider
+// can. Nothing throws out of it, every failure is in the errors of the result.
+class Assembler {
+public:
+    explicit Assembler(FileProvider provider);
+    AssemblyResult assemble(const std::string &rootName, bool encode = true) const;
+    void addIncludePath(const std::string &directory);
+
+    // A single source without includes
+    static AssemblyResult assembleSource(const std::string &source, bool encode = true);
+private:
+    FileProvider provider;
+    std::vector<std::string> includePaths;
+
+    void build(const std::string &rootName, bool encode, AssemblyResult &result) const;
+};
@@ -0,0 +1,269 @@
+#include "AssemblerDaemon.hpp"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static constexpr size_t MAX_REQUEST = 4096;
+static constexpr int REQUEST_TIMEOUT_MS = 5000;   // for the whole request line, and for each send of the reply
+
+static bool makeAddress(const std::string &path, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+static bool sendAll(int socket, const std::string &text) {
+    size_t sent = 0;
+    while (sent < text.size()) {
+        ssize_t count = send(socket, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (count <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+AssemblerDaemon::AssemblerDaemon(const std::string &socketPath, const std::string &directory, unsigned threads) :
+    socketPath(socketPath), directory(directory), threads(threads > 0 ? threads : 1) {}
+
+AssemblerDaemon::~AssemblerDaemon() {
+    if (listener >= 0) {
+        close(listener);
+    }
+}
+
+void AssemblerDaemon::addIncludePath(const std::string &directory) {
+    sources.addIncludePath(directory);
+}
+
+// Blocks until a shutdown request has been answered
+bool AssemblerDaemon::serve() {
+    sockaddr_un address;
+    if (!makeAddress(socketPath, address)) {
+        errors.emplace_back("Socket path is too long: " + socketPath);
+        return false;
+    }
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        errors.emplace_back("Couldn't listen on " + socketPath + ": " + std::strerror(errno));
+        return false;
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&AssemblerDaemon::work, this);
+    }
+    while (!stopping) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        clients.push_back(client);
+        clientReady.notify_one();
+    }
+    stop();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    close(listener);
+    listener = -1;
+    unlink(socketPath.c_str());
+    return true;
+}
+
+const std::vector<Error> &AssemblerDaemon::getErrors() const {
+    return errors;
+}
+
+bool AssemblerDaemon::hasErrors() const {
+    return !errors.empty();
+}
+
+// Thin client side: sends one request and copies the reply to out
+bool AssemblerDaemon::request(const std::string &socketPath, const std::string &line, std::ostream &out) {
+    sockaddr_un address;
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0 || !makeAddress(socketPath, address) ||
+        connect(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        out << "failed: no assembler daemon on " << socketPath << std::endl;
+        if (server >= 0) {
+            close(server);
+        }
+        return false;
+    }
+    sendAll(server, line + "\n");
+    shutdown(server, SHUT_WR);
+    std::string reply;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(server, buffer, sizeof(buffer))) > 0) {
+        reply.append(buffer, static_cast<size_t>(count));
+    }
+    close(server);
+    out << reply;
+    size_t last = reply.rfind('\n', reply.size() >= 2 ? reply.size() - 2 : 0);
+    last = last == std::string::npos ? 0 : last + 1;
+    return reply.compare(last, 2, "ok") == 0;
+}
+
+void AssemblerDaemon::work() {
+    while (true) {
+        int client;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            clientReady.wait(lock, [this] { return stopping || !clients.empty(); });
+            if (clients.empty()) {
+                return;
+            }
+            client = clients.front();
+            clients.pop_front();
+        }
+        answer(client);
+    }
+}
+
+// A client that doesn't finish its request line in time is dropped without
+// a reply, so it can't hold a worker
+void AssemblerDaemon::answer(int client) {
+    timeval timeout = { REQUEST_TIMEOUT_MS / 1000, (REQUEST_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+    std::string line;
+    char buffer[512];
+    while (line.find('\n') == std::string::npos && line.size() < MAX_REQUEST) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        pollfd readable = { client, POLLIN, 0 };
+        int ready = remaining.count() > 0 ? poll(&readable, 1, static_cast<int>(remaining.count())) : 0;
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            close(client);
+            ++droppedClients;
+            return;
+        }
+        ssize_t count = read(client, buffer, sizeof(buffer));
+        if (count <= 0) {
+            break;
+        }
+        line.append(buffer, static_cast<size_t>(count));
+    }
+    line = line.substr(0, line.find_first_of("\r\n"));
+    std::ostringstream reply;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = false;
+    try {
+        ok = handle(line, reply);
+    }
+    catch (const std::exception &exception) {
+        // One bad request fails alone, the server keeps running
+        reply << "Internal error: " << exception.what() << "\n";
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    reply << (ok ? "ok" : "failed") << " in " << elapsed.count() << " ms\n";
+    sendAll(client, reply.str());
+    close(client);
+    ++requestCount;
+}
+
+bool AssemblerDaemon::handle(const std::string &line, std::ostream &reply) {
+    std::istringstream iss(line);
+    std::string command, file;
+    iss >> command >> file;
+    if (command == "assemble" || command == "link") {
+        if (file.empty()) {
+            reply << "Usage: " << command << " <file>\n";
+            return false;
+        }
+        return assemble(file, command == "assemble", reply);
+    }
+    if (command == "stats") {
+        reply << "requests " << requestCount << ", dropped " << droppedClients << ", files parsed " << parses.getMissCount() << ", reused "
+            << parses.getHitCount() << ", images reused " << reusedImages << ", sources loaded "
+            << sources.getLoadCount() << ", held " << sources.getFileCount() << ", stat calls " << sources.getStatCount()
+            << "\n";
+        return true;
+    }
+    if (command == "shutdown") {
+        stop();
+        return true;
+    }
+    reply << "Unknown request: " << command << "\n";
+    return false;
+}
+
+// The image of the last build is reused while every source it came from
+// still loads as the same version
+bool AssemblerDaemon::assemble(const std::string &file, bool encode, std::ostream &reply) {
+    std::string root = (std::filesystem::path(file).is_absolute() ? file : directory + file) + ".asm";
+    sources.revalidate();
+    Linker linker(root, sources);
+    linker.setParseCache(&parses);
+    if (!linker.link()) {
+        for (const auto &error : linker.getErrors()) {
+            reply << error.getMessage() << "\n";
+        }
+        return false;
+    }
+    if (!encode) {
+        reply << "Linked " << linker.getCommands().size() << " commands and " << linker.getSymbolTable().size()
+            << " symbols from " << linker.getSourceFiles().size() << " files\n";
+        return true;
+    }
+
+    std::shared_ptr<Program> program;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto build = builds.find(root);
+        if (build != builds.end() && build->second.fileIds == linker.getFileIds()) {
+            program = build->second.program;
+            ++reusedImages;
+        }
+    }
+    if (!program) {
+        program = std::make_shared<Program>(linker.getCommands(), linker.getSymbolTable(), linker.getSourceFiles());
+        if (!program->load()) {
+            for (const auto &error : program->getErrors()) {
+                reply << error.getMessage() << "\n";
+            }
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        builds[root] = { linker.getFileIds(), program };
+    }
+
+    std::string base = root.substr(0, root.size() - 4);
+    std::lock_guard<std::mutex> lock(outputMutex);
+    if (!program->writeImage(base + ".bin") || !program->writeSymbols(base + ".sym")) {
+        reply << program->getErrors().back().getMessage() << "\n";
+        return false;
+    }
+    reply << "Wrote " << program->getImageWordCount() << " words to " << base << ".bin from "
+        << linker.getSourceFiles().size() << " files\n";
+    return true;
+}
+
+// Wakes the accept loop and lets the workers finish the queued clients
+void AssemblerDaemon::stop() {
+    stopping = true;
+    if (listener >= 0) {
+        shutdown(listener, SHUT_RDWR);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    clientReady.notify_all();
+}
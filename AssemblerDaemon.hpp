@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Linker.hpp"
+#include "Program.hpp"
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+// Long-lived assembler serving build requests over a Unix domain socket.
+// The source manager, parsed files and the last image of every root file
+// stay in memory between requests, so a build only reads and parses what
+// changed since the last one and skips encoding when nothing did.
+//
+// One request per connection, a single line sent within five seconds:
+//   assemble <file>    link and encode into <file>.bin and <file>.sym
+//   link <file>        link only
+//   stats              cache counters
+//   shutdown           stop once the running requests are answered
+// <file> is the root source without .asm, relative to the base directory
+// unless absolute. The reply is any number of message lines followed by a
+// final line that starts with "ok" or "failed".
+class AssemblerDaemon {
+public:
+    static constexpr unsigned DEFAULT_THREADS = 4;
+
+    AssemblerDaemon(const std::string &socketPath, const std::string &directory, unsigned threads = DEFAULT_THREADS);
+    ~AssemblerDaemon();
+    void addIncludePath(const std::string &directory);
+    bool serve();
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+
+    static bool request(const std::string &socketPath, const std::string &line, std::ostream &out);
+private:
+    // Image of a root file and the source versions it was built from
+    struct Build {
+        std::vector<uint32_t> fileIds;
+        std::shared_ptr<Program> program;
+    };
+
+    std::string socketPath;
+    std::string directory;
+    unsigned threads;
+    int listener = -1;
+    std::atomic<bool> stopping{ false };
+    std::mutex mutex;                   // guards clients and builds
+    std::condition_variable clientReady;
+    std::deque<int> clients;
+    std::unordered_map<std::string, Build> builds;
+    std::mutex outputMutex;             // one writer of output files at a time
+    SourceManager sources{ false };
+    ParseCache parses;
+    std::atomic<uint64_t> requestCount{ 0 };
+    std::atomic<uint64_t> droppedClients{ 0 };  // timed out before sending a request
+    std::atomic<uint64_t> reusedImages{ 0 };
+    std::vector<Error> errors;
+
+    void work();
+    void answer(int client);
+    bool handle(const std::string &line, std::ostream &reply);
+    bool assemble(const std::string &file, bool encode, std::ostream &reply);
+    void stop();
+};
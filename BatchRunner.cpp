@@ -0,0 +1,176 @@
+#include "BatchRunner.hpp"
+#include "Parser.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+BatchRunner::BatchRunner(const Program &program, unsigned threadCount)
+    : program(program), threadCount(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency())) {}
+
+void BatchRunner::setStepLimit(uint64_t stepLimit) {
+    this->stepLimit = stepLimit;
+}
+
+void BatchRunner::setStackTop(uint32_t stackTop) {
+    this->stackTop = stackTop;
+}
+
+double BatchRunner::getElapsedSeconds() const {
+    return elapsedSeconds;
+}
+
+unsigned BatchRunner::getThreadCount() const {
+    return threadCount;
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<BatchInput> &inputs) {
+    std::vector<BatchResult> results(inputs.size());
+    unsigned workers = static_cast<unsigned>(std::min<size_t>(threadCount, std::max<size_t>(inputs.size(), 1)));
+    std::vector<WorkQueue> queues(workers);
+
+    // Contiguous slices keep neighbouring inputs on one worker until stealing starts
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        queues[i * workers / inputs.size()].indices.push_back(i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned worker = 1; worker < workers; ++worker) {
+        threads.emplace_back(&BatchRunner::work, this, worker, std::ref(queues), std::cref(inputs), std::ref(results));
+    }
+    work(0, queues, inputs, results);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    elapsedSeconds = elapsed.count();
+    return results;
+}
+
+void BatchRunner::work(unsigned worker, std::vector<WorkQueue> &queues, const std::vector<BatchInput> &inputs, std::vector<BatchResult> &results) const {
+    Emulator emulator(program, stackTop);
+    size_t index;
+    while (takeWork(queues, worker, index)) {
+        runInstance(emulator, inputs[index], results[index]);
+    }
+}
+
+bool BatchRunner::takeWork(std::vector<WorkQueue> &queues, unsigned worker, size_t &index) {
+    {
+        std::lock_guard<std::mutex> lock(queues[worker].mutex);
+        if (!queues[worker].indices.empty()) {
+            index = queues[worker].indices.front();
+            queues[worker].indices.pop_front();
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        WorkQueue &victim = queues[(worker + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.indices.empty()) {
+            index = victim.indices.back();
+            victim.indices.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void BatchRunner::runInstance(Emulator &emulator, const BatchInput &input, BatchResult &result) const {
+    emulator.reset();
+    result.name = input.name;
+    for (const auto &preset : input.registers) {
+        emulator.setRegister(preset.first, preset.second);
+    }
+    for (const auto &word : input.memory) {
+        if (!emulator.getMemory().write(word.first, word.second)) {
+            result.state = Emulator::State::Fault;
+            result.error = "Input writes outside of memory";
+            return;
+        }
+    }
+    result.state = emulator.run(stepLimit);
+    result.instructions = emulator.getInstructionCount();
+    result.cycles = emulator.getCycleCount();
+    result.returnValue = emulator.getRegister(REGISTER_RETURN);
+    if (emulator.hasErrors()) {
+        result.error = emulator.getErrors().front().getMessage();
+    }
+}
+
+// One "<register|address|label> <value> [<value> ...]" entry per line, ';' starts a comment.
+// Several values after an address or label fill consecutive words.
+bool BatchRunner::loadInput(const std::string &filename, const Program &program, BatchInput &input, std::vector<Error> &errors) {
+    std::ifstream fileStream(filename);
+    if (!fileStream) {
+        errors.emplace_back("Failed to open input", Error::NO_LINE, filename);
+        return false;
+    }
+    size_t errorCount = errors.size();
+    input.name = filename;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(fileStream, line)) {
+        ++lineNumber;
+        std::istringstream iss(line.substr(0, line.find(';')));
+        std::string destination, token;
+        if (!(iss >> destination)) {
+            continue;
+        }
+        // A value is a signed or an unsigned word, nothing wider
+        std::vector<uint32_t> values;
+        bool valid = true;
+        while (valid && iss >> token) {
+            size_t end = 0;
+            long long number = 0;
+            try {
+                number = std::stoll(token, &end, 0);
+            }
+            catch (const std::exception &) {
+                end = 0;
+            }
+            valid = end == token.size() && number >= INT32_MIN && number <= static_cast<long long>(UINT32_MAX);
+            values.push_back(static_cast<uint32_t>(number));
+        }
+        if (!valid) {
+            errors.emplace_back("Invalid value: " + token, lineNumber, filename);
+            continue;
+        }
+        if (values.empty()) {
+            errors.emplace_back("Expected a value for " + destination, lineNumber, filename);
+            continue;
+        }
+
+        size_t registerIndex = Parser::getRegisterIndex(destination);
+        if (registerIndex != Parser::REGISTER_INVALID) {
+            input.registers.emplace_back(static_cast<int>(registerIndex), values.front());
+            continue;
+        }
+        uint32_t address;
+        if (std::isdigit(static_cast<unsigned char>(destination[0]))) {
+            size_t end = 0;
+            unsigned long long number = 0;
+            try {
+                number = std::stoull(destination, &end, 0);
+            }
+            catch (const std::exception &) {
+                end = 0;
+            }
+            if (end != destination.size() || number > UINT32_MAX) {
+                errors.emplace_back("Invalid address: " + destination, lineNumber, filename);
+                continue;
+            }
+            address = static_cast<uint32_t>(number);
+        }
+        else if (!program.findSymbol(destination, address)) {
+            errors.emplace_back("Undefined symbol: " + destination, lineNumber, filename);
+            continue;
+        }
+        for (uint32_t value : values) {
+            input.memory.emplace_back(address++, value);
+        }
+    }
+    return errors.size() == errorCount;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Emulator.hpp"
+#include <deque>
+#include <mutex>
+
+// Initial machine state of one instance: register values and memory words
+// written over the program image before it starts.
+struct BatchInput {
+    std::string name;
+    std::vector<std::pair<int, uint32_t>> registers;
+    std::vector<std::pair<uint32_t, uint32_t>> memory;
+};
+
+struct BatchResult {
+    std::string name;
+    Emulator::State state = Emulator::State::Ready;
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint32_t returnValue = 0;   // a0 when the instance stopped
+    std::string error;
+};
+
+// Runs many independent instances of one program on a pool of worker threads.
+// The Program is shared read-only, every worker owns one Emulator that is reset
+// between instances. Workers take instances from their own queue and steal from
+// the back of other queues once it runs dry.
+class BatchRunner {
+public:
+    static constexpr uint64_t DEFAULT_STEP_LIMIT = 100000000;
+    static constexpr int REGISTER_RETURN = 10; // a0
+
+    BatchRunner(const Program &program, unsigned threadCount = 0);
+    void setStepLimit(uint64_t stepLimit);
+    void setStackTop(uint32_t stackTop);
+    std::vector<BatchResult> run(const std::vector<BatchInput> &inputs);
+    double getElapsedSeconds() const;
+    unsigned getThreadCount() const;
+
+    static bool loadInput(const std::string &filename, const Program &program, BatchInput &input, std::vector<Error> &errors);
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> indices;
+    };
+
+    const Program &program;
+    unsigned threadCount;
+    uint64_t stepLimit = DEFAULT_STEP_LIMIT;
+    uint32_t stackTop = Emulator::DEFAULT_STACK_TOP;
+    double elapsedSeconds = 0;
+
+    void work(unsigned worker, std::vector<WorkQueue> &queues, const std::vector<BatchInput> &inputs, std::vector<BatchResult> &results) const;
+    static bool takeWork(std::vector<WorkQueue> &queues, unsigned worker, size_t &index);
+    void runInstance(Emulator &emulator, const BatchInput &input, BatchResult &result) const;
+};
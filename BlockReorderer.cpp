@@ -0,0 +1,314 @@
+#include "BlockReorderer.hpp"
+#include "Isa.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+static const std::unordered_map<std::string, std::string> INVERTED_BRANCHES = {
+    { "jz", "jnz" }, { "jnz", "jz" },
+    { "jlz", "jgez" }, { "jgez", "jlz" },
+    { "jlez", "jgz" }, { "jgz", "jlez" }
+};
+
+static bool isCode(const Command &command) {
+    return command.getType() == Command::Type::Instruction || command.getType() == Command::Type::Label;
+}
+
+static Command jumpTo(const std::string &name, const std::string &label, const Command &source, int r1 = 0) {
+    Command command = Command::createInstruction(name, AddressingMode::MemoryDirect, label, Command::Sign::Plus, r1);
+    command.setLine(source.getLine());
+    command.setFileIndex(source.getFileIndex());
+    return command;
+}
+
+BlockReorderer::BlockReorderer(const std::vector<Command> &commands, const std::vector<std::string> &sourceFiles,
+    const BranchProfile &profile)
+    : commands(commands), sourceFiles(sourceFiles), profile(profile) {}
+
+// Returns whether the code changed; addresses have to be laid out again
+// when it did
+bool BlockReorderer::reorder() {
+    for (const Command &command : commands) {
+        if (command.getType() == Command::Type::Label) {
+            labels.insert(command.getName());
+        }
+    }
+    std::vector<Command> reordered;
+    reordered.reserve(commands.size());
+    bool changed = false;
+    size_t index = 0;
+    while (index < commands.size()) {
+        if (!isCode(commands[index])) {
+            reordered.push_back(commands[index++]);
+            continue;
+        }
+        size_t begin = index;
+        while (index < commands.size() && isCode(commands[index])) {
+            ++index;
+        }
+        changed |= reorderRegion(begin, index, reordered);
+    }
+    if (changed) {
+        commands = std::move(reordered);
+    }
+    return changed;
+}
+
+const std::vector<Command> &BlockReorderer::getCommands() const {
+    return commands;
+}
+
+const BlockOrderStatistics &BlockReorderer::getStatistics() const {
+    return statistics;
+}
+
+bool BlockReorderer::reorderRegion(size_t begin, size_t end, std::vector<Command> &reordered) {
+    enum class Fix {
+        Keep,
+        Invert,     // the taken side comes next, branch to the fall-through instead
+        AddJump,    // neither side comes next, jmp to the fall-through
+        DropJump    // a jmp to the next block
+    };
+
+    std::vector<Block> blocks = findBlocks(begin, end);
+    std::vector<size_t> order = chainBlocks(blocks);
+    size_t count = blocks.size();
+
+    // Fixes are decided before anything is emitted, a jump added at the end
+    // may need a label on a block placed earlier
+    std::vector<Fix> fixes(count, Fix::Keep);
+    BlockOrderStatistics region;
+    region.blocks = count;
+    bool changed = false;
+    for (size_t position = 0; position < count; ++position) {
+        size_t b = order[position];
+        size_t next = position + 1 < count ? order[position + 1] : NO_BLOCK;
+        size_t fallThrough = b + 1 < count ? b + 1 : NO_BLOCK;
+        Block &block = blocks[b];
+        if (b != position) {
+            ++region.movedBlocks;
+            changed = true;
+        }
+        if (block.terminator != NO_BLOCK && !block.fallsThrough) {
+            region.takenBefore += block.taken;
+            if (block.target != NO_BLOCK && block.target == next) {
+                fixes[b] = Fix::DropJump;
+                ++region.removedJumps;
+            }
+            else {
+                region.takenAfter += block.taken;
+            }
+        }
+        else if (block.terminator != NO_BLOCK) {
+            region.takenBefore += block.taken;
+            if (fallThrough == NO_BLOCK || fallThrough == next) {
+                region.takenAfter += block.taken;
+            }
+            else if (block.target != NO_BLOCK && block.target == next) {
+                fixes[b] = Fix::Invert;
+                labelOf(blocks[fallThrough]);
+                ++region.invertedBranches;
+                region.takenAfter += block.notTaken;
+            }
+            else {
+                fixes[b] = Fix::AddJump;
+                labelOf(blocks[fallThrough]);
+                ++region.insertedJumps;
+                region.takenAfter += block.taken + block.notTaken;
+            }
+        }
+        else if (block.fallsThrough && fallThrough != NO_BLOCK && fallThrough != next) {
+            fixes[b] = Fix::AddJump;
+            labelOf(blocks[fallThrough]);
+            ++region.insertedJumps;
+            region.takenAfter += block.flow;
+        }
+        changed |= fixes[b] != Fix::Keep;
+    }
+
+    // The chaining is greedy, a region it made no better keeps its order
+    statistics.blocks += region.blocks;
+    statistics.takenBefore += region.takenBefore;
+    if (!changed || region.takenAfter >= region.takenBefore) {
+        statistics.takenAfter += region.takenBefore;
+        reordered.insert(reordered.end(), commands.begin() + begin, commands.begin() + end);
+        return false;
+    }
+    statistics.takenAfter += region.takenAfter;
+    statistics.movedBlocks += region.movedBlocks;
+    statistics.invertedBranches += region.invertedBranches;
+    statistics.insertedJumps += region.insertedJumps;
+    statistics.removedJumps += region.removedJumps;
+
+    for (size_t b : order) {
+        const Block &block = blocks[b];
+        const Command &first = commands[block.begin];
+        if (!block.label.empty() && (first.getType() != Command::Type::Label || first.getName() != block.label)) {
+            Command label = Command::createLabel(block.label);
+            label.setLine(first.getLine());
+            label.setFileIndex(first.getFileIndex());
+            reordered.push_back(label);
+        }
+        for (size_t i = block.begin; i < block.end; ++i) {
+            const Command &command = commands[i];
+            if (i != block.terminator || fixes[b] == Fix::Keep || fixes[b] == Fix::AddJump) {
+                reordered.push_back(command);
+            }
+            else if (fixes[b] == Fix::Invert) {
+                reordered.push_back(jumpTo(INVERTED_BRANCHES.at(command.getName()), blocks[b + 1].label, command,
+                    command.getR1()));
+            }
+        }
+        if (fixes[b] == Fix::AddJump) {
+            reordered.push_back(jumpTo("jmp", blocks[b + 1].label, commands[block.end - 1]));
+        }
+    }
+    return true;
+}
+
+// A block starts at a label and after every jmp, branch or return; calls
+// come back to the next instruction, so they don't end one. Labels that
+// follow each other belong to the same block.
+std::vector<BlockReorderer::Block> BlockReorderer::findBlocks(size_t begin, size_t end) {
+    std::vector<Block> blocks;
+    std::unordered_map<std::string, size_t> labelBlocks;
+    for (size_t i = begin; i < end; ++i) {
+        const Command &command = commands[i];
+        bool label = command.getType() == Command::Type::Label;
+        if (blocks.empty() || blocks.back().terminator != NO_BLOCK || !blocks.back().fallsThrough ||
+            (label && commands[i - 1].getType() != Command::Type::Label)) {
+            blocks.push_back({ i, i, NO_BLOCK, NO_BLOCK, true, 0, 0, 0, label ? command.getName() : std::string() });
+        }
+        Block &block = blocks.back();
+        block.end = i + 1;
+        if (label) {
+            labelBlocks.emplace(command.getName(), blocks.size() - 1);
+            continue;
+        }
+        const std::string &name = command.getName();
+        if (name == "jmp" || Isa::isKind(name, InstructionKind::Branch)) {
+            block.terminator = i;
+            block.fallsThrough = name != "jmp";
+            const BranchCounts *counts = command.getFileIndex() < sourceFiles.size() ?
+                profile.find(sourceFiles[command.getFileIndex()], command.getLine()) : nullptr;
+            if (counts) {
+                block.taken = counts->taken;
+                block.notTaken = block.fallsThrough ? counts->notTaken : 0;
+            }
+        }
+        else if (Isa::isKind(name, InstructionKind::Return)) {
+            block.fallsThrough = false;
+        }
+    }
+
+    for (Block &block : blocks) {
+        if (block.terminator == NO_BLOCK || commands[block.terminator].getAddressingMode() != AddressingMode::MemoryDirect) {
+            continue;
+        }
+        auto target = labelBlocks.find(commands[block.terminator].getNumberOrSymbol());
+        if (target != labelBlocks.end()) {
+            block.target = target->second;
+        }
+    }
+
+    // Blocks without a jmp or branch have no counts of their own, what
+    // flows into them from the region stands in for them
+    for (const Block &block : blocks) {
+        if (block.target != NO_BLOCK) {
+            blocks[block.target].flow += block.taken;
+        }
+    }
+    for (size_t b = 0; b + 1 < blocks.size(); ++b) {
+        if (blocks[b].fallsThrough) {
+            blocks[b + 1].flow += blocks[b].terminator == NO_BLOCK ? blocks[b].flow : blocks[b].notTaken;
+        }
+    }
+    return blocks;
+}
+
+// Bottom-up chaining: edges from heaviest to lightest join the chain ending
+// in their source to the chain starting with their target. Source adjacency
+// breaks ties, so without a profile nothing moves.
+std::vector<size_t> BlockReorderer::chainBlocks(const std::vector<Block> &blocks) const {
+    size_t count = blocks.size();
+
+    // Taking over the target of a fall-through turns that fall-through into
+    // a taken jump, so a taken edge only counts for what it carries beyond it
+    std::vector<uint64_t> fallingIn(count, 0);
+    for (size_t b = 0; b + 1 < count; ++b) {
+        if (blocks[b].fallsThrough) {
+            fallingIn[b + 1] = blocks[b].terminator == NO_BLOCK ? blocks[b].flow : blocks[b].notTaken;
+        }
+    }
+    std::vector<Edge> edges;
+    for (size_t b = 0; b < count; ++b) {
+        const Block &block = blocks[b];
+        if (block.fallsThrough && b + 1 < count) {
+            edges.push_back({ b, b + 1, fallingIn[b + 1], true });
+        }
+        if (block.target != NO_BLOCK && block.target != b && block.target != b + 1 && block.taken > fallingIn[block.target]) {
+            edges.push_back({ b, block.target, block.taken - fallingIn[block.target], false });
+        }
+    }
+    std::stable_sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) {
+        return a.weight > b.weight || (a.weight == b.weight && a.fallThrough && !b.fallThrough);
+    });
+
+    size_t pinned = blocks.back().fallsThrough ? count - 1 : NO_BLOCK;
+    std::vector<size_t> next(count, NO_BLOCK);
+    std::vector<bool> hasPrevious(count, false);
+    std::vector<size_t> chain(count);
+    std::vector<std::vector<size_t>> members(count);
+    size_t chains = count;
+    for (size_t b = 0; b < count; ++b) {
+        chain[b] = b;
+        members[b].push_back(b);
+    }
+    for (const Edge &edge : edges) {
+        if (next[edge.from] != NO_BLOCK || hasPrevious[edge.to] ||
+            edge.to == 0 || edge.from == pinned || chain[edge.from] == chain[edge.to]) {
+            continue;
+        }
+        // The first chain goes first and the pinned one last, they can't
+        // become one while other chains remain
+        if (chains > 2 && pinned != NO_BLOCK && chain[edge.from] == chain[0] && chain[edge.to] == chain[pinned]) {
+            continue;
+        }
+        next[edge.from] = edge.to;
+        hasPrevious[edge.to] = true;
+        size_t from = chain[edge.from], to = chain[edge.to];
+        for (size_t b : members[to]) {
+            chain[b] = from;
+        }
+        members[from].insert(members[from].end(), members[to].begin(), members[to].end());
+        members[to].clear();
+        --chains;
+    }
+
+    std::vector<size_t> heads;
+    for (size_t b = 0; b < count; ++b) {
+        if (!hasPrevious[b] && (pinned == NO_BLOCK || chain[b] != chain[pinned] || chain[b] == chain[0])) {
+            heads.push_back(b);
+        }
+    }
+    if (pinned != NO_BLOCK && chain[pinned] != chain[0]) {
+        heads.push_back(members[chain[pinned]].front());
+    }
+    std::vector<size_t> order;
+    order.reserve(count);
+    for (size_t head : heads) {
+        for (size_t b = head; b != NO_BLOCK; b = next[b]) {
+            order.push_back(b);
+        }
+    }
+    return order;
+}
+
+const std::string &BlockReorderer::labelOf(Block &block) {
+    while (block.label.empty()) {
+        std::string name = "__block_" + std::to_string(++generatedLabels);
+        if (labels.insert(name).second) {
+            block.label = name;
+        }
+    }
+    return block.label;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "BranchProfile.hpp"
+#include "Command.hpp"
+#include <unordered_set>
+
+// Taken counts are estimated from the profile, for the layout the linker
+// emitted and for the reordered one
+struct BlockOrderStatistics {
+    size_t blocks = 0;
+    size_t movedBlocks = 0;
+    size_t invertedBranches = 0;
+    size_t insertedJumps = 0;
+    size_t removedJumps = 0;
+    uint64_t takenBefore = 0;
+    uint64_t takenAfter = 0;
+};
+
+// Profile-guided basic block layout. Within each run of code between data,
+// org and def directives, blocks are chained along their hottest edges,
+// heaviest first, so that the common successor of a branch or jmp is the
+// next block and the transfer falls through. Branches are inverted when
+// their taken side is placed next, jmps to the next block are dropped and a
+// jmp is added where a fall-through successor ends up elsewhere. The first
+// block of a run stays first and a block that runs off its end stays last.
+// Edges the profile never saw keep the source order, and so does a run
+// whose taken count the new order wouldn't lower.
+class BlockReorderer {
+public:
+    BlockReorderer(const std::vector<Command> &commands, const std::vector<std::string> &sourceFiles, const BranchProfile &profile);
+    bool reorder();
+    const std::vector<Command> &getCommands() const;
+    const BlockOrderStatistics &getStatistics() const;
+private:
+    static constexpr size_t NO_BLOCK = ~0;
+
+    struct Block {
+        size_t begin;
+        size_t end;
+        size_t terminator = NO_BLOCK;   // command of the jmp or branch ending the block
+        size_t target = NO_BLOCK;       // block a direct jmp or branch goes to
+        bool fallsThrough = true;
+        uint64_t taken = 0;
+        uint64_t notTaken = 0;
+        uint64_t flow = 0;              // estimated entries, from the counts of the edges into it
+        std::string label;              // to jump to the block, generated if it has none
+    };
+
+    struct Edge {
+        size_t from;
+        size_t to;
+        uint64_t weight;
+        bool fallThrough;               // the blocks are adjacent in the source
+    };
+
+    std::vector<Command> commands;
+    const std::vector<std::string> &sourceFiles;
+    const BranchProfile &profile;
+    BlockOrderStatistics statistics;
+    std::unordered_set<std::string> labels;
+    size_t generatedLabels = 0;
+
+    bool reorderRegion(size_t begin, size_t end, std::vector<Command> &reordered);
+    std::vector<Block> findBlocks(size_t begin, size_t end);
+    std::vector<size_t> chainBlocks(const std::vector<Block> &blocks) const;
+    const std::string &labelOf(Block &block);
+};
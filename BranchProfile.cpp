@@ -0,0 +1,80 @@
+#include "BranchProfile.hpp"
+#include <fstream>
+#include <sstream>
+
+// Counts of a branch seen twice, in two runs, add up
+void BranchProfile::add(const std::string &file, int line, uint64_t taken, uint64_t notTaken) {
+    BranchCounts &branch = counts[{ file, line }];
+    branch.taken += taken;
+    branch.notTaken += notTaken;
+}
+
+const BranchCounts *BranchProfile::find(const std::string &file, int line) const {
+    auto it = counts.find({ file, line });
+    return it != counts.end() ? &it->second : nullptr;
+}
+
+size_t BranchProfile::size() const {
+    return counts.size();
+}
+
+uint64_t BranchProfile::getTakenCount() const {
+    uint64_t taken = 0;
+    for (const auto &branch : counts) {
+        taken += branch.second.taken;
+    }
+    return taken;
+}
+
+// One "<line> <taken> <not taken> <file>" record per line, the file name runs
+// to the end of the line; ';' starts a comment
+bool BranchProfile::load(const std::string &filename) {
+    std::ifstream fileStream(filename);
+    if (!fileStream) {
+        errors.emplace_back("Failed to open branch profile", Error::NO_LINE, filename);
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(fileStream, line)) {
+        ++lineNumber;
+        if (!line.empty() && line[0] == ';') {
+            continue;
+        }
+        std::istringstream iss(line);
+        int sourceLine;
+        uint64_t taken, notTaken;
+        std::string file;
+        if (!(iss >> sourceLine)) {
+            continue;
+        }
+        if (!(iss >> taken >> notTaken) || !std::getline(iss >> std::ws, file) || file.empty()) {
+            errors.emplace_back("Expected taken and not taken counts and a file", lineNumber, filename);
+            continue;
+        }
+        add(file, sourceLine, taken, notTaken);
+    }
+    return errors.empty();
+}
+
+bool BranchProfile::save(const std::string &filename) {
+    std::ofstream file(filename);
+    file << "; line taken not-taken file\n";
+    for (const auto &branch : counts) {
+        file << branch.first.second << " " << branch.second.taken << " " << branch.second.notTaken << " "
+            << branch.first.first << "\n";
+    }
+    if (!file) {
+        errors.emplace_back("Couldn't write branch profile", Error::NO_LINE, filename);
+        return false;
+    }
+    return true;
+}
+
+const std::vector<Error> &BranchProfile::getErrors() const {
+    return errors;
+}
+
+bool BranchProfile::hasErrors() const {
+    return !errors.empty();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Error.hpp"
+#include <cstdint>
+#include <map>
+#include <vector>
+
+struct BranchCounts {
+    uint64_t taken = 0;
+    uint64_t notTaken = 0;
+};
+
+// Taken and not-taken counts of the branches and jumps of a training run,
+// keyed by source file and line so the profile still applies after the
+// program is laid out differently. A jmp is never not taken.
+class BranchProfile {
+public:
+    void add(const std::string &file, int line, uint64_t taken, uint64_t notTaken);
+    const BranchCounts *find(const std::string &file, int line) const;
+    size_t size() const;
+    uint64_t getTakenCount() const;
+    bool load(const std::string &filename);
+    bool save(const std::string &filename);
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+private:
+    std::map<std::pair<std::string, int>, BranchCounts> counts;    // ordered, so saved profiles diff cleanly
+    std::vector<Error> errors;
+};
@@ -0,0 +1,71 @@
+#include "BufferedWriter.hpp"
+#include <cstring>
+
+BufferedWriter::BufferedWriter(size_t capacity) : buffer(capacity > 0 ? capacity : 1) {}
+
+BufferedWriter::~BufferedWriter() {
+    close();
+}
+
+bool BufferedWriter::open(const std::string &filename) {
+    close();
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        errors.emplace_back("Couldn't create file", Error::NO_LINE, filename);
+        return false;
+    }
+    this->filename = filename;
+    written = 0;
+    return true;
+}
+
+// Writes larger than the buffer go straight to the file
+void BufferedWriter::write(const char *data, size_t size) {
+    if (used + size > buffer.size()) {
+        flush();
+        if (size >= buffer.size()) {
+            file.write(data, size);
+            written += size;
+            return;
+        }
+    }
+    std::memcpy(buffer.data() + used, data, size);
+    used += size;
+}
+
+void BufferedWriter::write(const std::string &text) {
+    write(text.data(), text.size());
+}
+
+bool BufferedWriter::close() {
+    if (!file.is_open()) {
+        return true;
+    }
+    flush();
+    file.close();
+    if (!file) {
+        errors.emplace_back("Couldn't write file", Error::NO_LINE, filename);
+        return false;
+    }
+    return true;
+}
+
+uint64_t BufferedWriter::getWrittenBytes() const {
+    return written + used;
+}
+
+const std::vector<Error> &BufferedWriter::getErrors() const {
+    return errors;
+}
+
+bool BufferedWriter::hasErrors() const {
+    return !errors.empty();
+}
+
+void BufferedWriter::flush() {
+    if (used > 0) {
+        file.write(buffer.data(), used);
+        written += used;
+        used = 0;
+    }
+}
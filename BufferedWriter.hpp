@@ -0,0 +1,32 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Error.hpp"
+
+// Output file written through one large buffer, so bulk output costs a
+// handful of large writes instead of one per line
+class BufferedWriter {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1u << 22;
+
+    explicit BufferedWriter(size_t capacity = DEFAULT_CAPACITY);
+    ~BufferedWriter();
+    bool open(const std::string &filename);
+    void write(const char *data, size_t size);
+    void write(const std::string &text);
+    bool close();
+    uint64_t getWrittenBytes() const;
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+private:
+    std::ofstream file;
+    std::string filename;
+    std::vector<char> buffer;
+    size_t used = 0;
+    uint64_t written = 0;
+    std::vector<Error> errors;
+
+    void flush();
+};
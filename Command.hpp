@@ -1,59 +1,75 @@
-#pragma once
-
-#include "Token.hpp"
-#include <unordered_set>
-
-enum class AddressingMode {
-    None,
-    Immediate,
-    RegisterDirect,
-    MemoryDirect,
-    RegisterIndirect,
-    RegisterIndirectWithDisplacement
-};
-
-class Command {
-public:
-    enum class Type {
-        Instruction,
-        Directive,
-        SymbolDefinition,
-        Label
-    };
-    enum class Sign {
-        Plus,
-        Minus
-    };
-    static Command createInstruction0(const std::string &name);
-    static Command createInstruction(const std::string &name, AddressingMode addressingMode, const std::string &numberOrSymbol, Sign sign, int r1, int r2 = 0);
-    static Command createInstruction3(const std::string &name, int r1, int r2, int r3);
-    static Command createDirective(const std::string &name, const std::string &numberOrSymbol, uint32_t dupNumber = 0);
-    static Command createSymbolDefinition(const std::string &name, const std::string &number);
-    static Command createLabel(const std::string &name);
-    Type getType() const;
-    const std::string &getName() const;
-    AddressingMode getAddressingMode() const;
-    const std::string &getNumberOrSymbol() const;
-    uint32_t getDupNumber() const;
-    int getR1() const;
-    int getR2() const;
-    int getR3() const;
-    std::string toString() const;
-    uint32_t getMemorySizeWords() const;
-
-private:
-    Type type;
-    AddressingMode addressingMode = AddressingMode::None;
-    std::string name;
-    std::string numberOrSymbol;
-    uint32_t dupNumber = 0; // only used for dup
-    Sign sign; // used for register indirect with displacement
-    int r1 = 0;
-    int r2 = 0;
-    int r3 = 0;
-
-    Command(Type type, std::string name);
-
-    Command(Type type, const std::string &name, AddressingMode addressingMode, const std::string &numberOrSymbol, 
-        Sign sign, int r1 = 0, int r2 = 0, int r3 = 0);
+#pragma once
+
+#include "Token.hpp"
+#include <cstdint>
+#include <unordered_set>
+
+enum class AddressingMode {
+    None,
+    Immediate,
+    RegisterDirect,
+    MemoryDirect,
+    RegisterIndirect,
+    RegisterIndirectWithDisplacement
+};
+
+std::string toString(AddressingMode mode);
+
+class Command {
+public:
+    enum class Type {
+        Instruction,
+        Directive,
+        SymbolDefinition,
+        Label
+    };
+    enum class Sign {
+        Plus,
+        Minus
+    };
+    static Command createInstruction0(const std::string &name);
+    static Command createInstruction(const std::string &name, AddressingMode addressingMode, const std::string &numberOrSymbol, Sign sign, int r1, int r2 = 0);
+    static Command createInstruction3(const std::string &name, int r1, int r2, int r3);
+    static Command createDirective(const std::string &name, const std::string &numberOrSymbol, uint32_t dupNumber = 0);
+    static Command createSymbolDefinition(const std::string &name, const std::string &number);
+    static Command createLabel(const std::string &name);
+    Type getType() const;
+    const std::string &getName() const;
+    AddressingMode getAddressingMode() const;
+    const std::string &getNumberOrSymbol() const;
+    Sign getSign() const;
+    uint32_t getDupNumber() const;
+    int getR1() const;
+    int getR2() const;
+    int getR3() const;
+    std::string toString() const;
+    std::string toSource() const;
+    uint32_t getMemorySizeWords() const;
+    int getLine() const;
+    uint32_t getFileIndex() const;
+    uint32_t getAddress() const;
+    void setName(const std::string &name);
+    void setNumberOrSymbol(const std::string &numberOrSymbol);
+    void setLine(int line);
+    void setFileIndex(uint32_t fileIndex);
+    void setAddress(uint32_t address);
+
+private:
+    Type type;
+    AddressingMode addressingMode = AddressingMode::None;
+    std::string name;
+    std::string numberOrSymbol;
+    uint32_t dupNumber = 0; // only used for dup
+    Sign sign; // used for register indirect with displacement
+    int r1 = 0;
+    int r2 = 0;
+    int r3 = 0;
+    int line = Error::NO_LINE;
+    uint32_t fileIndex = 0; // index into the linker's source files
+    uint32_t address = 0;   // word address, assigned by the layout
+
+    Command(Type type, std::string name);
+
+    Command(Type type, const std::string &name, AddressingMode addressingMode, const std::string &numberOrSymbol, 
+        Sign sign, int r1 = 0, int r2 = 0, int r3 = 0);
 };
\ No newline at end of file
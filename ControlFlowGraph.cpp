@@ -0,0 +1,429 @@
+#include "ControlFlowGraph.hpp"
+#include "Isa.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+ControlFlowGraph::ControlFlowGraph(const std::vector<Command> &commands, const LatencyTable &latencies)
+    : commands(commands), latencies(latencies) {}
+
+void ControlFlowGraph::build() {
+    blocks.clear();
+    loops.clear();
+    labelBlocks.clear();
+    routineEstimates.clear();
+    splitBlocks();
+    connectBlocks();
+    findLoops();
+}
+
+void ControlFlowGraph::setLoopTripCount(uint32_t tripCount) {
+    loopTripCount = tripCount;
+    routineEstimates.clear();
+}
+
+const std::vector<BasicBlock> &ControlFlowGraph::getBlocks() const {
+    return blocks;
+}
+
+const std::vector<Loop> &ControlFlowGraph::getLoops() const {
+    return loops;
+}
+
+size_t ControlFlowGraph::getBlockOfLabel(const std::string &label) const {
+    auto it = labelBlocks.find(label);
+    return it != labelBlocks.end() ? it->second : NO_BLOCK;
+}
+
+size_t ControlFlowGraph::getBlockOfCommand(size_t commandIndex) const {
+    return commandIndex < commandBlocks.size() ? commandBlocks[commandIndex] : NO_BLOCK;
+}
+
+// A block runs loopTripCount times for every loop it is nested in
+uint64_t ControlFlowGraph::getBlockEstimate(size_t block) const {
+    uint64_t estimate = blocks[block].cycles;
+    for (int i = 0; i < blocks[block].loopDepth; ++i) {
+        if (estimate > UINT64_MAX / std::max<uint32_t>(loopTripCount, 1)) {
+            return UINT64_MAX;
+        }
+        estimate *= loopTripCount;
+    }
+    return estimate;
+}
+
+// Cost of everything reachable from the label, called routines included
+uint64_t ControlFlowGraph::getLabelEstimate(const std::string &label) const {
+    size_t block = getBlockOfLabel(label);
+    if (block == NO_BLOCK) {
+        return 0;
+    }
+    std::vector<size_t> callDepths(blocks.size(), 0);
+    size_t openDepth = SIZE_MAX;
+    return estimateRoutine(block, 1, callDepths, openDepth);
+}
+
+// Leaders are the first instruction, labelled instructions and instructions after jumps;
+// data directives end a block without falling through
+void ControlFlowGraph::splitBlocks() {
+    commandBlocks.assign(commands.size(), NO_BLOCK);
+    std::vector<std::string> pendingLabels;
+    size_t pendingFirst = 0;
+    bool open = false;
+
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const Command &command = commands[i];
+        switch (command.getType()) {
+        case Command::Type::Label:
+            if (pendingLabels.empty()) {
+                pendingFirst = i;
+            }
+            pendingLabels.push_back(command.getName());
+            open = false;
+            break;
+        case Command::Type::Instruction: {
+            if (!open) {
+                BasicBlock block;
+                block.first = pendingLabels.empty() ? i : pendingFirst;
+                block.last = i;
+                block.address = command.getAddress();
+                block.labels = pendingLabels;
+                for (const std::string &label : pendingLabels) {
+                    labelBlocks[label] = blocks.size();
+                }
+                for (size_t j = block.first; j < i; ++j) {
+                    commandBlocks[j] = blocks.size();
+                }
+                pendingLabels.clear();
+                blocks.push_back(block);
+                open = true;
+            }
+            BasicBlock &block = blocks.back();
+            block.last = i + 1;
+            block.instructionCount++;
+            block.cycles += latencies.getLatency(command);
+            commandBlocks[i] = blocks.size() - 1;
+
+            const std::string &name = command.getName();
+            if (Isa::transfersControl(name)) {
+                open = false;
+            }
+            break;
+        }
+        case Command::Type::Directive:
+            pendingLabels.clear(); // labels on data aren't code
+            open = false;
+            break;
+        case Command::Type::SymbolDefinition:
+            break;
+        }
+    }
+}
+
+void ControlFlowGraph::connectBlocks() {
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        BasicBlock &block = blocks[b];
+        const Command &last = commands[block.last - 1];
+        const std::string &name = last.getName();
+        size_t fallthrough = fallthroughBlock(block.last);
+
+        if (Isa::isKind(name, InstructionKind::Return)) {
+            continue;
+        }
+        if (name == "call") {
+            size_t target = jumpTarget(last);
+            if (target == NO_BLOCK) {
+                block.hasIndirectJump = true;
+            }
+            else {
+                block.callees.push_back(target);
+            }
+            if (fallthrough != NO_BLOCK) {
+                block.successors.push_back(fallthrough);
+            }
+            continue;
+        }
+        if (Isa::isKind(name, InstructionKind::Jump) || Isa::isKind(name, InstructionKind::Branch)) {
+            size_t target = jumpTarget(last);
+            if (target == NO_BLOCK) {
+                block.hasIndirectJump = true;
+            }
+            else {
+                block.successors.push_back(target);
+            }
+            if (Isa::isKind(name, InstructionKind::Branch) && fallthrough != NO_BLOCK && fallthrough != target) {
+                block.successors.push_back(fallthrough);
+            }
+            continue;
+        }
+        if (fallthrough != NO_BLOCK) {
+            block.successors.push_back(fallthrough);
+        }
+    }
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        for (size_t successor : blocks[b].successors) {
+            blocks[successor].predecessors.push_back(b);
+        }
+    }
+}
+
+// Block entered by falling off the command at commandIndex - 1
+size_t ControlFlowGraph::fallthroughBlock(size_t commandIndex) const {
+    for (size_t i = commandIndex; i < commands.size(); ++i) {
+        Command::Type type = commands[i].getType();
+        if (type == Command::Type::Instruction) {
+            return commandBlocks[i];
+        }
+        if (type == Command::Type::Directive) {
+            return NO_BLOCK;
+        }
+    }
+    return NO_BLOCK;
+}
+
+size_t ControlFlowGraph::jumpTarget(const Command &command) const {
+    if (command.getAddressingMode() != AddressingMode::MemoryDirect) {
+        return NO_BLOCK;
+    }
+    return getBlockOfLabel(command.getNumberOrSymbol());
+}
+
+// Cooper-Harvey-Kennedy over a virtual root that enters every block without
+// predecessors and every call target; returns the immediate dominator of each block
+std::vector<size_t> ControlFlowGraph::computeDominators() const {
+    const size_t root = blocks.size();
+    std::vector<bool> isEntry(blocks.size(), false);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (blocks[b].predecessors.empty()) {
+            isEntry[b] = true;
+        }
+        for (size_t callee : blocks[b].callees) {
+            isEntry[callee] = true;
+        }
+    }
+
+    // Postorder numbering, blocks stuck in unreachable cycles become entries as well
+    std::vector<size_t> postorder;
+    std::vector<size_t> order(blocks.size() + 1, NO_BLOCK);
+    std::vector<bool> visited(blocks.size(), false);
+    auto walk = [&](size_t start) {
+        std::vector<std::pair<size_t, size_t>> stack = { { start, 0 } };
+        visited[start] = true;
+        while (!stack.empty()) {
+            auto &[block, next] = stack.back();
+            if (next < blocks[block].successors.size()) {
+                size_t successor = blocks[block].successors[next++];
+                if (!visited[successor]) {
+                    visited[successor] = true;
+                    stack.push_back({ successor, 0 });
+                }
+                continue;
+            }
+            order[block] = postorder.size();
+            postorder.push_back(block);
+            stack.pop_back();
+        }
+    };
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (isEntry[b] && !visited[b]) {
+            walk(b);
+        }
+    }
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (!visited[b]) {
+            isEntry[b] = true;
+            walk(b);
+        }
+    }
+    order[root] = postorder.size();
+
+    std::vector<size_t> dominators(blocks.size() + 1, NO_BLOCK);
+    dominators[root] = root;
+    auto intersect = [&](size_t a, size_t b) {
+        while (a != b) {
+            while (order[a] < order[b]) {
+                a = dominators[a];
+            }
+            while (order[b] < order[a]) {
+                b = dominators[b];
+            }
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = postorder.rbegin(); it != postorder.rend(); ++it) {
+            size_t block = *it;
+            size_t dominator = isEntry[block] ? root : NO_BLOCK;
+            for (size_t predecessor : blocks[block].predecessors) {
+                if (dominators[predecessor] == NO_BLOCK) {
+                    continue;
+                }
+                dominator = dominator == NO_BLOCK ? predecessor : intersect(predecessor, dominator);
+            }
+            if (dominators[block] != dominator) {
+                dominators[block] = dominator;
+                changed = true;
+            }
+        }
+    }
+    return dominators;
+}
+
+bool ControlFlowGraph::dominates(const std::vector<size_t> &dominators, size_t dominator, size_t block) const {
+    const size_t root = blocks.size();
+    while (block != root && block != NO_BLOCK) {
+        if (block == dominator) {
+            return true;
+        }
+        block = dominators[block];
+    }
+    return false;
+}
+
+// A back edge u -> h with h dominating u defines the natural loop of h
+void ControlFlowGraph::findLoops() {
+    std::vector<size_t> dominators = computeDominators();
+    std::unordered_map<size_t, size_t> headerLoops;
+
+    for (size_t u = 0; u < blocks.size(); ++u) {
+        for (size_t header : blocks[u].successors) {
+            if (!dominates(dominators, header, u)) {
+                continue;
+            }
+            auto found = headerLoops.find(header);
+            if (found == headerLoops.end()) {
+                found = headerLoops.emplace(header, loops.size()).first;
+                loops.push_back({ header, { header } });
+            }
+            Loop &loop = loops[found->second];
+            std::vector<bool> inLoop(blocks.size(), false);
+            for (size_t block : loop.blocks) {
+                inLoop[block] = true;
+            }
+            std::vector<size_t> worklist;
+            if (!inLoop[u]) {
+                inLoop[u] = true;
+                loop.blocks.push_back(u);
+                worklist.push_back(u);
+            }
+            while (!worklist.empty()) {
+                size_t block = worklist.back();
+                worklist.pop_back();
+                for (size_t predecessor : blocks[block].predecessors) {
+                    if (!inLoop[predecessor]) {
+                        inLoop[predecessor] = true;
+                        loop.blocks.push_back(predecessor);
+                        worklist.push_back(predecessor);
+                    }
+                }
+            }
+        }
+    }
+
+    for (Loop &loop : loops) {
+        std::sort(loop.blocks.begin(), loop.blocks.end());
+        for (size_t block : loop.blocks) {
+            blocks[block].loopDepth++;
+        }
+    }
+}
+
+// Recursive calls are counted once, the call that closes the cycle adds nothing.
+// callDepths holds the call depth of the routines in progress and 0 for the
+// others. openDepth is lowered to the depth of any routine in progress that
+// a cycle led back to; an estimate that cut a cycle above its own routine is
+// partial and isn't cached.
+uint64_t ControlFlowGraph::estimateRoutine(size_t entry, size_t depth, std::vector<size_t> &callDepths, size_t &openDepth) const {
+    auto cached = routineEstimates.find(entry);
+    if (cached != routineEstimates.end()) {
+        return cached->second;
+    }
+    if (callDepths[entry]) {
+        openDepth = std::min(openDepth, callDepths[entry]);
+        return 0;
+    }
+    callDepths[entry] = depth;
+
+    uint64_t estimate = 0;
+    size_t reachedDepth = SIZE_MAX;
+    std::vector<bool> reached(blocks.size(), false);
+    std::vector<size_t> worklist = { entry };
+    reached[entry] = true;
+    while (!worklist.empty()) {
+        size_t block = worklist.back();
+        worklist.pop_back();
+        uint64_t blockEstimate = getBlockEstimate(block);
+        estimate = estimate > UINT64_MAX - blockEstimate ? UINT64_MAX : estimate + blockEstimate;
+
+        uint64_t multiplier = blocks[block].cycles ? blockEstimate / blocks[block].cycles : 1;
+        for (size_t callee : blocks[block].callees) {
+            uint64_t calleeEstimate = estimateRoutine(callee, depth + 1, callDepths, reachedDepth);
+            uint64_t callCost = calleeEstimate > UINT64_MAX / std::max<uint64_t>(multiplier, 1) ? UINT64_MAX : calleeEstimate * multiplier;
+            estimate = estimate > UINT64_MAX - callCost ? UINT64_MAX : estimate + callCost;
+        }
+        for (size_t successor : blocks[block].successors) {
+            if (!reached[successor]) {
+                reached[successor] = true;
+                worklist.push_back(successor);
+            }
+        }
+    }
+
+    callDepths[entry] = 0;
+    if (reachedDepth < depth) {
+        openDepth = std::min(openDepth, reachedDepth);
+    }
+    else {
+        routineEstimates[entry] = estimate;
+    }
+    return estimate;
+}
+
+std::string ControlFlowGraph::report() const {
+    std::ostringstream oss;
+    oss << "Basic blocks: " << blocks.size() << "\n";
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        const BasicBlock &block = blocks[b];
+        oss << "Block " << b << " at 0x" << std::hex << std::setw(8) << std::setfill('0') << block.address << std::dec;
+        for (const std::string &label : block.labels) {
+            oss << " " << label << ":";
+        }
+        oss << "\n";
+        oss << "  Instructions: " << block.instructionCount << ", Cycles: " << block.cycles
+            << ", Loop depth: " << block.loopDepth << ", Estimate: " << getBlockEstimate(b) << "\n";
+        oss << "  Successors:";
+        for (size_t successor : block.successors) {
+            oss << " " << successor;
+        }
+        if (block.hasIndirectJump) {
+            oss << " (indirect)";
+        }
+        oss << "\n";
+        if (!block.callees.empty()) {
+            oss << "  Calls:";
+            for (size_t callee : block.callees) {
+                oss << " " << callee;
+            }
+            oss << "\n";
+        }
+    }
+
+    oss << "Loops: " << loops.size() << "\n";
+    for (const Loop &loop : loops) {
+        oss << "  Header " << loop.header << ", Blocks:";
+        for (size_t block : loop.blocks) {
+            oss << " " << block;
+        }
+        oss << "\n";
+    }
+
+    oss << "Label estimates (loop trip count " << loopTripCount << "):\n";
+    for (const BasicBlock &block : blocks) {
+        for (const std::string &label : block.labels) {
+            oss << "  " << label << ": " << getLabelEstimate(label) << " cycles\n";
+        }
+    }
+    return oss.str();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "LatencyTable.hpp"
+#include <unordered_map>
+
+struct BasicBlock {
+    size_t first;                       // index of the first command (labels included)
+    size_t last;                        // one past the last instruction
+    uint32_t address;
+    std::vector<std::string> labels;
+    std::vector<size_t> successors;
+    std::vector<size_t> predecessors;
+    std::vector<size_t> callees;        // blocks entered through call
+    uint32_t instructionCount = 0;
+    uint32_t cycles = 0;                // one pass through the block
+    int loopDepth = 0;
+    bool hasIndirectJump = false;       // jump through a register or memory, successors unknown
+};
+
+struct Loop {
+    size_t header;
+    std::vector<size_t> blocks;         // header included
+};
+
+// Splits the linked command stream into basic blocks, connects them with
+// jump/fall-through and call edges, detects natural loops and estimates
+// static cycle counts from a latency table.
+class ControlFlowGraph {
+public:
+    static constexpr size_t NO_BLOCK = ~0;
+    static constexpr uint32_t DEFAULT_LOOP_TRIP_COUNT = 10;
+
+    ControlFlowGraph(const std::vector<Command> &commands, const LatencyTable &latencies = LatencyTable::getDefault());
+    void build();
+    void setLoopTripCount(uint32_t tripCount);
+
+    const std::vector<BasicBlock> &getBlocks() const;
+    const std::vector<Loop> &getLoops() const;
+    size_t getBlockOfLabel(const std::string &label) const;
+    size_t getBlockOfCommand(size_t commandIndex) const;
+    uint64_t getBlockEstimate(size_t block) const;
+    uint64_t getLabelEstimate(const std::string &label) const;
+    std::string report() const;
+private:
+    const std::vector<Command> &commands;
+    const LatencyTable &latencies;
+    uint32_t loopTripCount = DEFAULT_LOOP_TRIP_COUNT;
+    std::vector<BasicBlock> blocks;
+    std::vector<Loop> loops;
+    std::unordered_map<std::string, size_t> labelBlocks;
+    std::vector<size_t> commandBlocks;
+    mutable std::unordered_map<size_t, uint64_t> routineEstimates;   // finished routines only
+
+    void splitBlocks();
+    void connectBlocks();
+    void findLoops();
+    std::vector<size_t> computeDominators() const;
+    bool dominates(const std::vector<size_t> &dominators, size_t dominator, size_t block) const;
+    size_t fallthroughBlock(size_t commandIndex) const;
+    size_t jumpTarget(const Command &command) const;
+    uint64_t estimateRoutine(size_t entry, size_t depth, std::vector<size_t> &callDepths, size_t &openDepth) const;
+};
@@ -0,0 +1,332 @@
+#include "CrossReference.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t align8(size_t offset) {
+    return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+// Byte offsets of the arrays behind the header
+struct XrefLayout {
+    size_t symbols, uses, callees, callers, files, strings, end;
+
+    explicit XrefLayout(const XrefHeader &header) {
+        symbols = align8(sizeof(XrefHeader));
+        uses = align8(symbols + header.symbolCount * sizeof(XrefSymbol));
+        callees = align8(uses + header.useCount * sizeof(XrefUse));
+        callers = align8(callees + header.edgeCount * sizeof(uint32_t));
+        files = align8(callers + header.edgeCount * sizeof(uint32_t));
+        strings = align8(files + header.fileCount * sizeof(XrefFile));
+        end = strings + header.stringBytes;
+    }
+};
+
+static bool isSymbolic(const std::string &numberOrSymbol) {
+    return !numberOrSymbol.empty() && !std::isdigit(static_cast<unsigned char>(numberOrSymbol[0]));
+}
+
+CrossReference::CrossReference(const std::vector<Command> &commands, const std::unordered_map<std::string, uint32_t> &symbolTable,
+    const std::vector<std::string> &sourceFiles) {
+    std::vector<std::string> names;
+    names.reserve(symbolTable.size());
+    for (const auto &symbol : symbolTable) {
+        names.push_back(symbol.first);
+    }
+    std::sort(names.begin(), names.end());
+    std::unordered_map<std::string, uint32_t> indices;
+    symbols.resize(names.size());
+    for (uint32_t i = 0; i < names.size(); ++i) {
+        indices.emplace(names[i], i);
+        XrefSymbol &symbol = symbols[i];
+        std::memset(&symbol, 0, sizeof(symbol));
+        symbol.name = addString(names[i]);
+        symbol.nameLength = static_cast<uint32_t>(names[i].size());
+        symbol.value = symbolTable.at(names[i]);
+        symbol.file = NONE;
+        symbol.line = Error::NO_LINE;
+    }
+    for (const std::string &source : sourceFiles) {
+        files.push_back({ addString(source), static_cast<uint32_t>(source.size()) });
+    }
+
+    std::vector<std::pair<uint32_t, XrefUse>> found;
+    std::vector<std::pair<uint32_t, uint32_t>> calls;
+    uint32_t routine = NONE;
+    for (const Command &command : commands) {
+        Command::Type type = command.getType();
+        if (type == Command::Type::Label || type == Command::Type::SymbolDefinition) {
+            auto index = indices.find(command.getName());
+            if (index != indices.end()) {
+                XrefSymbol &symbol = symbols[index->second];
+                symbol.file = command.getFileIndex();
+                symbol.line = command.getLine();
+                symbol.kind = type == Command::Type::Label ? LABEL : DEFINITION;
+                if (type == Command::Type::Label) {
+                    routine = index->second;
+                }
+            }
+        }
+        else if (isSymbolic(command.getNumberOrSymbol())) {
+            auto index = indices.find(command.getNumberOrSymbol());
+            if (index != indices.end()) {
+                const InstructionInfo *info = type == Command::Type::Instruction ? Isa::find(command.getName()) : nullptr;
+                XrefUse use;
+                std::memset(&use, 0, sizeof(use));
+                use.address = command.getAddress();
+                use.file = command.getFileIndex();
+                use.line = command.getLine();
+                use.routine = routine;
+                use.opcode = info ? static_cast<uint8_t>(info->opcode) : NO_OPCODE;
+                use.mode = static_cast<uint8_t>(command.getAddressingMode());
+                found.emplace_back(index->second, use);
+                if (info && info->opcode == Opcode::Call && routine != NONE) {
+                    calls.emplace_back(routine, index->second);
+                }
+            }
+        }
+    }
+
+    std::stable_sort(found.begin(), found.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    uses.reserve(found.size());
+    for (const auto &use : found) {
+        XrefSymbol &symbol = symbols[use.first];
+        if (symbol.useCount++ == 0) {
+            symbol.firstUse = static_cast<uint32_t>(uses.size());
+        }
+        uses.push_back(use.second);
+    }
+
+    std::sort(calls.begin(), calls.end());
+    calls.erase(std::unique(calls.begin(), calls.end()), calls.end());
+    for (const auto &call : calls) {
+        XrefSymbol &caller = symbols[call.first];
+        if (caller.calleeCount++ == 0) {
+            caller.firstCallee = static_cast<uint32_t>(callees.size());
+        }
+        callees.push_back(call.second);
+    }
+    std::sort(calls.begin(), calls.end(), [](const auto &a, const auto &b) {
+        return a.second != b.second ? a.second < b.second : a.first < b.first;
+    });
+    for (const auto &call : calls) {
+        XrefSymbol &callee = symbols[call.second];
+        if (callee.callerCount++ == 0) {
+            callee.firstCaller = static_cast<uint32_t>(callers.size());
+        }
+        callers.push_back(call.first);
+    }
+}
+
+bool CrossReference::write(const std::string &filename) {
+    XrefHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.symbolCount = static_cast<uint32_t>(symbols.size());
+    header.useCount = static_cast<uint32_t>(uses.size());
+    header.edgeCount = static_cast<uint32_t>(callees.size());
+    header.fileCount = static_cast<uint32_t>(files.size());
+    header.stringBytes = static_cast<uint32_t>(strings.size());
+    XrefLayout layout(header);
+
+    std::vector<char> bytes(layout.end, 0);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    std::memcpy(bytes.data() + layout.symbols, symbols.data(), symbols.size() * sizeof(XrefSymbol));
+    std::memcpy(bytes.data() + layout.uses, uses.data(), uses.size() * sizeof(XrefUse));
+    std::memcpy(bytes.data() + layout.callees, callees.data(), callees.size() * sizeof(uint32_t));
+    std::memcpy(bytes.data() + layout.callers, callers.data(), callers.size() * sizeof(uint32_t));
+    std::memcpy(bytes.data() + layout.files, files.data(), files.size() * sizeof(XrefFile));
+    std::memcpy(bytes.data() + layout.strings, strings.data(), strings.size());
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.write(bytes.data(), bytes.size())) {
+        errors.emplace_back("Couldn't write cross-reference", Error::NO_LINE, filename);
+        return false;
+    }
+    return true;
+}
+
+size_t CrossReference::getSymbolCount() const {
+    return symbols.size();
+}
+
+size_t CrossReference::getUseCount() const {
+    return uses.size();
+}
+
+size_t CrossReference::getEdgeCount() const {
+    return callees.size();
+}
+
+const std::vector<Error> &CrossReference::getErrors() const {
+    return errors;
+}
+
+bool CrossReference::hasErrors() const {
+    return !errors.empty();
+}
+
+uint32_t CrossReference::addString(const std::string &text) {
+    uint32_t offset = static_cast<uint32_t>(strings.size());
+    strings += text;
+    strings += '\0';
+    return offset;
+}
+
+CrossReferenceIndex::~CrossReferenceIndex() {
+    close();
+}
+
+bool CrossReferenceIndex::open(const std::string &filename) {
+    close();
+    int descriptor = ::open(filename.c_str(), O_RDONLY);
+    struct stat status;
+    if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+        errors.emplace_back("Couldn't open cross-reference", Error::NO_LINE, filename);
+        if (descriptor >= 0) {
+            ::close(descriptor);
+        }
+        return false;
+    }
+    size = static_cast<size_t>(status.st_size);
+    void *mapped = size >= sizeof(XrefHeader) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+    ::close(descriptor);
+    if (mapped == MAP_FAILED) {
+        errors.emplace_back("Couldn't map cross-reference", Error::NO_LINE, filename);
+        size = 0;
+        return false;
+    }
+    data = static_cast<const char *>(mapped);
+    header = reinterpret_cast<const XrefHeader *>(data);
+    if (std::memcmp(header->magic, CrossReference::MAGIC, sizeof(header->magic)) != 0 || header->version != CrossReference::VERSION) {
+        errors.emplace_back("Not a cross-reference file of this version", Error::NO_LINE, filename);
+        close();
+        return false;
+    }
+    XrefLayout layout(*header);
+    if (layout.end > size) {
+        errors.emplace_back("Cross-reference file is truncated", Error::NO_LINE, filename);
+        close();
+        return false;
+    }
+    symbols = reinterpret_cast<const XrefSymbol *>(data + layout.symbols);
+    uses = reinterpret_cast<const XrefUse *>(data + layout.uses);
+    callees = reinterpret_cast<const uint32_t *>(data + layout.callees);
+    callers = reinterpret_cast<const uint32_t *>(data + layout.callers);
+    files = reinterpret_cast<const XrefFile *>(data + layout.files);
+    strings = data + layout.strings;
+    if (!isValid()) {
+        errors.emplace_back("Cross-reference file is corrupt", Error::NO_LINE, filename);
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CrossReferenceIndex::close() {
+    if (data) {
+        munmap(const_cast<char *>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    header = nullptr;
+}
+
+const XrefSymbol *CrossReferenceIndex::find(std::string_view name) const {
+    if (!header) {
+        return nullptr;
+    }
+    const XrefSymbol *end = symbols + header->symbolCount;
+    const XrefSymbol *symbol = std::lower_bound(symbols, end, name, [this](const XrefSymbol &entry, std::string_view key) {
+        return getName(entry) < key;
+    });
+    return symbol != end && getName(*symbol) == name ? symbol : nullptr;
+}
+
+const XrefSymbol &CrossReferenceIndex::getSymbol(uint32_t index) const {
+    return symbols[index];
+}
+
+std::string_view CrossReferenceIndex::getName(const XrefSymbol &symbol) const {
+    return std::string_view(strings + symbol.name, symbol.nameLength);
+}
+
+std::string_view CrossReferenceIndex::getFilename(uint32_t file) const {
+    if (file >= header->fileCount) {
+        return std::string_view();
+    }
+    return std::string_view(strings + files[file].name, files[file].nameLength);
+}
+
+const XrefUse *CrossReferenceIndex::getUses(const XrefSymbol &symbol) const {
+    return uses + symbol.firstUse;
+}
+
+const uint32_t *CrossReferenceIndex::getCallees(const XrefSymbol &symbol) const {
+    return callees + symbol.firstCallee;
+}
+
+const uint32_t *CrossReferenceIndex::getCallers(const XrefSymbol &symbol) const {
+    return callers + symbol.firstCaller;
+}
+
+// Ranges are added up in 64 bits, counts near 2^32 can't wrap past a check
+bool CrossReferenceIndex::isValid() const {
+    auto inRange = [](uint32_t first, uint32_t count, uint32_t size) {
+        return static_cast<uint64_t>(first) + count <= size;
+    };
+    auto isSymbolOrNone = [this](uint32_t index) {
+        return index == CrossReference::NONE || index < header->symbolCount;
+    };
+    auto isFileOrNone = [this](uint32_t file) {
+        return file == CrossReference::NONE || file < header->fileCount;
+    };
+    for (uint32_t i = 0; i < header->fileCount; ++i) {
+        if (!isString(files[i].name, files[i].nameLength)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->symbolCount; ++i) {
+        const XrefSymbol &symbol = symbols[i];
+        if (!isString(symbol.name, symbol.nameLength) || !isFileOrNone(symbol.file) ||
+            (symbol.kind != CrossReference::LABEL && symbol.kind != CrossReference::DEFINITION) ||
+            !inRange(symbol.firstUse, symbol.useCount, header->useCount) ||
+            !inRange(symbol.firstCallee, symbol.calleeCount, header->edgeCount) ||
+            !inRange(symbol.firstCaller, symbol.callerCount, header->edgeCount)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->useCount; ++i) {
+        const XrefUse &use = uses[i];
+        if (!isFileOrNone(use.file) || !isSymbolOrNone(use.routine) ||
+            (use.opcode != CrossReference::NO_OPCODE && use.opcode >= INSTRUCTION_COUNT) ||
+            use.mode > static_cast<uint8_t>(AddressingMode::RegisterIndirectWithDisplacement)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->edgeCount; ++i) {
+        if (callees[i] >= header->symbolCount || callers[i] >= header->symbolCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether the string lies in the table and ends in a NUL inside it
+bool CrossReferenceIndex::isString(uint32_t offset, uint32_t length) const {
+    return static_cast<uint64_t>(offset) + length < header->stringBytes && strings[offset + length] == '\0' &&
+        std::memchr(strings + offset, '\0', length) == nullptr;
+}
+
+const std::vector<Error> &CrossReferenceIndex::getErrors() const {
+    return errors;
+}
+
+bool CrossReferenceIndex::hasErrors() const {
+    return !errors.empty();
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Isa.hpp"
+#include <unordered_map>
+
+// Records of a cross-reference file. The file is a header followed by the
+// symbol, use, edge and file arrays and the string table, each array 8-byte
+// aligned, so it can be mapped and read in place. Every string in the table
+// is followed by a NUL.
+struct XrefHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t symbolCount;
+    uint32_t useCount;
+    uint32_t edgeCount;         // entries of the callee and of the caller list
+    uint32_t fileCount;
+    uint32_t stringBytes;
+    uint32_t reserved;
+};
+
+// Symbols are sorted by name. Uses, callees and callers of a symbol are
+// consecutive ranges of the respective arrays.
+struct XrefSymbol {
+    uint32_t name;              // offset into the string table
+    uint32_t nameLength;
+    uint32_t value;
+    uint32_t file;              // of the definition, NO_FILE for none
+    int32_t line;
+    uint32_t firstUse;
+    uint32_t useCount;
+    uint32_t firstCallee;
+    uint32_t calleeCount;
+    uint32_t firstCaller;
+    uint32_t callerCount;
+    uint8_t kind;
+    uint8_t reserved[3];
+};
+
+struct XrefUse {
+    uint32_t address;           // of the using instruction or data word
+    uint32_t file;
+    int32_t line;
+    uint32_t routine;           // symbol of the enclosing label, NONE for none
+    uint8_t opcode;             // NO_OPCODE for directives
+    uint8_t mode;               // AddressingMode of the operand
+    uint8_t reserved[2];
+};
+
+struct XrefFile {
+    uint32_t name;
+    uint32_t nameLength;
+};
+
+static_assert(sizeof(XrefHeader) == 32 && sizeof(XrefSymbol) == 48 && sizeof(XrefUse) == 20 && sizeof(XrefFile) == 8,
+    "cross-reference records are stored as is");
+
+// Where every symbol is defined and used and which routine calls which,
+// built from a linked command stream. A routine is everything from one label
+// to the next, a call with a symbolic target is an edge from the routine it
+// sits in to that symbol.
+class CrossReference {
+public:
+    static constexpr uint32_t NONE = ~0u;
+    static constexpr uint8_t NO_OPCODE = 0xFF;
+    static constexpr uint8_t LABEL = 0;
+    static constexpr uint8_t DEFINITION = 1;
+    static constexpr char MAGIC[4] = { 'R', 'X', 'R', 'F' };
+    static constexpr uint32_t VERSION = 2;
+
+    CrossReference(const std::vector<Command> &commands, const std::unordered_map<std::string, uint32_t> &symbolTable,
+        const std::vector<std::string> &sourceFiles);
+    bool write(const std::string &filename);
+    size_t getSymbolCount() const;
+    size_t getUseCount() const;
+    size_t getEdgeCount() const;
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+private:
+    std::vector<XrefSymbol> symbols;
+    std::vector<XrefUse> uses;
+    std::vector<uint32_t> callees;
+    std::vector<uint32_t> callers;
+    std::vector<XrefFile> files;
+    std::string strings;
+    std::vector<Error> errors;
+
+    uint32_t addString(const std::string &text);
+};
+
+// Read-only view of a cross-reference file mapped into memory. Lookups are
+// a binary search over the symbols, everything else is indexing. Every
+// range, index and string of the file is checked when it is opened, so the
+// indexing can't leave the mapping whatever the file holds.
+class CrossReferenceIndex {
+public:
+    CrossReferenceIndex() = default;
+    CrossReferenceIndex(const CrossReferenceIndex &) = delete;
+    CrossReferenceIndex &operator=(const CrossReferenceIndex &) = delete;
+    ~CrossReferenceIndex();
+    bool open(const std::string &filename);
+    void close();
+    const XrefSymbol *find(std::string_view name) const;
+    const XrefSymbol &getSymbol(uint32_t index) const;
+    std::string_view getName(const XrefSymbol &symbol) const;
+    std::string_view getFilename(uint32_t file) const;
+    const XrefUse *getUses(const XrefSymbol &symbol) const;
+    const uint32_t *getCallees(const XrefSymbol &symbol) const;
+    const uint32_t *getCallers(const XrefSymbol &symbol) const;
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    const XrefHeader *header = nullptr;
+    const XrefSymbol *symbols = nullptr;
+    const XrefUse *uses = nullptr;
+    const uint32_t *callees = nullptr;
+    const uint32_t *callers = nullptr;
+    const XrefFile *files = nullptr;
+    const char *strings = nullptr;
+    std::vector<Error> errors;
+
+    bool isValid() const;
+    bool isString(uint32_t offset, uint32_t length) const;
+};
@@ -0,0 +1,108 @@
+#include "Device.hpp"
+#include "Emulator.hpp"
+#include <fstream>
+#include <iterator>
+
+ConsoleDevice::ConsoleDevice(std::ostream &out) : out(out) {
+    buffer.reserve(BUFFER_SIZE);
+}
+
+ConsoleDevice::~ConsoleDevice() {
+    flush();
+}
+
+uint32_t ConsoleDevice::getSize() const {
+    return 2;
+}
+
+bool ConsoleDevice::read(uint32_t, uint32_t &value) {
+    value = 0;
+    return true;
+}
+
+bool ConsoleDevice::write(uint32_t offset, uint32_t value) {
+    if (offset == 0) {
+        buffer.push_back(static_cast<char>(value & 0xFF));
+    }
+    else {
+        buffer += std::to_string(static_cast<int32_t>(value));
+    }
+    if (buffer.size() >= BUFFER_SIZE) {
+        flush();
+    }
+    return true;
+}
+
+void ConsoleDevice::flush() {
+    if (buffer.empty()) {
+        return;
+    }
+    out.write(buffer.data(), buffer.size());
+    out.flush();
+    written += buffer.size();
+    buffer.clear();
+}
+
+uint64_t ConsoleDevice::getWrittenBytes() const {
+    return written + buffer.size();
+}
+
+bool InputDevice::load(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        errors.emplace_back("Couldn't open input file", Error::NO_LINE, filename);
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    position = 0;
+    return true;
+}
+
+void InputDevice::rewind() {
+    position = 0;
+}
+
+uint32_t InputDevice::getSize() const {
+    return 2;
+}
+
+bool InputDevice::read(uint32_t offset, uint32_t &value) {
+    if (offset == 1) {
+        value = static_cast<uint32_t>(data.size() - position);
+    }
+    else if (position < data.size()) {
+        value = static_cast<unsigned char>(data[position++]);
+    }
+    else {
+        value = END_OF_INPUT;
+    }
+    return true;
+}
+
+bool InputDevice::write(uint32_t, uint32_t) {
+    return false;
+}
+
+const std::vector<Error> &InputDevice::getErrors() const {
+    return errors;
+}
+
+bool InputDevice::hasErrors() const {
+    return !errors.empty();
+}
+
+CycleCounterDevice::CycleCounterDevice(const Emulator &emulator) : emulator(emulator) {}
+
+uint32_t CycleCounterDevice::getSize() const {
+    return 4;
+}
+
+bool CycleCounterDevice::read(uint32_t offset, uint32_t &value) {
+    uint64_t counter = offset < 2 ? emulator.getCycleCount() : emulator.getInstructionCount();
+    value = static_cast<uint32_t>(offset & 1 ? counter >> 32 : counter);
+    return true;
+}
+
+bool CycleCounterDevice::write(uint32_t, uint32_t) {
+    return false;
+}
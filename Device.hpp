@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Error.hpp"
+
+class Emulator;
+
+// Memory-mapped device. Offsets are words from the base the device was mapped
+// at; returning false faults the access.
+class Device {
+public:
+    virtual ~Device() = default;
+    virtual uint32_t getSize() const = 0;
+    virtual bool read(uint32_t offset, uint32_t &value) = 0;
+    virtual bool write(uint32_t offset, uint32_t value) = 0;
+    virtual void flush() {}
+};
+
+// Output port. Offset 0 writes the low byte as a character, offset 1 writes the
+// word as a signed decimal. Output is collected and handed to the stream in
+// batches, when the buffer fills and whenever the emulator stops.
+class ConsoleDevice : public Device {
+public:
+    static constexpr uint32_t DEFAULT_BASE = 0xFFFF0000;
+    static constexpr size_t BUFFER_SIZE = 1u << 16;
+
+    explicit ConsoleDevice(std::ostream &out);
+    ~ConsoleDevice() override;
+    uint32_t getSize() const override;
+    bool read(uint32_t offset, uint32_t &value) override;
+    bool write(uint32_t offset, uint32_t value) override;
+    void flush() override;
+    uint64_t getWrittenBytes() const;
+private:
+    std::ostream &out;
+    std::string buffer;
+    uint64_t written = 0;
+};
+
+// Input port backed by a host file read in one go. Offset 0 returns the next
+// byte or ~0 at end of file, offset 1 the number of bytes left.
+class InputDevice : public Device {
+public:
+    static constexpr uint32_t DEFAULT_BASE = 0xFFFF0010;
+    static constexpr uint32_t END_OF_INPUT = ~0u;
+
+    bool load(const std::string &filename);
+    void rewind();
+    uint32_t getSize() const override;
+    bool read(uint32_t offset, uint32_t &value) override;
+    bool write(uint32_t offset, uint32_t value) override;
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+private:
+    std::vector<char> data;
+    size_t position = 0;
+    std::vector<Error> errors;
+};
+
+// Read-only view of the emulator counters: cycles at offsets 0 (low) and
+// 1 (high), retired instructions at 2 and 3.
+class CycleCounterDevice : public Device {
+public:
+    static constexpr uint32_t DEFAULT_BASE = 0xFFFF0020;
+
+    explicit CycleCounterDevice(const Emulator &emulator);
+    uint32_t getSize() const override;
+    bool read(uint32_t offset, uint32_t &value) override;
+    bool write(uint32_t offset, uint32_t value) override;
+private:
+    const Emulator &emulator;
+};
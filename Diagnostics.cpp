@@ -0,0 +1,218 @@
+#include "Diagnostics.hpp"
+#include <algorithm>
+#include <iterator>
+
+// Message of each code, {n} stands for the n-th argument
+static const std::array<const char *, static_cast<size_t>(DiagnosticCode::Count)> MESSAGES = {
+    "Failed to open file",
+    "Unknown token: {0}",
+    "Command can't start with {0}",
+    "Unknown instruction: {0}",
+    "Expected an operand for {0}",
+    "First operand for {0} must be a register",
+    "Expected ',' after first operand for {0}",
+    "Expected ',' between operands for {0}",
+    "Invalid operand for {0}: {1}, expected register",
+    "Invalid operand for {0}: {1}",
+    "Constant operand not allowed for {0}",
+    "Expected number or symbol",
+    "Invalid format for 'dd', expected 'dup'",
+    "Expected number",
+    "Expected ')'",
+    "Expected filename after 'include' directive",
+    "Expected number for '{0}'",
+    "Unknown directive: {0}",
+    "Expected number or symbol after 'def'",
+    "Only one command per line",
+    "Expected a name after 'macro'",
+    "Name can't be used for a macro: {0}",
+    "Expected a parameter name for macro {0}",
+    "Missing 'endm' for '{0}'",
+    "'endm' without 'macro' or 'rept'",
+    "Macro {0} takes {1} arguments, got {2}",
+    "Macro expansion nested too deeply: {0}",
+    "Repeat count {0} takes the program beyond the image limit of {1} words",
+    "{0}",
+    "Circular include detected: {0}",
+    "Symbol redefinition: {0}",
+    "Undefined symbol: {0}",
+    "Number {0} doesn't fit in 32 bits",
+    "Multiple start directives found.",
+    "No start directive found.",
+    "Origin must be a number or a symbol of def: {0}",
+    "Segment at {0} overlaps the segment at {1} from {2}",
+    "Segment at {0} extends beyond the end of the address space",
+    "Segment at {0} takes the image beyond the limit of {1} words"
+};
+
+Diagnostics::Diagnostics(size_t codeLimit, size_t totalLimit) : codeLimit(codeLimit), totalLimit(totalLimit) {}
+
+uint32_t Diagnostics::addFile(const std::string &name) {
+    uint32_t id = intern(name);
+    auto file = fileIds.find(id);
+    if (file != fileIds.end()) {
+        return file->second;
+    }
+    files.push_back(id);
+    fileIds.emplace(id, static_cast<uint32_t>(files.size() - 1));
+    return static_cast<uint32_t>(files.size() - 1);
+}
+
+void Diagnostics::report(DiagnosticCode code, uint32_t file, int line, std::initializer_list<std::string_view> arguments,
+    uint16_t column, uint16_t endColumn) {
+    uint32_t argumentIds[4];
+    size_t count = 0;
+    for (std::string_view argument : arguments) {
+        if (count < std::size(argumentIds)) {
+            argumentIds[count++] = intern(argument);
+        }
+    }
+    add(code, file, line, argumentIds, count, column, endColumn);
+}
+
+// Takes the diagnostics of another engine, records without a file get
+// defaultFile of this one
+void Diagnostics::merge(const Diagnostics &other, uint32_t defaultFile) {
+    std::vector<uint32_t> fileMap(other.files.size());
+    for (size_t file = 0; file < other.files.size(); ++file) {
+        fileMap[file] = addFile(other.strings[other.files[file]]);
+    }
+    for (const Diagnostic &diagnostic : other.records) {
+        uint32_t argumentIds[4];
+        size_t count = std::min<size_t>(diagnostic.argumentCount, std::size(argumentIds));
+        for (size_t i = 0; i < count; ++i) {
+            argumentIds[i] = intern(other.strings[other.arguments[diagnostic.firstArgument + i]]);
+        }
+        uint32_t file = diagnostic.file == NO_FILE ? defaultFile : fileMap[diagnostic.file];
+        add(diagnostic.code, file, diagnostic.line, argumentIds, count, diagnostic.column, diagnostic.endColumn);
+    }
+    duplicates += other.duplicates;
+    suppressed += other.suppressed;
+}
+
+bool Diagnostics::empty() const {
+    return records.empty();
+}
+
+size_t Diagnostics::size() const {
+    return records.size();
+}
+
+const std::vector<Diagnostic> &Diagnostics::getDiagnostics() const {
+    return records;
+}
+
+uint64_t Diagnostics::getDuplicateCount() const {
+    return duplicates;
+}
+
+uint64_t Diagnostics::getSuppressedCount() const {
+    return suppressed;
+}
+
+// Same layout as Error::getMessage with the column added when it is known
+std::string Diagnostics::format(const Diagnostic &diagnostic) const {
+    std::string result = "Error";
+    if (diagnostic.line != Error::NO_LINE) {
+        result += " on line " + std::to_string(diagnostic.line);
+        if (diagnostic.column > 0) {
+            result += ", column " + std::to_string(diagnostic.column);
+        }
+    }
+    std::string_view filename = getFilename(diagnostic.file);
+    if (!filename.empty()) {
+        result += " in file ";
+        result += filename;
+    }
+    result += ": ";
+    result += formatMessage(diagnostic);
+    return result;
+}
+
+std::string Diagnostics::formatMessage(const Diagnostic &diagnostic) const {
+    std::string result;
+    for (const char *c = MESSAGES[static_cast<size_t>(diagnostic.code)]; *c; ++c) {
+        if (c[0] == '{' && c[1] >= '0' && c[1] <= '9' && c[2] == '}') {
+            size_t index = static_cast<size_t>(c[1] - '0');
+            if (index < diagnostic.argumentCount) {
+                result += strings[arguments[diagnostic.firstArgument + index]];
+            }
+            c += 2;
+        }
+        else {
+            result += *c;
+        }
+    }
+    return result;
+}
+
+std::string Diagnostics::formatSummary() const {
+    std::string summary = std::to_string(records.size()) + (records.size() == 1 ? " error" : " errors");
+    if (duplicates > 0) {
+        summary += ", " + std::to_string(duplicates) + " repeated";
+    }
+    if (suppressed > 0) {
+        summary += ", " + std::to_string(suppressed) + " more not shown";
+    }
+    return summary;
+}
+
+std::vector<Error> Diagnostics::toErrors() const {
+    std::vector<Error> errors;
+    errors.reserve(records.size());
+    for (const Diagnostic &diagnostic : records) {
+        errors.emplace_back(formatMessage(diagnostic), diagnostic.line, std::string(getFilename(diagnostic.file)));
+    }
+    return errors;
+}
+
+uint32_t Diagnostics::intern(std::string_view text) {
+    auto found = stringIds.find(std::string(text));
+    if (found != stringIds.end()) {
+        return found->second;
+    }
+    uint32_t id = static_cast<uint32_t>(strings.size());
+    strings.emplace_back(text);
+    stringIds.emplace(strings.back(), id);
+    return id;
+}
+
+void Diagnostics::add(DiagnosticCode code, uint32_t file, int line, const uint32_t *argumentIds, size_t argumentCount,
+    uint16_t column, uint16_t endColumn) {
+    uint64_t hash = static_cast<uint64_t>(code) * 0x9E3779B97F4A7C15ull;
+    auto mix = [&hash](uint64_t value) {
+        hash = (hash ^ value) * 0x100000001B3ull;
+    };
+    mix(file);
+    mix(static_cast<uint32_t>(line));
+    mix(column);
+    for (size_t i = 0; i < argumentCount; ++i) {
+        mix(argumentIds[i]);
+    }
+    // Hashes can collide, a match only counts when the fields agree too
+    auto candidates = seen.equal_range(hash);
+    for (auto it = candidates.first; it != candidates.second; ++it) {
+        const Diagnostic &other = it->second;
+        if (other.code == code && other.file == file && other.line == line && other.column == column &&
+            other.argumentCount == argumentCount &&
+            std::equal(argumentIds, argumentIds + argumentCount, arguments.begin() + other.firstArgument)) {
+            ++duplicates;
+            return;
+        }
+    }
+    Diagnostic diagnostic = { code, column, endColumn, static_cast<uint16_t>(argumentCount), file, line,
+        static_cast<uint32_t>(arguments.size()) };
+    arguments.insert(arguments.end(), argumentIds, argumentIds + argumentCount);
+    seen.emplace(hash, diagnostic);
+    uint32_t &codeCount = codeCounts[static_cast<size_t>(code)];
+    if (codeCount >= codeLimit || records.size() >= totalLimit) {
+        ++suppressed;
+        return;
+    }
+    ++codeCount;
+    records.push_back(diagnostic);
+}
+
+std::string_view Diagnostics::getFilename(uint32_t file) const {
+    return file < files.size() ? std::string_view(strings[files[file]]) : std::string_view();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Error.hpp"
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum class DiagnosticCode : uint16_t {
+    FileUnreadable,
+    UnknownToken,
+    CommandStart,
+    UnknownInstruction,
+    ExpectedOperand,
+    FirstOperandRegister,
+    ExpectedComma,
+    ExpectedCommaBetween,
+    ExpectedRegister,
+    InvalidOperand,
+    ConstantOperand,
+    ExpectedNumberOrSymbol,
+    ExpectedDup,
+    ExpectedNumber,
+    ExpectedParenthesis,
+    ExpectedFilename,
+    ExpectedDirectiveNumber,
+    UnknownDirective,
+    ExpectedDefinitionValue,
+    OneCommandPerLine,
+    ExpectedMacroName,
+    InvalidMacroName,
+    ExpectedParameter,
+    MissingEndm,
+    UnexpectedEndm,
+    ArgumentCount,
+    ExpansionTooDeep,
+    RepeatCountTooLarge,
+    SourceUnavailable,
+    CircularInclude,
+    SymbolRedefinition,
+    UndefinedSymbol,
+    NumberOutOfRange,
+    MultipleStart,
+    NoStart,
+    InvalidOrigin,
+    SegmentOverlap,
+    SegmentTooLarge,
+    ImageTooLarge,
+    Count
+};
+
+// One reported problem. Arguments and file names are interned in the
+// engine that holds the record, the message is only put together when the
+// diagnostic is printed.
+struct Diagnostic {
+    DiagnosticCode code;
+    uint16_t column;            // 1-based, 0 when unknown
+    uint16_t endColumn;         // one past the span
+    uint16_t argumentCount;
+    uint32_t file;
+    int32_t line;
+    uint32_t firstArgument;     // into the argument list of the engine
+};
+
+// Collects diagnostics of a build. toErrors gives them the Error form the
+// rest of the tree reports in. The same diagnostic at the same place is
+// kept once, and after codeLimit diagnostics of one code or totalLimit in
+// all further ones are only counted, so a generated file with a systematic
+// mistake doesn't bury the rest.
+class Diagnostics {
+public:
+    static constexpr uint32_t NO_FILE = ~0u;
+    static constexpr size_t DEFAULT_CODE_LIMIT = 100;
+    static constexpr size_t DEFAULT_TOTAL_LIMIT = 1000;
+
+    explicit Diagnostics(size_t codeLimit = DEFAULT_CODE_LIMIT, size_t totalLimit = DEFAULT_TOTAL_LIMIT);
+    uint32_t addFile(const std::string &name);
+    void report(DiagnosticCode code, uint32_t file, int line, std::initializer_list<std::string_view> arguments = {},
+        uint16_t column = 0, uint16_t endColumn = 0);
+    void merge(const Diagnostics &other, uint32_t defaultFile = NO_FILE);
+    bool empty() const;
+    size_t size() const;
+    const std::vector<Diagnostic> &getDiagnostics() const;
+    uint64_t getDuplicateCount() const;
+    uint64_t getSuppressedCount() const;
+    std::string format(const Diagnostic &diagnostic) const;
+    std::string formatMessage(const Diagnostic &diagnostic) const;
+    std::string formatSummary() const;
+    std::vector<Error> toErrors() const;
+private:
+    size_t codeLimit;
+    size_t totalLimit;
+    std::vector<Diagnostic> records;
+    std::vector<uint32_t> arguments;    // string ids, a range per record
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> stringIds;
+    std::vector<uint32_t> files;        // file id to string id
+    std::unordered_map<uint32_t, uint32_t> fileIds;
+    std::unordered_multimap<uint64_t, Diagnostic> seen;  // recorded and suppressed diagnostics by hash
+    std::array<uint32_t, static_cast<size_t>(DiagnosticCode::Count)> codeCounts{};
+    uint64_t duplicates = 0;
+    uint64_t suppressed = 0;
+
+    uint32_t intern(std::string_view text);
+    void add(DiagnosticCode code, uint32_t file, int line, const uint32_t *argumentIds, size_t argumentCount,
+        uint16_t column, uint16_t endColumn);
+    std::string_view getFilename(uint32_t file) const;
+};
@@ -0,0 +1,367 @@
+#include "Disassembler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+// Chunks each thread gets per window, so a slow chunk doesn't idle the rest
+static constexpr size_t CHUNKS_PER_THREAD = 4;
+
+// Longest instruction line without symbols: "\tstore r31, [r31 - 0x00000000]\t; 0x00000000\n"
+static constexpr size_t MAX_LINE = 64;
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+// Lines are formatted by hand into a scratch buffer and appended whole, the
+// text of a listing is several times the size of the image
+
+static char *writeText(char *out, std::string_view text) {
+    std::memcpy(out, text.data(), text.size());
+    return out + text.size();
+}
+
+static char *writeHex(char *out, uint32_t value) {
+    out[0] = '0';
+    out[1] = 'x';
+    for (int i = 9; i >= 2; --i) {
+        out[i] = HEX_DIGITS[value & 0xF];
+        value >>= 4;
+    }
+    return out + 10;
+}
+
+static char *writeRegister(char *out, uint8_t r) {
+    *out++ = 'r';
+    if (r >= 10) {
+        *out++ = static_cast<char>('0' + r / 10);
+    }
+    *out++ = static_cast<char>('0' + r % 10);
+    return out;
+}
+
+Disassembler::Disassembler(unsigned threads, size_t chunkWords) :
+    threads(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+    chunkWords(std::max<size_t>(chunkWords, Isa::MAX_WORDS)) {}
+
+// Images are little-endian words, as Program::writeImage stores them
+bool Disassembler::loadImage(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        errors.emplace_back("Couldn't open image", Error::NO_LINE, filename);
+        return false;
+    }
+    std::streamsize size = file.tellg();
+    if (size % sizeof(uint32_t) != 0) {
+        errors.emplace_back("Image size isn't a whole number of words", Error::NO_LINE, filename);
+        return false;
+    }
+    std::vector<unsigned char> bytes(static_cast<size_t>(size));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(bytes.data()), size)) {
+        errors.emplace_back("Couldn't read image", Error::NO_LINE, filename);
+        return false;
+    }
+    std::vector<uint32_t> words(bytes.size() / sizeof(uint32_t));
+    for (size_t i = 0; i < words.size(); ++i) {
+        const unsigned char *b = &bytes[i * sizeof(uint32_t)];
+        words[i] = b[0] | b[1] << 8 | b[2] << 16 | static_cast<uint32_t>(b[3]) << 24;
+    }
+
+    // A raw image could start with the magic word too, it is only taken for
+    // a header when the segments after it account for every word
+    std::vector<ImageSegment> segments;
+    bool segmented = words.size() >= 2 && words[0] == Program::IMAGE_MAGIC;
+    size_t i = 2;
+    for (uint32_t count = 0; segmented && count < words[1]; ++count) {
+        segmented = words.size() - i >= 2 && words.size() - i - 2 >= words[i + 1] &&
+            static_cast<uint64_t>(words[i]) + words[i + 1] <= (1ull << 32);
+        if (segmented) {
+            segments.push_back({ words[i], std::vector<uint32_t>(words.begin() + i + 2, words.begin() + i + 2 + words[i + 1]) });
+            i += 2 + words[i + 1];
+        }
+    }
+    if (!segmented || i != words.size()) {
+        segments.clear();
+        segments.push_back({ 0, std::move(words) });
+    }
+    setImage(std::move(segments));
+    return true;
+}
+
+// Hexadecimal after 0x, decimal otherwise, the whole text within 32 bits
+static bool parseAddress(std::string_view text, uint32_t &address) {
+    int base = 10;
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        text.remove_prefix(2);
+        base = 16;
+    }
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), address, base);
+    return !text.empty() && error == std::errc() && end == text.data() + text.size();
+}
+
+// Reads the "<address> <label>" lines of Program::writeSymbols
+bool Disassembler::loadSymbols(const std::string &filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        errors.emplace_back("Couldn't open symbols", Error::NO_LINE, filename);
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        std::istringstream iss(line);
+        std::string text, name;
+        uint32_t address;
+        if (!(iss >> text >> name) || !parseAddress(text, address)) {
+            if (!line.empty() && line != "\r") {
+                errors.emplace_back("Malformed symbol line", lineNumber, filename);
+            }
+            continue;
+        }
+        addSymbol(address, name);
+    }
+    return !hasErrors();
+}
+
+void Disassembler::setImage(std::vector<ImageSegment> segments) {
+    image = std::move(segments);
+    std::stable_sort(image.begin(), image.end(), [](const ImageSegment &a, const ImageSegment &b) {
+        return a.base < b.base;
+    });
+}
+
+// Several labels may share an address, operands use the first one
+void Disassembler::addSymbol(uint32_t address, const std::string &name) {
+    Symbol &symbol = symbols[address];
+    if (symbol.name.empty()) {
+        symbol.name = name;
+        longestSymbol = std::max(longestSymbol, name.size());
+    }
+    symbol.lines += name;
+    symbol.lines += ":\n";
+}
+
+bool Disassembler::disassemble(const std::string &filename) {
+    auto start = std::chrono::steady_clock::now();
+    instructionCount = 0;
+    dataWordCount = 0;
+    BufferedWriter writer;
+    if (!writer.open(filename)) {
+        errors.insert(errors.end(), writer.getErrors().begin(), writer.getErrors().end());
+        return false;
+    }
+
+    std::vector<uint32_t> addresses;
+    addresses.reserve(symbols.size());
+    for (const auto &symbol : symbols) {
+        addresses.push_back(symbol.first);
+    }
+    std::sort(addresses.begin(), addresses.end());
+    for (const ImageSegment &listed : image) {
+        segment = &listed;
+        labelled.assign(segment->words.size(), false);
+        for (auto address = std::lower_bound(addresses.begin(), addresses.end(), segment->base);
+            address != addresses.end() && *address < segment->getEnd(); ++address) {
+            labelled[*address - segment->base] = true;
+        }
+        if (segment->base != 0) {
+            char line[16];
+            char *out = writeHex(writeText(line, "\torg "), segment->base);
+            *out++ = '\n';
+            writer.write(line, out - line);
+        }
+
+        size_t chunkCount = (segment->words.size() + chunkWords - 1) / chunkWords;
+        size_t window = static_cast<size_t>(threads) * CHUNKS_PER_THREAD;
+        std::vector<Chunk> chunks(std::min(window, chunkCount));
+        size_t previousStop = 0;
+        for (size_t first = 0; first < chunkCount; first += window) {
+            size_t count = std::min(window, chunkCount - first);
+            std::atomic<size_t> next{ 0 };
+            auto work = [&]() {
+                for (size_t i = next++; i < count; i = next++) {
+                    Chunk &chunk = chunks[i];
+                    chunk.begin = (first + i) * chunkWords;
+                    chunk.end = std::min(chunk.begin + chunkWords, segment->words.size());
+                    decode(chunk, chunk.begin);
+                }
+            };
+            std::vector<std::thread> workers;
+            for (unsigned t = 1; t < threads && t < count; ++t) {
+                workers.emplace_back(work);
+            }
+            work();
+            for (auto &worker : workers) {
+                worker.join();
+            }
+
+            // Chunks are joined in order, each one only depends on where the one
+            // before it stopped
+            for (size_t i = 0; i < count; ++i) {
+                Chunk &chunk = chunks[i];
+                if (previousStop > chunk.begin) {
+                    stitch(chunk, previousStop);
+                }
+                previousStop = chunk.stop;
+                instructionCount += chunk.instructions;
+                dataWordCount += chunk.dataWords;
+                writer.write(chunk.text.data() + chunk.skip, chunk.text.size() - chunk.skip);
+            }
+        }
+        auto end = segment->getEnd() <= UINT32_MAX ? symbols.find(static_cast<uint32_t>(segment->getEnd())) : symbols.end();
+        if (end != symbols.end()) {
+            writer.write(end->second.lines);
+        }
+    }
+    segment = nullptr;
+
+    bool written = writer.close();
+    outputBytes = writer.getWrittenBytes();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    elapsedSeconds = elapsed.count();
+    if (!written) {
+        errors.insert(errors.end(), writer.getErrors().begin(), writer.getErrors().end());
+    }
+    return written;
+}
+
+uint64_t Disassembler::getInstructionCount() const {
+    return instructionCount;
+}
+
+uint64_t Disassembler::getDataWordCount() const {
+    return dataWordCount;
+}
+
+uint64_t Disassembler::getOutputBytes() const {
+    return outputBytes;
+}
+
+double Disassembler::getElapsedSeconds() const {
+    return elapsedSeconds;
+}
+
+unsigned Disassembler::getThreadCount() const {
+    return threads;
+}
+
+const std::vector<Error> &Disassembler::getErrors() const {
+    return errors;
+}
+
+bool Disassembler::hasErrors() const {
+    return !errors.empty();
+}
+
+// Sweeps the chunk from the given word on. An instruction whose extension
+// word carries a label can't be one, the label proves the next word starts
+// something of its own, so the first word is listed as data.
+void Disassembler::decode(Chunk &chunk, size_t from) const {
+    chunk.text.clear();
+    chunk.skip = 0;
+    chunk.heads.clear();
+    chunk.instructions = 0;
+    chunk.dataWords = 0;
+    chunk.text.reserve((chunk.end - chunk.begin) * 32);
+    std::vector<char> line(MAX_LINE + longestSymbol);
+    size_t i = from;
+    while (i < chunk.end) {
+        if (chunk.heads.size() < HEAD_LINES) {
+            chunk.heads.push_back({ i, chunk.text.size(), chunk.instructions, chunk.dataWords });
+        }
+        uint32_t address = static_cast<uint32_t>(segment->base + i);
+        if (labelled[i]) {
+            chunk.text += symbols.find(address)->second.lines;
+        }
+        DecodedInstruction instruction;
+        bool valid = Isa::decode(&segment->words[i], segment->words.size() - i, instruction) &&
+            !(instruction.size > 1 && labelled[i + 1]);
+        char *out = line.data();
+        *out++ = '\t';
+        if (!valid) {
+            out = writeHex(writeText(out, "dd "), segment->words[i]);
+            ++chunk.dataWords;
+            instruction.size = 1;
+        }
+        else {
+            const InstructionInfo &info = *instruction.info;
+            out = writeText(out, info.mnemonic);
+            if (info.arity == 3) {
+                out = writeRegister(writeText(out, " "), instruction.r1);
+                out = writeRegister(writeText(out, ", "), instruction.r2);
+                out = writeRegister(writeText(out, ", "), instruction.r3);
+            }
+            else if (info.arity == 2) {
+                out = writeRegister(writeText(out, " "), instruction.r1);
+                out = writeOperand(writeText(out, ","), instruction, instruction.r2);
+            }
+            else if (info.arity == 1) {
+                out = writeOperand(out, instruction, instruction.r1);
+            }
+            ++chunk.instructions;
+        }
+        out = writeHex(writeText(out, "\t; "), address);
+        *out++ = '\n';
+        chunk.text.append(line.data(), out - line.data());
+        i += instruction.size;
+    }
+    chunk.stop = i;
+}
+
+char *Disassembler::writeOperand(char *out, const DecodedInstruction &instruction, uint8_t r) const {
+    *out++ = ' ';
+    switch (instruction.mode) {
+    case AddressingMode::Immediate:
+        // Only jump targets are taken for addresses, other numbers just happen
+        // to match one now and then
+        *out++ = '#';
+        return writeNumber(out, instruction.operand,
+            instruction.info->kind == InstructionKind::Jump || instruction.info->kind == InstructionKind::Branch);
+    case AddressingMode::RegisterDirect:
+        return writeRegister(out, r);
+    case AddressingMode::MemoryDirect:
+        return writeNumber(out, instruction.operand, true);
+    case AddressingMode::RegisterIndirect:
+        out = writeRegister(writeText(out, "["), r);
+        return writeText(out, "]");
+    case AddressingMode::RegisterIndirectWithDisplacement:
+        out = writeRegister(writeText(out, "["), r);
+        out = writeNumber(writeText(out, instruction.minus ? " - " : " + "), instruction.operand, false);
+        return writeText(out, "]");
+    default:
+        return out;
+    }
+}
+
+char *Disassembler::writeNumber(char *out, uint32_t value, bool symbolic) const {
+    if (symbolic && !symbols.empty()) {
+        auto symbol = symbols.find(value);
+        if (symbol != symbols.end()) {
+            return writeText(out, symbol->second.name);
+        }
+    }
+    return writeHex(out, value);
+}
+
+// The previous chunk ended on an instruction that reaches into this one, so
+// this one really starts at from. Where the sweep from the chunk start lands
+// on from as well, everything after that point is already right.
+void Disassembler::stitch(Chunk &chunk, size_t from) const {
+    for (const LineStart &head : chunk.heads) {
+        if (head.word == from) {
+            chunk.skip = head.offset;
+            chunk.instructions -= head.instructions;
+            chunk.dataWords -= head.dataWords;
+            return;
+        }
+        if (head.word > from) {
+            break;
+        }
+    }
+    decode(chunk, from);
+}
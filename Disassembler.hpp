@@ -0,0 +1,78 @@
+#pragma once
+
+#include "BufferedWriter.hpp"
+#include "Program.hpp"
+#include <unordered_map>
+
+// Turns binary images back into assembly listings. Words that no instruction
+// encodes to are listed as dd. With a symbol map, labels are printed before
+// their address and direct operands that hit a label are shown by name.
+// Every segment of an image but one at address 0 is listed after an org.
+//
+// The image is cut into chunks that worker threads decode independently, one
+// window of chunks at a time. A chunk may end on an instruction whose
+// extension word is the first word of the next chunk; the next chunk then has
+// to start one word later, so its first lines are dropped up to the point
+// where its own decoding falls in step. That is nearly always within a few
+// words, otherwise the chunk is decoded again from the right word.
+class Disassembler {
+public:
+    static constexpr size_t DEFAULT_CHUNK_WORDS = 1u << 16;
+
+    explicit Disassembler(unsigned threads = 0, size_t chunkWords = DEFAULT_CHUNK_WORDS);
+    bool loadImage(const std::string &filename);
+    bool loadSymbols(const std::string &filename);
+    void setImage(std::vector<ImageSegment> segments);
+    void addSymbol(uint32_t address, const std::string &name);
+    bool disassemble(const std::string &filename);
+    uint64_t getInstructionCount() const;
+    uint64_t getDataWordCount() const;
+    uint64_t getOutputBytes() const;
+    double getElapsedSeconds() const;
+    unsigned getThreadCount() const;
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+private:
+    struct LineStart {
+        size_t word;
+        size_t offset;          // into the chunk text
+        uint64_t instructions;  // decoded before this line
+        uint64_t dataWords;
+    };
+
+    struct Chunk {
+        size_t begin;
+        size_t end;
+        size_t stop;            // first word past the last decoded one, end or end + 1
+        std::string text;
+        size_t skip;            // leading text dropped when stitching
+        std::vector<LineStart> heads;
+        uint64_t instructions;
+        uint64_t dataWords;
+    };
+
+    struct Symbol {
+        std::string name;
+        std::string lines;      // a label line for each name at the address
+    };
+
+    static constexpr size_t HEAD_LINES = 32;
+
+    unsigned threads;
+    size_t chunkWords;
+    std::vector<ImageSegment> image;
+    const ImageSegment *segment = nullptr;  // being listed, chunks index its words
+    std::unordered_map<uint32_t, Symbol> symbols;
+    std::vector<bool> labelled;         // per word of the segment
+    size_t longestSymbol = 0;
+    uint64_t instructionCount = 0;
+    uint64_t dataWordCount = 0;
+    uint64_t outputBytes = 0;
+    double elapsedSeconds = 0;
+    std::vector<Error> errors;
+
+    void decode(Chunk &chunk, size_t from) const;
+    char *writeOperand(char *out, const DecodedInstruction &instruction, uint8_t r) const;
+    char *writeNumber(char *out, uint32_t value, bool symbolic) const;
+    void stitch(Chunk &chunk, size_t from) const;
+};
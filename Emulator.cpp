@@ -0,0 +1,497 @@
+#include "Emulator.hpp"
+#include <iomanip>
+#include <sstream>
+
+// The post-initialisation state is kept as a snapshot, so resetting costs
+// only the pages the previous run wrote
+Emulator::Emulator(const Program &program, uint32_t stackTop) : program(program), code(program.getCode().data()) {
+    for (const ImageSegment &segment : program.getImage()) {
+        memory.load(segment.base, segment.words);
+    }
+    std::fill(std::begin(registers), std::end(registers), 0);
+    registers[REGISTER_SP] = stackTop;
+    memory.write(registers[REGISTER_SP], HALT_ADDRESS);
+    pc = program.getEntry();
+    initialState = snapshot();
+}
+
+Emulator::Emulator(const Program &program, Memory &shared, uint32_t stackTop) :
+    program(program), code(program.getCode().data()), memory(shared) {
+    std::fill(std::begin(registers), std::end(registers), 0);
+    registers[REGISTER_SP] = stackTop;
+    memory.write(registers[REGISTER_SP], HALT_ADDRESS);
+    pc = program.getEntry();
+    initialState = snapshot();
+}
+
+void Emulator::reset() {
+    restore(initialState);
+    if (profiler) {
+        profiler->reset();
+    }
+}
+
+Emulator::Snapshot Emulator::snapshot() {
+    Snapshot snapshot;
+    if (!memory.isView()) {
+        snapshot.memory = memory.snapshot();
+    }
+    std::copy(std::begin(registers), std::end(registers), std::begin(snapshot.registers));
+    snapshot.pc = pc;
+    snapshot.instructionCount = instructionCount;
+    snapshot.cycleCount = cycleCount;
+    snapshot.state = state;
+    return snapshot;
+}
+
+void Emulator::restore(const Snapshot &snapshot) {
+    if (!memory.isView()) {
+        memory.restore(snapshot.memory);
+    }
+    std::copy(std::begin(snapshot.registers), std::end(snapshot.registers), std::begin(registers));
+    pc = snapshot.pc;
+    instructionCount = snapshot.instructionCount;
+    cycleCount = snapshot.cycleCount;
+    state = snapshot.state;
+    errors.clear();
+    interruptCheckCycle = interrupts ? cycleCount : EventQueue::NO_EVENT;
+}
+
+Emulator::State Emulator::run(uint64_t maxSteps) {
+    if (state == State::Halted || state == State::Fault) {
+        return state;
+    }
+    if ((state == State::Breakpoint || state == State::Watchpoint) && maxSteps > 0) {
+        if (!stepOver()) {
+            memory.flushDevices();
+            return state;
+        }
+        maxSteps--;
+    }
+    State result = dispatch(maxSteps);
+    memory.flushDevices();
+    return result;
+}
+
+void Emulator::setProfiler(Profiler *profiler) {
+    this->profiler = profiler;
+    if (profiler) {
+        profiler->reset();
+    }
+}
+
+void Emulator::setTracer(Tracer *tracer) {
+    this->tracer = tracer;
+}
+
+void Emulator::setInterruptController(InterruptController *interrupts) {
+    this->interrupts = interrupts;
+    interruptCheckCycle = interrupts ? cycleCount : EventQueue::NO_EVENT;
+}
+
+bool Emulator::addBreakpoint(uint32_t address) {
+    uint32_t index = program.findOp(address);
+    if (index == Program::NO_OP) {
+        return false;
+    }
+    if (patchedCode.empty()) {
+        patchedCode = program.getCode();
+        code = patchedCode.data();
+    }
+    patchedCode[index].opcode = Opcode::Trap;
+    patchedCode[index].cycles = 0;
+    return true;
+}
+
+bool Emulator::removeBreakpoint(uint32_t address) {
+    uint32_t index = program.findOp(address);
+    if (index == Program::NO_OP || patchedCode.empty() || patchedCode[index].opcode != Opcode::Trap) {
+        return false;
+    }
+    patchedCode[index] = program.getCode()[index];
+    return true;
+}
+
+void Emulator::addWatchpoint(uint32_t address, uint8_t kinds) {
+    memory.addWatch(address, kinds);
+}
+
+bool Emulator::removeWatchpoint(uint32_t address) {
+    return memory.removeWatch(address);
+}
+
+const Memory::WatchHit &Emulator::getWatchHit() const {
+    return watchHit;
+}
+
+Emulator::State Emulator::getState() const {
+    return state;
+}
+
+uint32_t Emulator::getRegister(int index) const {
+    return registers[index];
+}
+
+void Emulator::setRegister(int index, uint32_t value) {
+    if (index != 0) {
+        registers[index] = value;
+    }
+}
+
+uint32_t Emulator::getPc() const {
+    return pc == Program::NO_OP ? HALT_ADDRESS : program.getCode()[pc].address;
+}
+
+Memory &Emulator::getMemory() {
+    return memory;
+}
+
+const Memory &Emulator::getMemory() const {
+    return memory;
+}
+
+uint64_t Emulator::getInstructionCount() const {
+    return instructionCount;
+}
+
+uint64_t Emulator::getCycleCount() const {
+    return cycleCount;
+}
+
+const std::vector<Error> &Emulator::getErrors() const {
+    return errors;
+}
+
+bool Emulator::hasErrors() const {
+    return !errors.empty();
+}
+
+Emulator::State Emulator::fault(const std::string &message) {
+    std::ostringstream oss;
+    oss << message << " at ";
+    if (pc == Program::NO_OP) {
+        oss << "end of code";
+    }
+    else {
+        oss << program.describeAddress(program.getCode()[pc].address);
+    }
+    errors.emplace_back(oss.str());
+    return state = State::Fault;
+}
+
+// A watched access fails without side effects, so the op is rolled back and
+// retried by the next run
+Emulator::State Emulator::memoryFault(const MicroOp &op, const std::string &message) {
+    if (!memory.takeWatchHit(watchHit)) {
+        return fault(message);
+    }
+    instructionCount--;
+    cycleCount -= op.cycles;
+    return state = State::Watchpoint;
+}
+
+// Executes the op at pc with its trap lifted and watches disabled
+bool Emulator::stepOver() {
+    uint32_t index = pc;
+    bool trapped = !patchedCode.empty() && index != Program::NO_OP && patchedCode[index].opcode == Opcode::Trap;
+    if (trapped) {
+        patchedCode[index] = program.getCode()[index];
+    }
+    memory.setWatchesEnabled(false);
+    State result = dispatch(1);
+    memory.setWatchesEnabled(true);
+    if (trapped) {
+        patchedCode[index].opcode = Opcode::Trap;
+        patchedCode[index].cycles = 0;
+    }
+    return result == State::StepLimit;
+}
+
+uint32_t Emulator::effectiveAddress(const MicroOp &op) const {
+    switch (op.addressingMode) {
+    case AddressingMode::RegisterIndirect:
+        return registers[op.rs];
+    case AddressingMode::RegisterIndirectWithDisplacement:
+        return registers[op.rs] + op.value;
+    default:
+        return op.value;
+    }
+}
+
+// Jumps go to the effective address of their operand, or to the register value
+uint32_t Emulator::jumpTarget(const MicroOp &op, bool &valid) const {
+    valid = true;
+    if (op.target != Program::NO_OP) {
+        return op.target;
+    }
+    uint32_t address = op.addressingMode == AddressingMode::RegisterDirect ? registers[op.rs] : effectiveAddress(op);
+    uint32_t target = program.findOp(address);
+    valid = target != Program::NO_OP;
+    return target;
+}
+
+// Runs due device events and enters the handler of the lowest enabled pending line.
+// While anything is pending the next block boundary checks again, since imr may
+// have been changed by an ordinary instruction in between.
+bool Emulator::serviceInterrupts(uint32_t &next) {
+    EventQueue &events = interrupts->getEvents();
+    events.runDue(cycleCount);
+
+    uint32_t line;
+    if (next != Program::NO_OP && interrupts->takeInterrupt(registers[REGISTER_IMR], line)) {
+        // Watchpoints don't see the implicit vector read and pushes
+        uint32_t handlerAddress, handler = Program::NO_OP;
+        uint32_t sp = registers[REGISTER_SP];
+        memory.setWatchesEnabled(false);
+        if (memory.read(registers[REGISTER_IVTP] + line, handlerAddress)) {
+            handler = program.findOp(handlerAddress);
+        }
+        bool pushed = memory.write(sp - 1, program.getCode()[next].address) && memory.write(sp - 2, registers[REGISTER_IMR]);
+        memory.setWatchesEnabled(true);
+        if (handler == Program::NO_OP) {
+            fault("Interrupt " + std::to_string(line) + " has no handler");
+            return false;
+        }
+        if (!pushed) {
+            fault("Stack overflow");
+            return false;
+        }
+        registers[REGISTER_SP] = sp - 2;
+        registers[REGISTER_IMR] = 0;
+        if (profiler) {
+            profiler->onCall(handler);
+        }
+        next = handler;
+    }
+    interruptCheckCycle = interrupts->getPending() ? cycleCount : events.getNextEventCycle();
+    return true;
+}
+
+// Word the op will access, computed before it changes any register
+bool Emulator::memoryOperand(const MicroOp &op, uint32_t &address) const {
+    switch (op.opcode) {
+    case Opcode::Load:
+    case Opcode::Store:
+        address = effectiveAddress(op);
+        return op.addressingMode != AddressingMode::Immediate && op.addressingMode != AddressingMode::RegisterDirect;
+    case Opcode::Push:
+    case Opcode::Call:
+        address = registers[REGISTER_SP] - 1;
+        return true;
+    case Opcode::Pop:
+    case Opcode::Ret:
+    case Opcode::Iret:
+        address = registers[REGISTER_SP];
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Emulator::traceOp(const MicroOp &op, bool hasMemory, uint32_t memoryAddress) {
+    TraceRecord record;
+    record.address = op.address;
+    record.memoryAddress = memoryAddress;
+    record.opcode = static_cast<uint8_t>(op.opcode);
+    record.flags = hasMemory ? Tracer::HAS_MEMORY : 0;
+    record.reserved = 0;
+    switch (op.opcode) {
+    case Opcode::Store:
+        record.reg = op.addressingMode == AddressingMode::RegisterDirect ? op.rs : Tracer::NO_REGISTER;
+        break;
+    case Opcode::Load:
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+    case Opcode::Inc:
+    case Opcode::Dec:
+    case Opcode::Neg:
+    case Opcode::Pop:
+        record.reg = op.rd;
+        break;
+    default:
+        record.reg = Tracer::NO_REGISTER;
+        break;
+    }
+    record.value = record.reg != Tracer::NO_REGISTER ? registers[record.reg] : 0;
+    tracer->record(record);
+}
+
+Emulator::State Emulator::dispatch(uint64_t maxSteps) {
+    if (tracer) {
+        return profiler ? execute<true, true>(maxSteps) : execute<false, true>(maxSteps);
+    }
+    return profiler ? execute<true, false>(maxSteps) : execute<false, false>(maxSteps);
+}
+
+template <bool Profile, bool Trace>
+Emulator::State Emulator::execute(uint64_t maxSteps) {
+    const MicroOp *code = this->code;
+    uint32_t *r = registers;
+    uint32_t value;
+    bool valid;
+
+    for (uint64_t step = 0; step < maxSteps; ++step) {
+        if (pc == Program::NO_OP) {
+            return fault("Execution left the code");
+        }
+        const MicroOp &op = code[pc];
+        if constexpr (Profile) {
+            profiler->onInstruction(pc, op.cycles);
+        }
+        instructionCount++;
+        cycleCount += op.cycles;
+        uint32_t next = op.next;
+        uint32_t memoryAddress = 0;
+        bool hasMemory = false;
+        if constexpr (Trace) {
+            hasMemory = memoryOperand(op, memoryAddress);
+        }
+
+        switch (op.opcode) {
+        case Opcode::Load:
+            if (op.addressingMode == AddressingMode::Immediate) {
+                value = op.value;
+            }
+            else if (op.addressingMode == AddressingMode::RegisterDirect) {
+                value = r[op.rs];
+            }
+            else if (!memory.read(effectiveAddress(op), value)) {
+                return memoryFault(op, "Load from invalid address");
+            }
+            r[op.rd] = value;
+            break;
+        case Opcode::Store:
+            if (op.addressingMode == AddressingMode::RegisterDirect) {
+                r[op.rs] = r[op.rd];
+            }
+            else if (!memory.write(effectiveAddress(op), r[op.rd])) {
+                return memoryFault(op, "Store to invalid address");
+            }
+            break;
+        case Opcode::Add:
+            r[op.rd] = r[op.rs] + r[op.rt];
+            break;
+        case Opcode::Sub:
+            r[op.rd] = r[op.rs] - r[op.rt];
+            break;
+        case Opcode::Mul:
+            r[op.rd] = r[op.rs] * r[op.rt];
+            break;
+        case Opcode::Inc:
+            r[op.rd]++;
+            break;
+        case Opcode::Dec:
+            r[op.rd]--;
+            break;
+        case Opcode::Neg:
+            r[op.rd] = 0u - r[op.rd];
+            break;
+        case Opcode::Push:
+            if (!memory.write(r[REGISTER_SP] - 1, r[op.rd])) {
+                return memoryFault(op, "Stack overflow");
+            }
+            r[REGISTER_SP]--;
+            break;
+        case Opcode::Pop:
+            if (!memory.read(r[REGISTER_SP], value)) {
+                return memoryFault(op, "Stack underflow");
+            }
+            r[REGISTER_SP]++;
+            r[op.rd] = value;
+            break;
+        case Opcode::Trap:
+            instructionCount--;
+            return state = State::Breakpoint;
+        case Opcode::Jmp:
+            next = jumpTarget(op, valid);
+            if (!valid) {
+                return fault("Jump to an address without an instruction");
+            }
+            if constexpr (Profile) {
+                profiler->onTaken(pc);
+            }
+            break;
+        case Opcode::Call:
+            next = jumpTarget(op, valid);
+            if (!valid) {
+                return fault("Call to an address without an instruction");
+            }
+            if (!memory.write(r[REGISTER_SP] - 1, op.address + op.size)) {
+                return memoryFault(op, "Stack overflow");
+            }
+            r[REGISTER_SP]--;
+            if constexpr (Profile) {
+                profiler->onCall(next);
+            }
+            break;
+        case Opcode::Ret:
+            if (!memory.read(r[REGISTER_SP], value)) {
+                return memoryFault(op, "Stack underflow");
+            }
+            r[REGISTER_SP]++;
+            if (value == HALT_ADDRESS) {
+                pc = Program::NO_OP;
+                return state = State::Halted;
+            }
+            next = program.findOp(value);
+            if (next == Program::NO_OP) {
+                return fault("Return to an address without an instruction");
+            }
+            if constexpr (Profile) {
+                profiler->onReturn();
+            }
+            break;
+        case Opcode::Iret: {
+            uint32_t mask;
+            if (!memory.read(r[REGISTER_SP], mask) || !memory.read(r[REGISTER_SP] + 1, value)) {
+                return memoryFault(op, "Stack underflow");
+            }
+            r[REGISTER_IMR] = mask;
+            r[REGISTER_SP] += 2;
+            next = program.findOp(value);
+            if (next == Program::NO_OP) {
+                return fault("Return to an address without an instruction");
+            }
+            if constexpr (Profile) {
+                profiler->onReturn();
+            }
+            break;
+        }
+        case Opcode::Jz:
+        case Opcode::Jnz:
+        case Opcode::Jlz:
+        case Opcode::Jlez:
+        case Opcode::Jgz:
+        case Opcode::Jgez: {
+            int32_t tested = static_cast<int32_t>(r[op.rd]);
+            bool taken =
+                (op.opcode == Opcode::Jz && tested == 0) ||
+                (op.opcode == Opcode::Jnz && tested != 0) ||
+                (op.opcode == Opcode::Jlz && tested < 0) ||
+                (op.opcode == Opcode::Jlez && tested <= 0) ||
+                (op.opcode == Opcode::Jgz && tested > 0) ||
+                (op.opcode == Opcode::Jgez && tested >= 0);
+            if (taken) {
+                next = jumpTarget(op, valid);
+                if (!valid) {
+                    return fault("Jump to an address without an instruction");
+                }
+                if constexpr (Profile) {
+                    profiler->onTaken(pc);
+                }
+            }
+            break;
+        }
+        }
+        r[0] = 0;
+        if constexpr (Trace) {
+            traceOp(op, hasMemory, memoryAddress);
+        }
+        if (op.opcode >= Opcode::Jmp && cycleCount >= interruptCheckCycle && !serviceInterrupts(next)) {
+            return state;
+        }
+        pc = next;
+    }
+    return state = State::StepLimit;
+}
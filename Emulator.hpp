@@ -0,0 +1,105 @@
+#pragma once
+
+#include "InterruptController.hpp"
+#include "Memory.hpp"
+#include "Profiler.hpp"
+#include "Tracer.hpp"
+
+// Executes a decoded Program. Registers are 32 bits wide and r0 (zero) is
+// hardwired; the stack grows down from stackTop through sp.
+// call pushes the return address and ret pops it, returning from the
+// outermost routine halts the machine.
+//
+// Interrupts are only looked at when a control transfer ends a block. The
+// return address and imr are pushed, imr is cleared and execution continues
+// at the handler stored at ivtp + line; iret undoes this.
+//
+// Breakpoints replace their op with a trap in a private copy of the micro-op
+// stream, the program keeps the original. Watchpoints are left to the memory
+// page flags. Either stops before the instruction retires and the next run
+// steps over it, so a run without any costs nothing extra.
+//
+// A hart runs over a view of memory that already holds the program. Its
+// snapshots hold registers only, the shared memory is left alone.
+class Emulator {
+public:
+    enum class State {
+        Ready,
+        Halted,
+        Fault,
+        StepLimit,
+        Breakpoint,
+        Watchpoint
+    };
+
+    static constexpr uint32_t DEFAULT_STACK_TOP = ~0u;
+    static constexpr uint32_t HALT_ADDRESS = ~0u;
+    static constexpr int REGISTER_COUNT = 32;
+    static constexpr int REGISTER_SP = 2;
+    static constexpr int REGISTER_IVTP = 26;
+    static constexpr int REGISTER_IMR = 27;
+
+    struct Snapshot {
+        Memory::Snapshot memory;
+        uint32_t registers[REGISTER_COUNT];
+        uint32_t pc;
+        uint64_t instructionCount;
+        uint64_t cycleCount;
+        State state;
+    };
+
+    Emulator(const Program &program, uint32_t stackTop = DEFAULT_STACK_TOP);
+    Emulator(const Program &program, Memory &shared, uint32_t stackTop);
+    void reset();
+    Snapshot snapshot();
+    void restore(const Snapshot &snapshot);
+    State run(uint64_t maxSteps = UINT64_MAX);
+    void setProfiler(Profiler *profiler);
+    void setInterruptController(InterruptController *interrupts);
+    void setTracer(Tracer *tracer);
+    bool addBreakpoint(uint32_t address);
+    bool removeBreakpoint(uint32_t address);
+    void addWatchpoint(uint32_t address, uint8_t kinds = Memory::WATCH_WRITE);
+    bool removeWatchpoint(uint32_t address);
+    const Memory::WatchHit &getWatchHit() const;
+
+    State getState() const;
+    uint32_t getRegister(int index) const;
+    void setRegister(int index, uint32_t value);
+    uint32_t getPc() const;
+    Memory &getMemory();
+    const Memory &getMemory() const;
+    uint64_t getInstructionCount() const;
+    uint64_t getCycleCount() const;
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+private:
+    const Program &program;
+    const MicroOp *code;                // the program's ops, or patchedCode once a breakpoint is set
+    std::vector<MicroOp> patchedCode;
+    Memory memory;
+    uint32_t registers[REGISTER_COUNT];
+    uint32_t pc;                        // op index
+    uint64_t instructionCount = 0;
+    uint64_t cycleCount = 0;
+    State state = State::Ready;
+    Profiler *profiler = nullptr;
+    InterruptController *interrupts = nullptr;
+    Tracer *tracer = nullptr;
+    uint64_t interruptCheckCycle = EventQueue::NO_EVENT;
+    std::vector<Error> errors;
+    Snapshot initialState;
+    Memory::WatchHit watchHit;
+
+    State dispatch(uint64_t maxSteps);
+    template <bool Profile, bool Trace>
+    State execute(uint64_t maxSteps);
+    State fault(const std::string &message);
+    State memoryFault(const MicroOp &op, const std::string &message);
+    bool stepOver();
+    uint32_t effectiveAddress(const MicroOp &op) const;
+    uint32_t jumpTarget(const MicroOp &op, bool &valid) const;
+    bool serviceInterrupts(uint32_t &next);
+    bool memoryOperand(const MicroOp &op, uint32_t &address) const;
+    void traceOp(const MicroOp &op, bool hasMemory, uint32_t memoryAddress);
+};
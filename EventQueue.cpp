@@ -0,0 +1,26 @@
+#include "EventQueue.hpp"
+
+void EventQueue::schedule(uint64_t cycle, Callback callback) {
+    events.push({ cycle, sequence++, std::move(callback) });
+}
+
+// Callbacks may schedule further events, those run too if they are already due
+void EventQueue::runDue(uint64_t cycle) {
+    while (!events.empty() && events.top().cycle <= cycle) {
+        Event event = events.top();
+        events.pop();
+        event.callback(event.cycle);
+    }
+}
+
+uint64_t EventQueue::getNextEventCycle() const {
+    return events.empty() ? NO_EVENT : events.top().cycle;
+}
+
+bool EventQueue::isEmpty() const {
+    return events.empty();
+}
+
+void EventQueue::clear() {
+    events = {};
+}
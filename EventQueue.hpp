@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+// Time-ordered queue of device events, timestamps are emulator cycles.
+// Events due at the same cycle run in the order they were scheduled.
+class EventQueue {
+public:
+    using Callback = std::function<void(uint64_t cycle)>;
+
+    static constexpr uint64_t NO_EVENT = UINT64_MAX;
+
+    void schedule(uint64_t cycle, Callback callback);
+    void runDue(uint64_t cycle);
+    uint64_t getNextEventCycle() const;
+    bool isEmpty() const;
+    void clear();
+private:
+    struct Event {
+        uint64_t cycle;
+        uint64_t sequence;
+        Callback callback;
+    };
+
+    struct Later {
+        bool operator()(const Event &a, const Event &b) const {
+            return a.cycle != b.cycle ? a.cycle > b.cycle : a.sequence > b.sequence;
+        }
+    };
+
+    std::priority_queue<Event, std::vector<Event>, Later> events;
+    uint64_t sequence = 0;
+};
@@ -0,0 +1,60 @@
+#include "InterruptController.hpp"
+#include <algorithm>
+
+void InterruptController::raise(uint32_t line) {
+    pending |= 1u << (line % LINE_COUNT);
+}
+
+void InterruptController::clear(uint32_t line) {
+    pending &= ~(1u << (line % LINE_COUNT));
+}
+
+uint32_t InterruptController::getPending() const {
+    return pending;
+}
+
+// Lowest enabled pending line wins
+bool InterruptController::takeInterrupt(uint32_t mask, uint32_t &line) {
+    uint32_t deliverable = pending & mask;
+    if (!deliverable) {
+        return false;
+    }
+    line = 0;
+    while (!(deliverable & (1u << line))) {
+        ++line;
+    }
+    clear(line);
+    delivered++;
+    return true;
+}
+
+uint64_t InterruptController::getDeliveredCount() const {
+    return delivered;
+}
+
+EventQueue &InterruptController::getEvents() {
+    return events;
+}
+
+void InterruptController::reset() {
+    pending = 0;
+    delivered = 0;
+    events.clear();
+}
+
+TimerDevice::TimerDevice(InterruptController &controller, uint32_t line, uint64_t period)
+    : controller(controller), line(line), period(std::max<uint64_t>(period, 1)) {}
+
+void TimerDevice::start(uint64_t cycle) {
+    controller.getEvents().schedule(cycle + period, [this](uint64_t cycle) { tick(cycle); });
+}
+
+uint64_t TimerDevice::getTickCount() const {
+    return ticks;
+}
+
+void TimerDevice::tick(uint64_t cycle) {
+    ticks++;
+    controller.raise(line);
+    start(cycle);
+}
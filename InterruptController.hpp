@@ -0,0 +1,38 @@
+#pragma once
+
+#include "EventQueue.hpp"
+
+// Pending interrupt lines plus the event queue that devices use to raise them.
+// The emulator vectors the lowest pending line that imr enables through the
+// table at ivtp.
+class InterruptController {
+public:
+    static constexpr uint32_t LINE_COUNT = 32;
+
+    void raise(uint32_t line);
+    void clear(uint32_t line);
+    uint32_t getPending() const;
+    bool takeInterrupt(uint32_t mask, uint32_t &line);
+    uint64_t getDeliveredCount() const;
+    EventQueue &getEvents();
+    void reset();
+private:
+    uint32_t pending = 0;
+    uint64_t delivered = 0;
+    EventQueue events;
+};
+
+// Raises its line every period cycles once started
+class TimerDevice {
+public:
+    TimerDevice(InterruptController &controller, uint32_t line, uint64_t period);
+    void start(uint64_t cycle);
+    uint64_t getTickCount() const;
+private:
+    InterruptController &controller;
+    uint32_t line;
+    uint64_t period;
+    uint64_t ticks = 0;
+
+    void tick(uint64_t cycle);
+};
@@ -0,0 +1,60 @@
+#include "IntervalTree.hpp"
+#include <algorithm>
+
+IntervalTree::IntervalTree(std::vector<Interval> intervals) : intervals(std::move(intervals)) {
+    std::sort(this->intervals.begin(), this->intervals.end(), [](const Interval &a, const Interval &b) {
+        return a.start != b.start ? a.start < b.start : a.id < b.id;
+    });
+    maxEnds.resize(this->intervals.size());
+    build(0, this->intervals.size());
+}
+
+// Ids of the intervals sharing at least one point with [start, end)
+void IntervalTree::findOverlaps(uint64_t start, uint64_t end, std::vector<uint32_t> &ids) const {
+    if (start < end) {
+        query(0, intervals.size(), start, end, ids);
+    }
+}
+
+bool IntervalTree::findContaining(uint64_t point, uint32_t &id) const {
+    std::vector<uint32_t> ids;
+    findOverlaps(point, point + 1, ids);
+    if (ids.empty()) {
+        return false;
+    }
+    id = ids.front();
+    return true;
+}
+
+size_t IntervalTree::size() const {
+    return intervals.size();
+}
+
+uint64_t IntervalTree::build(size_t low, size_t high) {
+    if (low >= high) {
+        return 0;
+    }
+    size_t middle = low + (high - low) / 2;
+    uint64_t maxEnd = std::max({ intervals[middle].end, build(low, middle), build(middle + 1, high) });
+    maxEnds[middle] = maxEnd;
+    return maxEnd;
+}
+
+void IntervalTree::query(size_t low, size_t high, uint64_t start, uint64_t end, std::vector<uint32_t> &ids) const {
+    if (low >= high) {
+        return;
+    }
+    size_t middle = low + (high - low) / 2;
+    if (maxEnds[middle] <= start) {
+        return;
+    }
+    query(low, middle, start, end, ids);
+    const Interval &interval = intervals[middle];
+    if (interval.start >= end) {
+        return;     // everything to the right starts later still
+    }
+    if (interval.end > start && interval.start < interval.end) {
+        ids.push_back(interval.id);
+    }
+    query(middle + 1, high, start, end, ids);
+}
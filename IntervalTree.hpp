@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Static set of half-open intervals answering overlap queries in
+// O(log n + k). The intervals are sorted by start once; the tree is implicit
+// in the sorted array, the middle of every range being the root of its
+// subtree, and each node keeps the largest end below it so that subtrees
+// ending before a query are skipped.
+class IntervalTree {
+public:
+    struct Interval {
+        uint64_t start;
+        uint64_t end;           // exclusive
+        uint32_t id;
+    };
+
+    IntervalTree() = default;
+    explicit IntervalTree(std::vector<Interval> intervals);
+    void findOverlaps(uint64_t start, uint64_t end, std::vector<uint32_t> &ids) const;
+    bool findContaining(uint64_t point, uint32_t &id) const;
+    size_t size() const;
+private:
+    std::vector<Interval> intervals;    // sorted by start
+    std::vector<uint64_t> maxEnds;      // of the subtree rooted at each index
+
+    uint64_t build(size_t low, size_t high);
+    void query(size_t low, size_t high, uint64_t start, uint64_t end, std::vector<uint32_t> &ids) const;
+};
@@ -0,0 +1,97 @@
+#include "Isa.hpp"
+#include <iomanip>
+#include <sstream>
+
+// Operands that aren't registers carry REGISTER_INVALID and encode as zero
+static uint32_t registerField(int r) {
+    return r >= 0 && r <= static_cast<int>(Isa::REGISTER_MASK) ? static_cast<uint32_t>(r) : 0;
+}
+
+// Numbers are spelled the way the tokenizer produces them
+static std::string hexNumber(uint32_t value) {
+    std::ostringstream oss;
+    oss << "0x" << std::hex << std::setw(8) << std::setfill('0') << value;
+    return oss.str();
+}
+
+// The command must name an instruction of the table, operand is the resolved
+// number or address before the displacement sign is applied
+uint32_t Isa::encode(const Command &command, uint32_t operand, uint32_t *words) {
+    const InstructionInfo &info = *find(command.getName());
+    AddressingMode mode = command.getAddressingMode();
+    words[0] =
+        static_cast<uint32_t>(info.opcode) << OPCODE_SHIFT |
+        static_cast<uint32_t>(mode) << MODE_SHIFT |
+        registerField(command.getR1()) << R1_SHIFT |
+        registerField(command.getR2()) << R2_SHIFT |
+        registerField(command.getR3()) << R3_SHIFT;
+    if (mode == AddressingMode::RegisterIndirectWithDisplacement && command.getSign() == Command::Sign::Minus) {
+        words[0] |= SIGN_BIT;
+    }
+    if (!hasExtensionWord(mode)) {
+        return 1;
+    }
+    words[1] = operand;
+    return 2;
+}
+
+// Fails for words that no instruction encodes to, so data can be told apart
+bool Isa::decode(const uint32_t *words, size_t available, DecodedInstruction &instruction) {
+    if (available == 0) {
+        return false;
+    }
+    uint32_t word = words[0];
+    uint32_t opcode = word >> OPCODE_SHIFT;
+    uint32_t modeValue = (word >> MODE_SHIFT) & MODE_MASK;
+    if (opcode >= INSTRUCTION_COUNT || (word & RESERVED_MASK) ||
+        modeValue > static_cast<uint32_t>(AddressingMode::RegisterIndirectWithDisplacement)) {
+        return false;
+    }
+    const InstructionInfo &info = INSTRUCTION_TABLE[opcode];
+    AddressingMode mode = static_cast<AddressingMode>(modeValue);
+    uint8_t r1 = static_cast<uint8_t>((word >> R1_SHIFT) & REGISTER_MASK);
+    uint8_t r2 = static_cast<uint8_t>((word >> R2_SHIFT) & REGISTER_MASK);
+    uint8_t r3 = static_cast<uint8_t>((word >> R3_SHIFT) & REGISTER_MASK);
+    bool minus = (word & SIGN_BIT) != 0;
+    if ((minus && mode != AddressingMode::RegisterIndirectWithDisplacement) || (info.arity < 3 && r3) || (info.arity < 2 && r2)) {
+        return false;
+    }
+    bool valid;
+    switch (info.arity) {
+    case 0: valid = mode == AddressingMode::None && !r1; break;
+    case 3: valid = mode == AddressingMode::RegisterDirect; break;
+    default: valid = allows(info, info.arity - 1, mode); break;
+    }
+    uint32_t size = getEncodedSize(mode);
+    if (!valid || size > available) {
+        return false;
+    }
+    instruction = { &info, mode, r1, r2, r3, minus, size > 1 ? words[1] : 0, size };
+    return true;
+}
+
+bool Isa::decode(const uint32_t *words, size_t available, Command &command, uint32_t &size) {
+    DecodedInstruction instruction;
+    if (!decode(words, available, instruction)) {
+        return false;
+    }
+    std::string name(instruction.info->mnemonic);
+    std::string operand = hasExtensionWord(instruction.mode) ? hexNumber(instruction.operand) : "";
+    Command::Sign sign = instruction.minus ? Command::Sign::Minus : Command::Sign::Plus;
+    switch (instruction.info->arity) {
+    case 0:
+        command = Command::createInstruction0(name);
+        break;
+    case 1:
+        command = Command::createInstruction(name, instruction.mode, operand, sign, instruction.r1);
+        break;
+    case 2:
+        command = Command::createInstruction(name, instruction.mode, operand, sign, instruction.r1, instruction.r2);
+        break;
+    default:
+        command = Command::createInstruction3(name, instruction.r1, instruction.r2, instruction.r3);
+        break;
+    }
+    size = instruction.size;
+    return true;
+}
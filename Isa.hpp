@@ -0,0 +1,232 @@
+#pragma once
+
+#include "Command.hpp"
+#include <array>
+#include <iterator>
+#include <string_view>
+
+// Opcodes of the instruction set in table order. Everything from Jmp on
+// transfers control. Trap isn't an instruction, the emulator patches it over
+// ops that carry a breakpoint.
+enum class Opcode : uint8_t {
+    Load,
+    Store,
+    Add,
+    Sub,
+    Mul,
+    Inc,
+    Dec,
+    Neg,
+    Push,
+    Pop,
+    Jmp,
+    Call,
+    Ret,
+    Jz,
+    Jnz,
+    Jlz,
+    Jlez,
+    Jgz,
+    Jgez,
+    Iret,
+    Trap
+};
+
+enum class InstructionKind : uint8_t {
+    Arithmetic,
+    Memory,
+    Stack,
+    Jump,       // jmp and call, one operand
+    Branch,     // tested register and target
+    Return
+};
+
+// What a branch tests its register against, None for everything else
+enum class BranchCondition : uint8_t {
+    None,
+    Zero,
+    NotZero,
+    Negative,
+    NotPositive,
+    Positive,
+    NotNegative
+};
+
+constexpr uint8_t modeBit(AddressingMode mode) {
+    return static_cast<uint8_t>(1u << static_cast<int>(mode));
+}
+
+constexpr uint8_t MODES_REGISTER = modeBit(AddressingMode::RegisterDirect);
+constexpr uint8_t MODES_WRITABLE = MODES_REGISTER | modeBit(AddressingMode::MemoryDirect) |
+    modeBit(AddressingMode::RegisterIndirect) | modeBit(AddressingMode::RegisterIndirectWithDisplacement);
+constexpr uint8_t MODES_ANY = MODES_WRITABLE | modeBit(AddressingMode::Immediate);
+
+struct InstructionInfo {
+    std::string_view mnemonic;
+    Opcode opcode;
+    InstructionKind kind;
+    uint8_t arity;
+    std::array<uint8_t, 3> operands;    // addressing modes allowed for each operand
+    uint32_t latency;                   // default cycles
+    BranchCondition condition;
+};
+
+// The instruction set. Adding an instruction is a line here plus its Opcode;
+// the parser, encoder, decoder and default latencies all follow the table.
+inline constexpr InstructionInfo INSTRUCTION_TABLE[] = {
+    { "load",  Opcode::Load,  InstructionKind::Memory,     2, { MODES_REGISTER, MODES_ANY, 0 }, 2, BranchCondition::None },
+    { "store", Opcode::Store, InstructionKind::Memory,     2, { MODES_REGISTER, MODES_WRITABLE, 0 }, 2, BranchCondition::None },
+    { "add",   Opcode::Add,   InstructionKind::Arithmetic, 3, { MODES_REGISTER, MODES_REGISTER, MODES_REGISTER }, 1, BranchCondition::None },
+    { "sub",   Opcode::Sub,   InstructionKind::Arithmetic, 3, { MODES_REGISTER, MODES_REGISTER, MODES_REGISTER }, 1, BranchCondition::None },
+    { "mul",   Opcode::Mul,   InstructionKind::Arithmetic, 3, { MODES_REGISTER, MODES_REGISTER, MODES_REGISTER }, 3, BranchCondition::None },
+    { "inc",   Opcode::Inc,   InstructionKind::Arithmetic, 1, { MODES_REGISTER, 0, 0 }, 1, BranchCondition::None },
+    { "dec",   Opcode::Dec,   InstructionKind::Arithmetic, 1, { MODES_REGISTER, 0, 0 }, 1, BranchCondition::None },
+    { "neg",   Opcode::Neg,   InstructionKind::Arithmetic, 1, { MODES_REGISTER, 0, 0 }, 1, BranchCondition::None },
+    { "push",  Opcode::Push,  InstructionKind::Stack,      1, { MODES_REGISTER, 0, 0 }, 2, BranchCondition::None },
+    { "pop",   Opcode::Pop,   InstructionKind::Stack,      1, { MODES_REGISTER, 0, 0 }, 2, BranchCondition::None },
+    { "jmp",   Opcode::Jmp,   InstructionKind::Jump,       1, { MODES_ANY, 0, 0 }, 2, BranchCondition::None },
+    { "call",  Opcode::Call,  InstructionKind::Jump,       1, { MODES_ANY, 0, 0 }, 3, BranchCondition::None },
+    { "ret",   Opcode::Ret,   InstructionKind::Return,     0, { 0, 0, 0 }, 3, BranchCondition::None },
+    { "jz",    Opcode::Jz,    InstructionKind::Branch,     2, { MODES_REGISTER, MODES_ANY, 0 }, 2, BranchCondition::Zero },
+    { "jnz",   Opcode::Jnz,   InstructionKind::Branch,     2, { MODES_REGISTER, MODES_ANY, 0 }, 2, BranchCondition::NotZero },
+    { "jlz",   Opcode::Jlz,   InstructionKind::Branch,     2, { MODES_REGISTER, MODES_ANY, 0 }, 2, BranchCondition::Negative },
+    { "jlez",  Opcode::Jlez,  InstructionKind::Branch,     2, { MODES_REGISTER, MODES_ANY, 0 }, 2, BranchCondition::NotPositive },
+    { "jgz",   Opcode::Jgz,   InstructionKind::Branch,     2, { MODES_REGISTER, MODES_ANY, 0 }, 2, BranchCondition::Positive },
+    { "jgez",  Opcode::Jgez,  InstructionKind::Branch,     2, { MODES_REGISTER, MODES_ANY, 0 }, 2, BranchCondition::NotNegative },
+    { "iret",  Opcode::Iret,  InstructionKind::Return,     0, { 0, 0, 0 }, 4, BranchCondition::None },
+};
+
+constexpr size_t INSTRUCTION_COUNT = std::size(INSTRUCTION_TABLE);
+
+// Table indices ordered by mnemonic, built while compiling
+constexpr std::array<uint8_t, INSTRUCTION_COUNT> sortInstructionsByMnemonic() {
+    std::array<uint8_t, INSTRUCTION_COUNT> order{};
+    for (size_t i = 0; i < INSTRUCTION_COUNT; ++i) {
+        size_t j = i;
+        while (j > 0 && INSTRUCTION_TABLE[i].mnemonic < INSTRUCTION_TABLE[order[j - 1]].mnemonic) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = static_cast<uint8_t>(i);
+    }
+    return order;
+}
+
+inline constexpr std::array<uint8_t, INSTRUCTION_COUNT> INSTRUCTIONS_BY_MNEMONIC = sortInstructionsByMnemonic();
+
+constexpr bool checkInstructionTable() {
+    for (size_t i = 0; i < INSTRUCTION_COUNT; ++i) {
+        if (static_cast<size_t>(INSTRUCTION_TABLE[i].opcode) != i || INSTRUCTION_TABLE[i].arity > 3) {
+            return false;
+        }
+        if ((INSTRUCTION_TABLE[i].kind == InstructionKind::Branch) != (INSTRUCTION_TABLE[i].condition != BranchCondition::None)) {
+            return false;
+        }
+        if (i > 0 && INSTRUCTION_TABLE[INSTRUCTIONS_BY_MNEMONIC[i - 1]].mnemonic == INSTRUCTION_TABLE[INSTRUCTIONS_BY_MNEMONIC[i]].mnemonic) {
+            return false;
+        }
+    }
+    return INSTRUCTION_COUNT == static_cast<size_t>(Opcode::Trap);
+}
+
+static_assert(checkInstructionTable(), "the instruction table must follow Opcode order with unique mnemonics and conditions on branches only");
+
+// Fields of an encoded instruction, operand is the extension word
+struct DecodedInstruction {
+    const InstructionInfo *info;
+    AddressingMode mode;
+    uint8_t r1;
+    uint8_t r2;
+    uint8_t r3;
+    bool minus;
+    uint32_t operand;
+    uint32_t size;
+};
+
+// Lookups into the instruction table plus the binary encoding.
+//
+// An instruction is one word, followed by an extension word holding the
+// number or address when its addressing mode has one:
+//   31..26 opcode  25..23 addressing mode  22..18 r1  17..13 r2  12..8 r3
+//   7 displacement sign  6..0 zero
+// r1 is the operand register of one-operand instructions and the destination
+// or tested register otherwise, r2 the operand register of two-operand ones.
+class Isa {
+public:
+    static constexpr uint32_t OPCODE_SHIFT = 26;
+    static constexpr uint32_t MODE_SHIFT = 23;
+    static constexpr uint32_t R1_SHIFT = 18;
+    static constexpr uint32_t R2_SHIFT = 13;
+    static constexpr uint32_t R3_SHIFT = 8;
+    static constexpr uint32_t SIGN_BIT = 1u << 7;
+    static constexpr uint32_t REGISTER_MASK = 0x1F;
+    static constexpr uint32_t MODE_MASK = 0x7;
+    static constexpr uint32_t RESERVED_MASK = 0x7F;
+    static constexpr uint32_t MAX_WORDS = 2;
+
+    static constexpr const InstructionInfo *find(std::string_view mnemonic) {
+        size_t low = 0, high = INSTRUCTION_COUNT;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            const InstructionInfo &info = INSTRUCTION_TABLE[INSTRUCTIONS_BY_MNEMONIC[middle]];
+            if (info.mnemonic == mnemonic) {
+                return &info;
+            }
+            if (info.mnemonic < mnemonic) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+        return nullptr;
+    }
+
+    static constexpr const InstructionInfo &get(Opcode opcode) {
+        return INSTRUCTION_TABLE[static_cast<size_t>(opcode)];
+    }
+
+    static constexpr bool isKind(std::string_view mnemonic, InstructionKind kind) {
+        const InstructionInfo *info = find(mnemonic);
+        return info && info->kind == kind;
+    }
+
+    static constexpr bool transfersControl(std::string_view mnemonic) {
+        const InstructionInfo *info = find(mnemonic);
+        return info && (info->kind == InstructionKind::Jump || info->kind == InstructionKind::Branch || info->kind == InstructionKind::Return);
+    }
+
+    // Whether a branch with the condition is taken when its register holds value
+    static constexpr bool holds(BranchCondition condition, int32_t value) {
+        switch (condition) {
+        case BranchCondition::Zero: return value == 0;
+        case BranchCondition::NotZero: return value != 0;
+        case BranchCondition::Negative: return value < 0;
+        case BranchCondition::NotPositive: return value <= 0;
+        case BranchCondition::Positive: return value > 0;
+        case BranchCondition::NotNegative: return value >= 0;
+        default: return false;
+        }
+    }
+
+    static constexpr bool allows(const InstructionInfo &info, size_t operand, AddressingMode mode) {
+        return operand < info.arity && (info.operands[operand] & modeBit(mode));
+    }
+
+    static constexpr bool hasExtensionWord(AddressingMode mode) {
+        return
+            mode == AddressingMode::Immediate ||
+            mode == AddressingMode::MemoryDirect ||
+            mode == AddressingMode::RegisterIndirectWithDisplacement;
+    }
+
+    static constexpr uint32_t getEncodedSize(AddressingMode mode) {
+        return hasExtensionWord(mode) ? 2 : 1;
+    }
+
+    static uint32_t encode(const Command &command, uint32_t operand, uint32_t *words);
+    static bool decode(const uint32_t *words, size_t available, DecodedInstruction &instruction);
+    static bool decode(const uint32_t *words, size_t available, Command &command, uint32_t &size);
+};
+
+static_assert(Isa::find("jgez") && Isa::find("jgez")->opcode == Opcode::Jgez && !Isa::find("dd"), "mnemonic lookup");
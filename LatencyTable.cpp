@@ -0,0 +1,66 @@
+#include "LatencyTable.hpp"
+#include "Isa.hpp"
+#include <fstream>
+#include <sstream>
+
+LatencyTable::LatencyTable() {
+    for (const InstructionInfo &instruction : INSTRUCTION_TABLE) {
+        latencies.emplace(instruction.mnemonic, instruction.latency);
+    }
+}
+
+// One "<instruction> <cycles>" pair per line, ';' starts a comment
+bool LatencyTable::load(const std::string &filename) {
+    std::ifstream fileStream(filename);
+    if (!fileStream) {
+        errors.emplace_back("Failed to open latency table", Error::NO_LINE, filename);
+        return false;
+    }
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(fileStream, line)) {
+        ++lineNumber;
+        line = line.substr(0, line.find(';'));
+        std::istringstream iss(line);
+        std::string instruction;
+        long long cycles;
+        if (!(iss >> instruction)) {
+            continue;
+        }
+        if (!(iss >> cycles) || cycles < 0) {
+            errors.emplace_back("Expected cycle count for " + instruction, lineNumber, filename);
+            continue;
+        }
+        latencies[instruction] = static_cast<uint32_t>(cycles);
+    }
+    return errors.empty();
+}
+
+void LatencyTable::setLatency(const std::string &instruction, uint32_t cycles) {
+    latencies[instruction] = cycles;
+}
+
+uint32_t LatencyTable::getLatency(const std::string &instruction) const {
+    auto it = latencies.find(instruction);
+    return it != latencies.end() ? it->second : DEFAULT_LATENCY;
+}
+
+uint32_t LatencyTable::getLatency(const Command &command) const {
+    if (command.getType() != Command::Type::Instruction) {
+        return 0;
+    }
+    return getLatency(command.getName());
+}
+
+const std::vector<Error> &LatencyTable::getErrors() const {
+    return errors;
+}
+
+bool LatencyTable::hasErrors() const {
+    return !errors.empty();
+}
+
+const LatencyTable &LatencyTable::getDefault() {
+    static const LatencyTable table;
+    return table;
+}
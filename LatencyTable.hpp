@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Command.hpp"
+#include <unordered_map>
+
+// Per-opcode cycle costs used by the static analyses, starting from the
+// latencies of the instruction table. Names that aren't listed take
+// DEFAULT_LATENCY cycles.
+class LatencyTable {
+public:
+    static constexpr uint32_t DEFAULT_LATENCY = 1;
+
+    LatencyTable();
+    bool load(const std::string &filename);
+    void setLatency(const std::string &instruction, uint32_t cycles);
+    uint32_t getLatency(const std::string &instruction) const;
+    uint32_t getLatency(const Command &command) const;
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+
+    static const LatencyTable &getDefault();
+private:
+    std::unordered_map<std::string, uint32_t> latencies;
+    std::vector<Error> errors;
+};
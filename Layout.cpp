@@ -0,0 +1,148 @@
+#include "Layout.hpp"
+#include "Linker.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+static std::string hex(uint64_t value) {
+    std::ostringstream oss;
+    oss << "0x" << std::hex << std::uppercase << std::setw(8) << std::setfill('0') << value;
+    return oss.str();
+}
+
+static std::string location(const Segment &segment, const std::vector<std::string> &sourceFiles) {
+    if (segment.line == Error::NO_LINE || segment.fileIndex >= sourceFiles.size()) {
+        return "start of program";
+    }
+    return std::filesystem::path(sourceFiles[segment.fileIndex]).filename().string() + ":" + std::to_string(segment.line);
+}
+
+Layout::Layout(std::vector<Command> &commands, const std::unordered_map<std::string, uint32_t> &symbolTable) :
+    commands(commands), symbolTable(symbolTable) {}
+
+// Reports with the file names of sourceFiles, which may be empty when the
+// layout is known to be sound
+bool Layout::place(Diagnostics &diagnostics, const std::vector<std::string> &sourceFiles) {
+    size_t reported = diagnostics.size();
+    auto report = [&](DiagnosticCode code, const Command &command, std::initializer_list<std::string_view> arguments) {
+        uint32_t file = command.getFileIndex() < sourceFiles.size() ? diagnostics.addFile(sourceFiles[command.getFileIndex()]) : Diagnostics::NO_FILE;
+        diagnostics.report(code, file, command.getLine(), arguments);
+    };
+
+    segments.clear();
+    Segment segment = { 0, 0, 0, 0, 0, Error::NO_LINE, 0, 0 };
+    uint64_t address = 0;
+    uint64_t words = 0;
+    bool tooLarge = false;
+    bool imageTooLarge = false;
+    auto close = [&](size_t end) {
+        segment.endCommand = end;
+        segment.size = static_cast<uint32_t>(std::min<uint64_t>(address - segment.start, UINT32_MAX));
+        if (segment.endCommand > segment.firstCommand) {
+            segments.push_back(segment);
+        }
+    };
+    for (size_t i = 0; i < commands.size(); ++i) {
+        Command &command = commands[i];
+        if (command.getType() == Command::Type::Directive && command.getName() == "org") {
+            close(i);
+            uint32_t origin;
+            if (!Linker::resolveValue(symbolTable, command.getNumberOrSymbol(), origin)) {
+                report(Linker::isNumber(command.getNumberOrSymbol()) ? DiagnosticCode::NumberOutOfRange : DiagnosticCode::InvalidOrigin,
+                    command, { command.getNumberOrSymbol() });
+                origin = static_cast<uint32_t>(std::min<uint64_t>(address, UINT32_MAX));
+            }
+            segment = { origin, 0, i, i, command.getFileIndex(), command.getLine(), 0, 0 };
+            address = origin;
+            tooLarge = false;
+        }
+        command.setAddress(static_cast<uint32_t>(address));
+        uint32_t size = command.getMemorySizeWords();
+        (command.getType() == Command::Type::Instruction ? segment.codeWords : segment.dataWords) += size;
+        address += size;
+        words += size;
+        if (address > (1ull << 32) && !tooLarge) {
+            report(DiagnosticCode::SegmentTooLarge, command, { hex(segment.start) });
+            tooLarge = true;
+        }
+        if (words > MAX_IMAGE_WORDS && !imageTooLarge) {
+            report(DiagnosticCode::ImageTooLarge, command, { hex(segment.start), hex(MAX_IMAGE_WORDS) });
+            imageTooLarge = true;
+        }
+    }
+    close(commands.size());
+
+    imageSize = static_cast<uint32_t>(std::min<uint64_t>(words, UINT32_MAX));
+    checkOverlaps(diagnostics, sourceFiles);
+    return diagnostics.size() == reported;
+}
+
+const std::vector<Segment> &Layout::getSegments() const {
+    return segments;
+}
+
+uint32_t Layout::getImageSize() const {
+    return imageSize;
+}
+
+// Segments in address order with the gaps between them
+std::string Layout::memoryMap(const std::vector<Segment> &segments, const std::vector<std::string> &sourceFiles) {
+    std::vector<const Segment *> ordered;
+    for (const Segment &segment : segments) {
+        if (segment.size > 0) {
+            ordered.push_back(&segment);
+        }
+    }
+    std::stable_sort(ordered.begin(), ordered.end(), [](const Segment *a, const Segment *b) {
+        return a->start < b->start;
+    });
+
+    std::ostringstream oss;
+    oss << std::left << std::setw(12) << "Start" << std::setw(12) << "End" << std::right << std::setw(10) << "Words"
+        << std::setw(10) << "Code" << std::setw(10) << "Data" << "  Origin" << std::endl;
+    uint64_t end = 0;
+    uint64_t used = 0;
+    for (const Segment *segment : ordered) {
+        if (segment->start > end) {
+            oss << std::left << std::setw(12) << hex(end) << std::setw(12) << hex(segment->start - 1) << std::right
+                << std::setw(10) << segment->start - end << "  (gap)" << std::endl;
+        }
+        oss << std::left << std::setw(12) << hex(segment->start) << std::setw(12) << hex(segment->getEnd() - 1) << std::right
+            << std::setw(10) << segment->size << std::setw(10) << segment->codeWords << std::setw(10) << segment->dataWords
+            << "  " << location(*segment, sourceFiles) << std::endl;
+        end = std::max(end, segment->getEnd());
+        used += segment->size;
+    }
+    oss << ordered.size() << " segments, " << used << " of " << end << " words used" << std::endl;
+    return oss.str();
+}
+
+// Each overlapping pair is reported once, at the segment placed later in the
+// source
+void Layout::checkOverlaps(Diagnostics &diagnostics, const std::vector<std::string> &sourceFiles) {
+    std::vector<IntervalTree::Interval> intervals;
+    intervals.reserve(segments.size());
+    for (uint32_t i = 0; i < segments.size(); ++i) {
+        if (segments[i].size > 0) {
+            intervals.push_back({ segments[i].start, segments[i].getEnd(), i });
+        }
+    }
+    IntervalTree tree(std::move(intervals));
+    std::vector<uint32_t> overlaps;
+    for (uint32_t i = 0; i < segments.size(); ++i) {
+        const Segment &segment = segments[i];
+        overlaps.clear();
+        tree.findOverlaps(segment.start, segment.getEnd(), overlaps);
+        std::sort(overlaps.begin(), overlaps.end());
+        for (uint32_t other : overlaps) {
+            if (other >= i) {
+                break;
+            }
+            const Command &org = commands[segment.firstCommand];
+            uint32_t file = org.getFileIndex() < sourceFiles.size() ? diagnostics.addFile(sourceFiles[org.getFileIndex()]) : Diagnostics::NO_FILE;
+            diagnostics.report(DiagnosticCode::SegmentOverlap, file, segment.line,
+                { hex(segment.start), hex(segments[other].start), location(segments[other], sourceFiles) });
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Command.hpp"
+#include "Diagnostics.hpp"
+#include "IntervalTree.hpp"
+#include <unordered_map>
+
+// A run of commands placed at consecutive addresses. The first segment starts
+// at address 0, every org directive starts a new one at its operand.
+struct Segment {
+    uint32_t start;
+    uint32_t size;              // words
+    size_t firstCommand;        // the org directive, if any
+    size_t endCommand;          // one past the last command
+    uint32_t fileIndex;         // of the org directive
+    int line;                   // of the org directive, NO_LINE for the first segment
+    uint32_t codeWords;
+    uint32_t dataWords;
+
+    uint64_t getEnd() const {
+        return static_cast<uint64_t>(start) + size;
+    }
+};
+
+// Assigns every command its address. Org operands are numbers or symbols of
+// def, labels can't be used since their addresses come out of the layout.
+// Segments may lie anywhere in the address space; only the words they hold
+// count against the image limit.
+// Overlapping segments are found through an interval tree over the placed
+// segments, so thousands of segments lay out in O(n log n).
+class Layout {
+public:
+    static constexpr uint32_t MAX_IMAGE_WORDS = 1u << 24;   // in all segments together, each one is stored densely
+
+    Layout(std::vector<Command> &commands, const std::unordered_map<std::string, uint32_t> &symbolTable);
+    bool place(Diagnostics &diagnostics, const std::vector<std::string> &sourceFiles);
+    const std::vector<Segment> &getSegments() const;
+    uint32_t getImageSize() const;
+
+    static std::string memoryMap(const std::vector<Segment> &segments, const std::vector<std::string> &sourceFiles);
+private:
+    std::vector<Command> &commands;
+    const std::unordered_map<std::string, uint32_t> &symbolTable;
+    std::vector<Segment> segments;
+    uint32_t imageSize = 0;                 // words in all segments
+
+    void checkOverlaps(Diagnostics &diagnostics, const std::vector<std::string> &sourceFiles);
+};
@@ -0,0 +1,54 @@
+#include "LineTable.hpp"
+#include "Error.hpp"
+#include <algorithm>
+#include <filesystem>
+
+void LineTable::setFiles(const std::vector<std::string> &files) {
+    this->files = files;
+}
+
+// Entries must be added in increasing address order
+void LineTable::addEntry(uint32_t address, uint32_t fileIndex, int line) {
+    if (!entries.empty()) {
+        Entry &last = entries.back();
+        if (last.fileIndex == fileIndex && last.line == line) {
+            return;
+        }
+        if (last.address == address) {
+            last.fileIndex = fileIndex;
+            last.line = line;
+            return;
+        }
+    }
+    entries.push_back({ address, fileIndex, line });
+}
+
+bool LineTable::find(uint32_t address, Location &location) const {
+    auto it = std::upper_bound(entries.begin(), entries.end(), address, [](uint32_t address, const Entry &entry) {
+        return address < entry.address;
+        });
+    if (it == entries.begin()) {
+        return false;
+    }
+    --it;
+    location = { it->fileIndex, it->line };
+    return it->line != Error::NO_LINE;
+}
+
+std::string LineTable::describe(uint32_t address) const {
+    Location location;
+    if (!find(address, location)) {
+        return "?";
+    }
+    std::string filename = std::filesystem::path(getFilename(location.fileIndex)).filename().string();
+    return filename + ":" + std::to_string(location.line);
+}
+
+const std::string &LineTable::getFilename(uint32_t fileIndex) const {
+    static const std::string unknown = "?";
+    return fileIndex < files.size() ? files[fileIndex] : unknown;
+}
+
+size_t LineTable::getEntryCount() const {
+    return entries.size();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Maps memory addresses back to source locations.
+// Only address ranges where the location changes are stored, so a
+// source line that emits many words costs a single entry.
+class LineTable {
+public:
+    struct Location {
+        uint32_t fileIndex;
+        int line;
+    };
+
+    void setFiles(const std::vector<std::string> &files);
+    void addEntry(uint32_t address, uint32_t fileIndex, int line);
+    bool find(uint32_t address, Location &location) const;
+    std::string describe(uint32_t address) const;
+    const std::string &getFilename(uint32_t fileIndex) const;
+    size_t getEntryCount() const;
+private:
+    struct Entry {
+        uint32_t address;
+        uint32_t fileIndex;
+        int line;
+    };
+    std::vector<std::string> files;
+    std::vector<Entry> entries;
+};
@@ -1,150 +1,291 @@
-#pragma once
-#include "Linker.hpp"
-#include <unordered_set>
-#include <vector>
-#include <filesystem>
-
-Linker::Linker(const std::string &rootFilename) : rootFilename(rootFilename) {}
-
-bool Linker::link() {
-    return 
-        resolveIncludes(rootFilename, commands) && 
-        resolveSymbols() && 
-        resolveStartDirective() && 
-        errors.empty();
-}
-
-bool Linker::resolveIncludes(const std::string &filename, std::vector<Command> &collectedCommands) {
-    if (hasCircularInclude(filename)) {
-        errors.push_back(Error("Circular include detected: " + filename));
-        return false;
-    }
-    if (includedFiles.count(filename) > 0) {
-        return true;
-    }
-    includeStack.push(filename);
-
-    if (!std::filesystem::exists(filename)) {
-        errors.push_back(Error("File doesn't exist: " + filename));
-        includeStack.pop();
-        return false;
-    }
-
-    Parser parser(filename);
-    if (!parser.parse()) {
-        errors.insert(errors.end(), parser.getErrors().begin(), parser.getErrors().end());
-        return false;
-    }
-
-    includedFiles.insert(filename);
-    std::vector<Command> currentFileCommands = parser.getCommands();
-
-    for (const Command &command : currentFileCommands) {
-        if (command.getType() == Command::Type::Directive && command.getName() == "include") {
-            std::string includeFilename = command.getNumberOrSymbol();
-
-            if (includeFilename.find(".asm") == std::string::npos) {
-                includeFilename += ".asm";
-            }
-
-            std::filesystem::path rootPath = std::filesystem::path(rootFilename).parent_path();
-            std::filesystem::path fullIncludePath = rootPath / includeFilename;
-
-            std::vector<Command> includedFileCommands;
-            if (!resolveIncludes(fullIncludePath.string(), includedFileCommands)) {
-                return false;
-            }
-
-            collectedCommands.insert(collectedCommands.end(), includedFileCommands.begin(), includedFileCommands.end());
-        }
-        else {
-            collectedCommands.push_back(command);
-        }
-    }
-
-
-    includeStack.pop();
-    return true;
-}
-
-bool Linker::hasCircularInclude(const std::string &filename) {
-    std::stack<std::string> temp = includeStack;
-    while (!temp.empty()) {
-        if (temp.top() == filename) {
-            return true;
-        }
-        temp.pop();
-    }
-    return false;
-}
-
-bool Linker::resolveSymbols() {
-    // First pass: collect all symbol definitions and labels
-    size_t memoryIndex = 0;
-    for (const Command &command : commands) {
-        if (command.getType() == Command::Type::SymbolDefinition) {
-            const std::string &symbol = command.getName();
-            if (symbolTable.count(symbol) > 0) {
-                errors.push_back(Error("Symbol redefinition: " + symbol));
-                return false;
-            }
-            symbolTable[symbol] = static_cast<uint32_t>(std::stoul(command.getNumberOrSymbol(), nullptr, 16));
-        }
-        else if (command.getType() == Command::Type::Label) {
-            const std::string &symbol = command.getName();
-            if (symbolTable.count(symbol) > 0) {
-                errors.push_back(Error("Symbol redefinition: " + symbol));
-                return false;
-            }
-            symbolTable[symbol] = memoryIndex;
-            memoryIndex += command.getMemorySizeWords();
-        }
-    }
-
-    // Second pass: resolve all symbol references
-    for (const Command &command : commands) {
-        if (command.getType() == Command::Type::Instruction || command.getType() == Command::Type::Directive) {
-            if (command.getAddressingMode() == AddressingMode::MemoryDirect ||
-                command.getAddressingMode() == AddressingMode::RegisterIndirectWithDisplacement) {
-                const std::string &symbol = command.getNumberOrSymbol();
-                if (symbolTable.count(symbol) == 0) {
-                    errors.push_back(Error("Undefined symbol: " + symbol));
-                    return false;
-                }
-            }
-        }
-    }
-
-    return true;
-}
-
-bool Linker::resolveStartDirective() {
-    for (const Command &command : commands) {
-        if (command.getType() == Command::Type::Directive && command.getName() == "start") {
-            if (startFound) {
-                errors.push_back(Error("Multiple start directives found."));
-                return false;
-            }
-            startFound = true;
-        }
-    }
-
-    if (!startFound) {
-        errors.push_back(Error("No start directive found."));
-        return false;
-    }
-
-    return true;
-}
-
-const std::vector<Command> &Linker::getCommands() const {
-    return commands;
-}
-
-const std::vector<Error> &Linker::getErrors() const {
-    return errors;
-}
-
-bool Linker::hasErrors() const {
-    return !errors.empty();
-}
+#pragma once
+#include "Linker.hpp"
+#include "AllocationTracker.hpp"
+#include <unordered_set>
+#include <vector>
+#include <filesystem>
+#include <cctype>
+
+Linker::Linker(const std::string &rootFilename) :
+    rootFilename(rootFilename),
+    rootDirectory(std::filesystem::path(rootFilename).parent_path().string()),
+    ownedSources(std::make_unique<SourceManager>()),
+    sources(*ownedSources) {}
+
+Linker::Linker(const std::string &rootFilename, SourceManager &sources) :
+    rootFilename(rootFilename),
+    rootDirectory(std::filesystem::path(rootFilename).parent_path().string()),
+    sources(sources) {}
+
+void Linker::addIncludePath(const std::string &directory) {
+    sources.addIncludePath(directory);
+}
+
+// Parsed files are taken from the cache and parsed into it on a miss
+void Linker::setParseCache(ParseCache *cache) {
+    parseCache = cache;
+}
+
+void Linker::setBranchProfile(const BranchProfile *profile) {
+    branchProfile = profile;
+}
+
+// Every file is parsed and every symbol checked before giving up, so one
+// link reports all errors. Symbols aren't resolved when a file is missing or
+// broken, undefined symbols would mostly follow from that.
+bool Linker::link() {
+    if (resolveIncludes(rootFilename, commands, nullptr)) {
+        resolveSymbols();
+        resolveStartDirective();
+    }
+    if (branchProfile && diagnostics.empty()) {
+        reorderBlocks();
+    }
+    return diagnostics.empty();
+}
+
+// Includes are looked up next to the root file, then along the include paths
+// of the source manager. A file is parsed once however it is spelled.
+bool Linker::resolveIncludes(const std::string &filename, std::vector<Command> &collectedCommands, const Command *include) {
+    AllocationScope scope("linker commands");
+    uint32_t includingFile = include ? diagnostics.addFile(sourceFiles[include->getFileIndex()]) : Diagnostics::NO_FILE;
+    int includingLine = include ? include->getLine() : Error::NO_LINE;
+    std::string error;
+    std::shared_ptr<const SourceFile> source = include ? sources.open(filename, rootDirectory, error) : sources.open(filename, "", error);
+    if (!source) {
+        diagnostics.report(DiagnosticCode::SourceUnavailable, includingFile, includingLine, { error });
+        return false;
+    }
+    uint32_t id = source->id;
+    if (fileStates[id] == FileState::OnStack) {
+        diagnostics.report(DiagnosticCode::CircularInclude, includingFile, includingLine, { source->path });
+        return false;
+    }
+    if (fileStates[id] == FileState::Done) {
+        return true;
+    }
+    fileStates[id] = FileState::OnStack;
+
+    // A file with errors still contributes its good lines, so that the files
+    // it includes get checked as well
+    const SourceFile &file = *source;
+    bool included = true;
+    std::vector<Command> currentFileCommands;
+    if (parseCache) {
+        std::shared_ptr<const ParsedFile> parsed = parseCache->get(file);
+        if (!parsed->diagnostics.empty()) {
+            diagnostics.merge(parsed->diagnostics);
+            included = false;
+        }
+        currentFileCommands = parsed->commands;
+    }
+    else {
+        Parser parser(file.path, file.data, file.size);
+        if (!parser.parse()) {
+            diagnostics.merge(parser.getDiagnostics());
+            included = false;
+        }
+        currentFileCommands = parser.getCommands();
+    }
+
+    uint32_t fileIndex = static_cast<uint32_t>(sourceFiles.size());
+    sourceFiles.push_back(file.path);
+    fileIds.push_back(id);
+
+    for (Command &command : currentFileCommands) {
+        command.setFileIndex(fileIndex);
+        if (command.getType() == Command::Type::Directive && command.getName() == "include") {
+            std::string includeFilename = command.getNumberOrSymbol();
+
+            if (includeFilename.find(".asm") == std::string::npos) {
+                includeFilename += ".asm";
+            }
+
+            std::vector<Command> includedFileCommands;
+            included = resolveIncludes(includeFilename, includedFileCommands, &command) && included;
+
+            collectedCommands.insert(collectedCommands.end(), includedFileCommands.begin(), includedFileCommands.end());
+        }
+        else {
+            collectedCommands.push_back(command);
+        }
+    }
+
+    fileStates[id] = FileState::Done;
+    return included;
+}
+
+bool Linker::resolveSymbols() {
+    AllocationScope scope("symbol table");
+    size_t reported = diagnostics.size();
+
+    // First pass: collect all symbol definitions and labels, the first
+    // definition of a name wins. Labels get their addresses once the
+    // definitions the org directives may use are known.
+    std::unordered_set<std::string> defined;
+    std::vector<const Command *> labels;
+    for (const Command &command : commands) {
+        if (command.getType() == Command::Type::SymbolDefinition || command.getType() == Command::Type::Label) {
+            const std::string &symbol = command.getName();
+            if (!defined.insert(symbol).second) {
+                report(DiagnosticCode::SymbolRedefinition, command, symbol);
+            }
+            else if (command.getType() == Command::Type::SymbolDefinition) {
+                // A value can name a definition above it, one that doesn't
+                // resolve is reported and reads as 0 so its uses don't add to it
+                const std::string &value = command.getNumberOrSymbol();
+                uint32_t resolved = 0;
+                if (!resolveValue(symbolTable, value, resolved)) {
+                    report(isNumber(value) ? DiagnosticCode::NumberOutOfRange : DiagnosticCode::UndefinedSymbol, command, value);
+                    resolved = 0;
+                }
+                symbolTable[symbol] = resolved;
+            }
+            else {
+                labels.push_back(&command);
+            }
+        }
+    }
+
+    Layout layout(commands, symbolTable);
+    layout.place(diagnostics, sourceFiles);
+    segments = layout.getSegments();
+    for (const Command *label : labels) {
+        symbolTable[label->getName()] = label->getAddress();
+    }
+
+    // Second pass: resolve all symbol references, an org that can't be
+    // resolved has been reported by the layout
+    for (const Command &command : commands) {
+        if (command.getType() == Command::Type::Directive && command.getName() == "org") {
+            continue;
+        }
+        if (command.getType() == Command::Type::Instruction || command.getType() == Command::Type::Directive) {
+            if (command.getType() == Command::Type::Directive ||
+                command.getAddressingMode() == AddressingMode::MemoryDirect ||
+                command.getAddressingMode() == AddressingMode::Immediate ||
+                command.getAddressingMode() == AddressingMode::RegisterIndirectWithDisplacement) {
+                const std::string &symbol = command.getNumberOrSymbol();
+                uint32_t value;
+                if (!resolveValue(symbolTable, symbol, value)) {
+                    report(isNumber(symbol) ? DiagnosticCode::NumberOutOfRange : DiagnosticCode::UndefinedSymbol, command, symbol);
+                }
+            }
+        }
+    }
+
+    return diagnostics.size() == reported;
+}
+
+// Added jumps make code longer, so the segments are laid out again and may
+// now overlap
+void Linker::reorderBlocks() {
+    BlockReorderer reorderer(commands, sourceFiles, *branchProfile);
+    bool changed = reorderer.reorder();
+    blockOrderStatistics = reorderer.getStatistics();
+    if (!changed) {
+        return;
+    }
+    commands = reorderer.getCommands();
+    Layout layout(commands, symbolTable);
+    layout.place(diagnostics, sourceFiles);
+    segments = layout.getSegments();
+    for (const Command &command : commands) {
+        if (command.getType() == Command::Type::Label) {
+            symbolTable[command.getName()] = command.getAddress();
+        }
+    }
+}
+
+// Numbers start with a digit, names can't
+bool Linker::isNumber(const std::string &numberOrSymbol) {
+    return !numberOrSymbol.empty() && std::isdigit(static_cast<unsigned char>(numberOrSymbol[0]));
+}
+
+// False for an undefined symbol and for a number that doesn't fit in 32 bits
+bool Linker::resolveValue(const std::unordered_map<std::string, uint32_t> &symbolTable, const std::string &numberOrSymbol, uint32_t &value) {
+    if (isNumber(numberOrSymbol)) {
+        uint64_t number;
+        if (!Token::parseNumber(numberOrSymbol, number) || number > UINT32_MAX) {
+            return false;
+        }
+        value = static_cast<uint32_t>(number);
+        return true;
+    }
+    auto it = symbolTable.find(numberOrSymbol);
+    if (it == symbolTable.end()) {
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
+bool Linker::resolveStartDirective() {
+    for (const Command &command : commands) {
+        if (command.getType() == Command::Type::Directive && command.getName() == "start") {
+            if (startFound) {
+                report(DiagnosticCode::MultipleStart, command);
+                return false;
+            }
+            startFound = true;
+        }
+    }
+
+    if (!startFound) {
+        diagnostics.report(DiagnosticCode::NoStart, Diagnostics::NO_FILE, Error::NO_LINE);
+        return false;
+    }
+
+    return true;
+}
+
+const std::vector<Command> &Linker::getCommands() const {
+    return commands;
+}
+
+const std::unordered_map<std::string, uint32_t> &Linker::getSymbolTable() const {
+    return symbolTable;
+}
+
+const std::vector<std::string> &Linker::getSourceFiles() const {
+    return sourceFiles;
+}
+
+const std::vector<uint32_t> &Linker::getFileIds() const {
+    return fileIds;
+}
+
+// Only meaningful after a successful link
+const std::vector<Segment> &Linker::getSegments() const {
+    return segments;
+}
+
+const BlockOrderStatistics &Linker::getBlockOrderStatistics() const {
+    return blockOrderStatistics;
+}
+
+CrossReference Linker::buildCrossReference() const {
+    return CrossReference(commands, symbolTable, sourceFiles);
+}
+
+std::vector<Error> Linker::getErrors() const {
+    return diagnostics.toErrors();
+}
+
+const Diagnostics &Linker::getDiagnostics() const {
+    return diagnostics;
+}
+
+bool Linker::hasErrors() const {
+    return !diagnostics.empty();
+}
+
+void Linker::report(DiagnosticCode code, const Command &command, std::string_view argument) {
+    uint32_t file = diagnostics.addFile(sourceFiles[command.getFileIndex()]);
+    if (argument.empty()) {
+        diagnostics.report(code, file, command.getLine());
+    }
+    else {
+        diagnostics.report(code, file, command.getLine(), { argument });
+    }
+}
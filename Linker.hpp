@@ -1,28 +1,61 @@
-#pragma once
-
-#include "Parser.hpp"
-#include <stack>
-#include <unordered_map>
-
-class Linker {
-public:
-    Linker(const std::string &rootFilename);
-    bool link();
-    const std::vector<Command> &getCommands() const;
-    const std::vector<Error> &getErrors() const;
-    bool hasErrors() const;
-private:
-    std::string rootFilename;
-    std::vector<Command> commands;
-    std::vector<Error> errors;
-    std::unordered_set<std::string> includedFiles;
-    std::unordered_map<std::string, uint32_t> symbolTable;
-    std::stack<std::string> includeStack;
-    bool startFound = false;
-
-    bool processFile(const std::string &filename);
-    bool resolveSymbols();
-    bool resolveIncludes(const std::string &filename, std::vector<Command> &collectedCommands);
-    bool hasCircularInclude(const std::string &filename);
-    bool resolveStartDirective();
-};
+#pragma once
+
+#include "Parser.hpp"
+#include "CrossReference.hpp"
+#include "ParseCache.hpp"
+#include "Layout.hpp"
+#include "BlockReorderer.hpp"
+#include <memory>
+#include <unordered_map>
+
+class Linker {
+public:
+    Linker(const std::string &rootFilename);
+    Linker(const std::string &rootFilename, SourceManager &sources);    // files stay mapped in sources
+    void addIncludePath(const std::string &directory);
+    void setParseCache(ParseCache *cache);
+    void setBranchProfile(const BranchProfile *profile);   // lays the blocks out for it after linking
+    bool link();
+    const std::vector<Command> &getCommands() const;
+    const std::unordered_map<std::string, uint32_t> &getSymbolTable() const;
+    const std::vector<std::string> &getSourceFiles() const;
+    const std::vector<uint32_t> &getFileIds() const;
+    const std::vector<Segment> &getSegments() const;
+    const BlockOrderStatistics &getBlockOrderStatistics() const;
+    CrossReference buildCrossReference() const;
+    std::vector<Error> getErrors() const;
+    const Diagnostics &getDiagnostics() const;
+    bool hasErrors() const;
+
+    static bool isNumber(const std::string &numberOrSymbol);
+    static bool resolveValue(const std::unordered_map<std::string, uint32_t> &symbolTable, const std::string &numberOrSymbol, uint32_t &value);
+private:
+    enum class FileState : uint8_t {
+        Unseen,
+        OnStack,    // being included, seeing it again is a cycle
+        Done
+    };
+
+    std::string rootFilename;
+    std::string rootDirectory;
+    std::unique_ptr<SourceManager> ownedSources;
+    SourceManager &sources;
+    ParseCache *parseCache = nullptr;
+    const BranchProfile *branchProfile = nullptr;
+    BlockOrderStatistics blockOrderStatistics;
+    std::unordered_map<uint32_t, FileState> fileStates;    // by SourceFile id, Unseen when missing
+    std::vector<Command> commands;
+    Diagnostics diagnostics;
+    std::vector<std::string> sourceFiles;
+    std::vector<uint32_t> fileIds;      // SourceFile ids in the order of sourceFiles
+    std::unordered_map<std::string, uint32_t> symbolTable;
+    std::vector<Segment> segments;
+    bool startFound = false;
+
+    bool processFile(const std::string &filename);
+    bool resolveSymbols();
+    bool resolveIncludes(const std::string &filename, std::vector<Command> &collectedCommands, const Command *include);
+    bool resolveStartDirective();
+    void reorderBlocks();
+    void report(DiagnosticCode code, const Command &command, std::string_view argument = {});
+};
@@ -0,0 +1,279 @@
+#include "Memory.hpp"
+#include <algorithm>
+#include <atomic>
+
+Memory::Memory() : home(this) {
+    clear();
+}
+
+Memory::Memory(Memory &shared) : home(&shared) {
+    std::lock_guard<std::mutex> lock(home->mutex);
+    home->shared = true;
+}
+
+bool Memory::isView() const {
+    return home != this;
+}
+
+// Drops cached translations, so pages allocated through other views since
+// are seen
+void Memory::synchronize() {
+    flushTlb();
+}
+
+void Memory::clear() {
+    for (auto &table : directory) {
+        table.reset();
+    }
+    dirtyPages.clear();
+    generation = 0;
+    for (const DeviceMapping &mapping : devices) {
+        flagDevicePages(mapping);
+    }
+    for (const auto &watch : watches) {
+        getEntry(watch.first >> PAGE_BITS).watched = true;
+    }
+    flushTlb();
+}
+
+// One segment of an image, words past the end of the address space are dropped
+void Memory::load(uint32_t base, const std::vector<uint32_t> &words) {
+    size_t count = static_cast<size_t>(std::min<uint64_t>(words.size(), (1ull << 32) - base));
+    for (size_t i = 0; i < count; ++i) {
+        if (words[i]) {
+            write(static_cast<uint32_t>(base + i), words[i]);
+        }
+    }
+}
+
+// All pages become shared with the snapshot, so the next write to any of them copies it
+Memory::Snapshot Memory::snapshot() {
+    for (uint32_t page : dirtyPages) {
+        getEntry(page).dirty = false;
+    }
+    dirtyPages.clear();
+    flushTlb();
+
+    Snapshot snapshot;
+    snapshot.generation = generation = nextGeneration();
+    for (uint32_t d = 0; d < directory.size(); ++d) {
+        if (!directory[d]) {
+            continue;
+        }
+        for (uint32_t t = 0; t <= TABLE_MASK; ++t) {
+            const PageEntry &entry = directory[d]->entries[t];
+            if (entry.page) {
+                snapshot.pages.emplace_back((d << TABLE_BITS) | t, entry.page);
+            }
+        }
+    }
+    return snapshot;
+}
+
+void Memory::restore(const Snapshot &snapshot) {
+    if (snapshot.generation == generation) {
+        for (uint32_t page : dirtyPages) {
+            auto it = std::lower_bound(snapshot.pages.begin(), snapshot.pages.end(), page, [](const auto &entry, uint32_t page) {
+                return entry.first < page;
+                });
+            PageEntry &entry = getEntry(page);
+            entry.page = it != snapshot.pages.end() && it->first == page ? it->second : nullptr;
+            entry.dirty = false;
+        }
+        dirtyPages.clear();
+        flushTlb();
+        return;
+    }
+    clear();
+    for (const auto &page : snapshot.pages) {
+        getEntry(page.first).page = page.second;
+    }
+    generation = snapshot.generation;
+}
+
+size_t Memory::getAllocatedPageCount() const {
+    size_t count = 0;
+    for (const auto &table : directory) {
+        if (table) {
+            count += std::count_if(table->entries.begin(), table->entries.end(), [](const PageEntry &entry) {
+                return entry.page != nullptr;
+                });
+        }
+    }
+    return count;
+}
+
+size_t Memory::getDirtyPageCount() const {
+    return dirtyPages.size();
+}
+
+// Mappings may not overlap each other or wrap around the address space
+bool Memory::mapDevice(uint32_t base, Device *device) {
+    uint32_t size = device->getSize();
+    if (size == 0 || base + (size - 1) < base) {
+        return false;
+    }
+    for (const DeviceMapping &mapping : devices) {
+        if (base <= mapping.base + (mapping.size - 1) && mapping.base <= base + (size - 1)) {
+            return false;
+        }
+    }
+    devices.push_back({ base, size, device });
+    flagDevicePages(devices.back());
+    flushTlb();
+    return true;
+}
+
+void Memory::flushDevices() {
+    std::unique_lock<std::mutex> lock(home->mutex, std::defer_lock);
+    if (home->shared) {
+        lock.lock();
+    }
+    for (const DeviceMapping &mapping : home->devices) {
+        mapping.device->flush();
+    }
+}
+
+void Memory::addWatch(uint32_t address, uint8_t kinds) {
+    watches[address] |= kinds;
+    getEntry(address >> PAGE_BITS).watched = true;
+    flushTlb();
+}
+
+// The page stays flagged while another word in it is watched
+bool Memory::removeWatch(uint32_t address) {
+    if (!watches.erase(address)) {
+        return false;
+    }
+    uint32_t page = address >> PAGE_BITS;
+    getEntry(page).watched = std::any_of(watches.begin(), watches.end(), [page](const auto &watch) {
+        return watch.first >> PAGE_BITS == page;
+        });
+    return true;
+}
+
+// Disabled watches let an access through, which is how a debugger steps over one
+void Memory::setWatchesEnabled(bool enabled) {
+    watchesEnabled = enabled;
+}
+
+bool Memory::takeWatchHit(WatchHit &hit) {
+    if (!watchHitPending) {
+        return false;
+    }
+    hit = watchHit;
+    watchHitPending = false;
+    return true;
+}
+
+const std::shared_ptr<Memory::Page> &Memory::zeroPage() {
+    static const std::shared_ptr<Page> page = std::make_shared<Page>(Page{});
+    return page;
+}
+
+uint64_t Memory::nextGeneration() {
+    static std::atomic<uint64_t> counter{ 0 };
+    return ++counter;
+}
+
+Memory::PageEntry *Memory::findEntry(uint32_t page) const {
+    const std::unique_ptr<PageTable> &table = home->directory[page >> TABLE_BITS];
+    return table ? &table->entries[page & TABLE_MASK] : nullptr;
+}
+
+Memory::PageEntry &Memory::getEntry(uint32_t page) {
+    std::unique_ptr<PageTable> &table = home->directory[page >> TABLE_BITS];
+    if (!table) {
+        table = std::make_unique<PageTable>();
+    }
+    return table->entries[page & TABLE_MASK];
+}
+
+// There are only ever a handful of devices
+const Memory::DeviceMapping *Memory::findDevice(uint32_t address) const {
+    for (const DeviceMapping &mapping : home->devices) {
+        if (address - mapping.base < mapping.size) {
+            return &mapping;
+        }
+    }
+    return nullptr;
+}
+
+void Memory::flagDevicePages(const DeviceMapping &mapping) {
+    uint32_t last = (mapping.base + (mapping.size - 1)) >> PAGE_BITS;
+    for (uint32_t page = mapping.base >> PAGE_BITS; ; ++page) {
+        getEntry(page).device = true;
+        if (page == last) {
+            break;
+        }
+    }
+}
+
+bool Memory::checkWatch(uint32_t address, bool write) const {
+    if (!watchesEnabled) {
+        return false;
+    }
+    auto it = home->watches.find(address);
+    if (it == home->watches.end() || !(it->second & (write ? WATCH_WRITE : WATCH_READ))) {
+        return false;
+    }
+    watchHit = { address, write };
+    watchHitPending = true;
+    return true;
+}
+
+// Untouched pages are cached read-only as the zero page. Unwatched words of a
+// flagged page behave as ordinary memory but bypass the TLB as well.
+bool Memory::readSlow(uint32_t address, uint32_t &value) const {
+    std::unique_lock<std::mutex> lock(home->mutex, std::defer_lock);
+    if (home->shared) {
+        lock.lock();
+    }
+    uint32_t page = address >> PAGE_BITS;
+    PageEntry *entry = findEntry(page);
+    const std::shared_ptr<Page> &data = entry && entry->page ? entry->page : zeroPage();
+    if (entry && (entry->device || entry->watched)) {
+        if (entry->watched && checkWatch(address, false)) {
+            return false;
+        }
+        if (const DeviceMapping *mapping = entry->device ? findDevice(address) : nullptr) {
+            return mapping->device->read(address - mapping->base, value);
+        }
+    }
+    else {
+        tlb[page & TLB_MASK] = { page, data->data(), entry && entry->dirty };
+    }
+    value = (*data)[address & PAGE_MASK];
+    return true;
+}
+
+bool Memory::writeSlow(uint32_t address, uint32_t value) {
+    std::unique_lock<std::mutex> lock(home->mutex, std::defer_lock);
+    if (home->shared) {
+        lock.lock();
+    }
+    uint32_t page = address >> PAGE_BITS;
+    PageEntry &entry = getEntry(page);
+    if (entry.watched && checkWatch(address, true)) {
+        return false;
+    }
+    if (entry.device) {
+        if (const DeviceMapping *mapping = findDevice(address)) {
+            return mapping->device->write(address - mapping->base, value);
+        }
+    }
+    if (!entry.dirty) {
+        entry.page = std::make_shared<Page>(entry.page ? *entry.page : Page{});
+        entry.dirty = true;
+        home->dirtyPages.push_back(page);
+    }
+    if (!entry.device && !entry.watched) {
+        tlb[page & TLB_MASK] = { page, entry.page->data(), true };
+    }
+    (*entry.page)[address & PAGE_MASK] = value;
+    return true;
+}
+
+void Memory::flushTlb() const {
+    tlb.fill(TlbEntry{});
+}
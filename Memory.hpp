@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "Device.hpp"
+
+// Sparse word-addressed simulated memory covering the whole 32-bit address
+// space. Addresses are translated through a two-level page table whose pages
+// are allocated on the first write; untouched memory reads as zero.
+// A small direct-mapped software TLB caches recent translations so the inline
+// accessors only walk the page table on a miss.
+//
+// Pages are shared copy-on-write with snapshots. A page is copied the first
+// time it is written after a snapshot or restore and remembered as dirty, so
+// restoring only touches pages written since.
+//
+// Pages overlapping a mapped device or holding a watched word are flagged in
+// the page table and never enter the TLB, so device accesses and watchpoints
+// take the slow path without costing the inline accessors anything.
+// A watched access is not performed, it fails and leaves a hit to be taken.
+//
+// A view shares the pages, devices and watches of another memory and only
+// keeps its own TLB, which is how several harts run over one memory. While a
+// memory has views, page allocation, copies and device accesses of all of
+// them are serialised on its mutex; accesses through the TLB are not, words
+// written by one hart are seen by the others as on the hardware. A page one
+// view allocates may still read as zero through another view's TLB until that
+// view synchronizes. Views take no snapshots, the memory they share must not
+// either while they run.
+class Memory {
+public:
+    static constexpr uint32_t PAGE_BITS = 10;
+    static constexpr uint32_t PAGE_WORDS = 1u << PAGE_BITS;
+    static constexpr uint32_t PAGE_MASK = PAGE_WORDS - 1;
+    static constexpr uint32_t TABLE_BITS = 12;
+    static constexpr uint32_t DIRECTORY_BITS = 32 - TABLE_BITS - PAGE_BITS;
+    static constexpr uint32_t TLB_BITS = 6;
+
+    using Page = std::array<uint32_t, PAGE_WORDS>;
+
+    enum Watch : uint8_t {
+        WATCH_READ = 1,
+        WATCH_WRITE = 2
+    };
+
+    struct WatchHit {
+        uint32_t address = 0;
+        bool write = false;
+    };
+
+    struct Snapshot {
+        uint64_t generation = 0;
+        std::vector<std::pair<uint32_t, std::shared_ptr<Page>>> pages; // sorted by page number
+    };
+
+    Memory();
+    explicit Memory(Memory &shared);
+    Memory(const Memory &) = delete;
+    Memory &operator=(const Memory &) = delete;
+    bool isView() const;
+    void synchronize();
+    void clear();
+    void load(uint32_t base, const std::vector<uint32_t> &words);
+    Snapshot snapshot();
+    void restore(const Snapshot &snapshot);
+    size_t getAllocatedPageCount() const;
+    size_t getDirtyPageCount() const;
+    bool mapDevice(uint32_t base, Device *device);
+    void flushDevices();
+    void addWatch(uint32_t address, uint8_t kinds);
+    bool removeWatch(uint32_t address);
+    void setWatchesEnabled(bool enabled);
+    bool takeWatchHit(WatchHit &hit);
+
+    bool read(uint32_t address, uint32_t &value) const {
+        uint32_t page = address >> PAGE_BITS;
+        const TlbEntry &entry = tlb[page & TLB_MASK];
+        if (entry.page == page) {
+            value = entry.data[address & PAGE_MASK];
+            return true;
+        }
+        return readSlow(address, value);
+    }
+
+    bool write(uint32_t address, uint32_t value) {
+        uint32_t page = address >> PAGE_BITS;
+        TlbEntry &entry = tlb[page & TLB_MASK];
+        if (entry.page == page && entry.writable) {
+            entry.data[address & PAGE_MASK] = value;
+            return true;
+        }
+        return writeSlow(address, value);
+    }
+private:
+    static constexpr uint32_t TABLE_MASK = (1u << TABLE_BITS) - 1;
+    static constexpr uint32_t TLB_MASK = (1u << TLB_BITS) - 1;
+    static constexpr uint32_t NO_PAGE = ~0u;
+
+    struct PageEntry {
+        std::shared_ptr<Page> page;     // null until the page is first written
+        bool dirty = false;             // private to this memory and may be written in place
+        bool device = false;            // overlaps a device mapping, never cached in the TLB
+        bool watched = false;           // holds a watched word, never cached in the TLB
+    };
+
+    struct PageTable {
+        std::array<PageEntry, 1u << TABLE_BITS> entries;
+    };
+
+    struct DeviceMapping {
+        uint32_t base;
+        uint32_t size;
+        Device *device;
+    };
+
+    struct TlbEntry {
+        uint32_t page = NO_PAGE;
+        uint32_t *data = nullptr;
+        bool writable = false;
+    };
+
+    Memory *home;                       // this, or the memory a view shares
+    bool shared = false;                // has views, slow paths lock
+    std::mutex mutex;
+    std::array<std::unique_ptr<PageTable>, 1u << DIRECTORY_BITS> directory;
+    mutable std::array<TlbEntry, 1u << TLB_BITS> tlb;
+    std::vector<uint32_t> dirtyPages;
+    std::vector<DeviceMapping> devices;
+    std::unordered_map<uint32_t, uint8_t> watches;
+    bool watchesEnabled = true;
+    mutable bool watchHitPending = false;
+    mutable WatchHit watchHit;
+    uint64_t generation = 0;            // snapshot the clean pages belong to
+
+    static const std::shared_ptr<Page> &zeroPage();
+    static uint64_t nextGeneration();
+    PageEntry *findEntry(uint32_t page) const;
+    PageEntry &getEntry(uint32_t page);
+    const DeviceMapping *findDevice(uint32_t address) const;
+    void flagDevicePages(const DeviceMapping &mapping);
+    bool checkWatch(uint32_t address, bool write) const;
+    bool readSlow(uint32_t address, uint32_t &value) const;
+    bool writeSlow(uint32_t address, uint32_t value);
+    void flushTlb() const;
+};
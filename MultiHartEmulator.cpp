@@ -0,0 +1,106 @@
+#include "MultiHartEmulator.hpp"
+#include <algorithm>
+#include <chrono>
+
+MultiHartEmulator::MultiHartEmulator(const Program &program, unsigned hartCount, uint64_t quantum, uint32_t stackWords) :
+    quantum(std::max<uint64_t>(quantum, 1)) {
+    for (const ImageSegment &segment : program.getImage()) {
+        memory.load(segment.base, segment.words);
+    }
+    hartCount = std::max(hartCount, 1u);
+    for (unsigned i = 0; i < hartCount; ++i) {
+        uint32_t stackTop = Emulator::DEFAULT_STACK_TOP - i * stackWords;
+        harts.push_back(std::make_unique<Emulator>(program, memory, stackTop));
+        harts.back()->setRegister(REGISTER_HART, i);
+        harts.back()->setRegister(REGISTER_HARTS, hartCount);
+    }
+}
+
+// Every hart runs until it stops or has executed maxSteps instructions
+void MultiHartEmulator::run(uint64_t maxSteps) {
+    active = harts.size();
+    waiting = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < harts.size(); ++i) {
+        threads.emplace_back(&MultiHartEmulator::work, this, i, maxSteps);
+    }
+    work(0, maxSteps);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t MultiHartEmulator::getHartCount() const {
+    return harts.size();
+}
+
+Emulator &MultiHartEmulator::getHart(size_t index) {
+    return *harts[index];
+}
+
+const Emulator &MultiHartEmulator::getHart(size_t index) const {
+    return *harts[index];
+}
+
+// Devices are mapped here, before the harts run
+Memory &MultiHartEmulator::getMemory() {
+    return memory;
+}
+
+uint64_t MultiHartEmulator::getInstructionCount() const {
+    uint64_t count = 0;
+    for (const auto &hart : harts) {
+        count += hart->getInstructionCount();
+    }
+    return count;
+}
+
+uint64_t MultiHartEmulator::getQuantumCount() const {
+    return quanta;
+}
+
+double MultiHartEmulator::getElapsedSeconds() const {
+    return elapsedSeconds;
+}
+
+void MultiHartEmulator::work(size_t index, uint64_t maxSteps) {
+    Emulator &hart = *harts[index];
+    uint64_t steps = 0;
+    hart.getMemory().synchronize();
+    while (true) {
+        uint64_t slice = std::min(quantum, maxSteps - steps);
+        uint64_t before = hart.getInstructionCount();
+        Emulator::State state = hart.run(slice);
+        steps += hart.getInstructionCount() - before;
+        bool stopped = state != Emulator::State::StepLimit || steps >= maxSteps;
+        arrive(stopped);
+        if (stopped) {
+            return;
+        }
+        hart.getMemory().synchronize();
+    }
+}
+
+// The last hart to arrive ends the quantum and releases the others
+void MultiHartEmulator::arrive(bool leave) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (leave) {
+        --active;
+    }
+    else {
+        ++waiting;
+    }
+    if (active > 0 && waiting == active) {
+        waiting = 0;
+        ++phase;
+        ++quanta;
+        released.notify_all();
+        return;
+    }
+    if (!leave) {
+        uint64_t arrived = phase;
+        released.wait(lock, [this, arrived] { return phase != arrived; });
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Emulator.hpp"
+#include <condition_variable>
+#include <thread>
+
+// Runs several harts of one program over shared memory, each on its own
+// host thread. Harts start at the entry with private registers and stacks:
+// sp is the top of their own stack, stackWords below the one before, a0
+// holds the hart index and a1 the hart count.
+//
+// Harts run in quanta of instructions and meet at a barrier after each, where
+// they synchronize their view of memory. Within a quantum they only see each
+// other through words of pages both already use; the quantum bounds how far
+// they drift apart. Larger quanta scale better, smaller ones keep harts that
+// communicate closer in time.
+class MultiHartEmulator {
+public:
+    static constexpr uint64_t DEFAULT_QUANTUM = 10000;
+    static constexpr uint32_t DEFAULT_STACK_WORDS = 1u << 16;
+    static constexpr int REGISTER_HART = 10;    // a0
+    static constexpr int REGISTER_HARTS = 11;   // a1
+
+    MultiHartEmulator(const Program &program, unsigned hartCount, uint64_t quantum = DEFAULT_QUANTUM,
+        uint32_t stackWords = DEFAULT_STACK_WORDS);
+    void run(uint64_t maxSteps = UINT64_MAX);
+    size_t getHartCount() const;
+    Emulator &getHart(size_t index);
+    const Emulator &getHart(size_t index) const;
+    Memory &getMemory();
+    uint64_t getInstructionCount() const;
+    uint64_t getQuantumCount() const;
+    double getElapsedSeconds() const;
+private:
+    Memory memory;
+    std::vector<std::unique_ptr<Emulator>> harts;
+    uint64_t quantum;
+    uint64_t quanta = 0;
+    double elapsedSeconds = 0;
+
+    // Harts that stopped leave the barrier, the others wait for each other
+    std::mutex mutex;
+    std::condition_variable released;
+    size_t waiting = 0;
+    size_t active = 0;
+    uint64_t phase = 0;
+
+    void work(size_t index, uint64_t maxSteps);
+    void arrive(bool leave);
+};
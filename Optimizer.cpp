@@ -0,0 +1,329 @@
+#include "Optimizer.hpp"
+#include "Isa.hpp"
+#include "Layout.hpp"
+#include <unordered_set>
+
+static constexpr int REGISTER_ZERO = 0;
+
+// Rules are tried in order on every instruction; add new patterns here
+const std::vector<Optimizer::Rule> Optimizer::rules = {
+    { "push-pop", &Optimizer::removePushPop },
+    { "identity-arithmetic", &Optimizer::removeIdentityArithmetic },
+    { "write-to-zero", &Optimizer::removeZeroWrite },
+    { "self-move", &Optimizer::removeSelfMove },
+    { "zero-branch", &Optimizer::foldZeroBranch },
+    { "jump-to-next", &Optimizer::removeJumpToNext },
+    { "jump-threading", &Optimizer::threadJump },
+    { "jump-to-ret", &Optimizer::replaceJumpToReturn },
+    { "unreachable", &Optimizer::removeUnreachable }
+};
+
+Optimizer::Optimizer(const std::vector<Command> &commands, const std::unordered_map<std::string, uint32_t> &symbolTable,
+    const LatencyTable &latencies)
+    : commands(commands), symbolTable(symbolTable), latencies(latencies) {}
+
+bool Optimizer::optimize() {
+    bool changed = false;
+    for (int pass = 0; pass < MAX_PASSES; ++pass) {
+        if (!runPass()) {
+            break;
+        }
+        changed = true;
+    }
+    relocateLabels();
+    return changed;
+}
+
+const std::vector<Command> &Optimizer::getCommands() const {
+    return commands;
+}
+
+const std::unordered_map<std::string, uint32_t> &Optimizer::getSymbolTable() const {
+    return symbolTable;
+}
+
+const std::unordered_map<std::string, size_t> &Optimizer::getRuleHits() const {
+    return ruleHits;
+}
+
+size_t Optimizer::getRemovedInstructions() const {
+    return removedInstructions;
+}
+
+uint32_t Optimizer::getSavedWords() const {
+    return savedWords;
+}
+
+uint64_t Optimizer::getSavedCycles() const {
+    return savedCycles;
+}
+
+uint32_t Optimizer::estimateCycles(const Command &command) const {
+    return latencies.getLatency(command);
+}
+
+bool Optimizer::runPass() {
+    removed.assign(commands.size(), false);
+    indexLabels();
+
+    bool changed = false;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        for (const Rule &rule : rules) {
+            if (!isInstruction(i)) {
+                break;
+            }
+            if (rule.apply(*this, i)) {
+                ruleHits[rule.name]++;
+                changed = true;
+            }
+        }
+    }
+    compact();
+    return changed;
+}
+
+void Optimizer::compact() {
+    std::vector<Command> kept;
+    kept.reserve(commands.size());
+    for (size_t i = 0; i < commands.size(); ++i) {
+        if (!removed[i]) {
+            kept.push_back(commands[i]);
+        }
+    }
+    commands = std::move(kept);
+    removed.assign(commands.size(), false);
+}
+
+void Optimizer::indexLabels() {
+    labelIndices.clear();
+    for (size_t i = 0; i < commands.size(); ++i) {
+        if (commands[i].getType() == Command::Type::Label) {
+            labelIndices[commands[i].getName()] = i;
+        }
+    }
+}
+
+void Optimizer::relocateLabels() {
+    // Removed instructions shift every following label of their segment
+    // down. Segments only shrink, so the layout that linked stays sound.
+    Diagnostics unused;
+    Layout layout(commands, symbolTable);
+    layout.place(unused, {});
+    for (const Command &command : commands) {
+        if (command.getType() == Command::Type::Label) {
+            symbolTable[command.getName()] = command.getAddress();
+        }
+    }
+}
+
+bool Optimizer::isInstruction(size_t index, const std::string &name) const {
+    return
+        index < commands.size() &&
+        !removed[index] &&
+        commands[index].getType() == Command::Type::Instruction &&
+        (name.empty() || commands[index].getName() == name);
+}
+
+bool Optimizer::isDirectJump(size_t index) const {
+    const Command &command = commands[index];
+    return
+        (command.getName() == "jmp" || Isa::isKind(command.getName(), InstructionKind::Branch)) &&
+        command.getAddressingMode() == AddressingMode::MemoryDirect &&
+        labelIndices.count(command.getNumberOrSymbol()) > 0;
+}
+
+// Next instruction that directly follows index, labels and directives in between break adjacency
+size_t Optimizer::nextAdjacent(size_t index) const {
+    for (size_t i = index + 1; i < commands.size(); ++i) {
+        if (removed[i] || commands[i].getType() == Command::Type::SymbolDefinition) {
+            continue;
+        }
+        return commands[i].getType() == Command::Type::Instruction ? i : NO_INDEX;
+    }
+    return NO_INDEX;
+}
+
+// Next instruction executed after index falls through, labels are skipped
+size_t Optimizer::nextReachable(size_t index) const {
+    for (size_t i = index + 1; i < commands.size(); ++i) {
+        if (removed[i] ||
+            commands[i].getType() == Command::Type::SymbolDefinition ||
+            commands[i].getType() == Command::Type::Label) {
+            continue;
+        }
+        return commands[i].getType() == Command::Type::Instruction ? i : NO_INDEX;
+    }
+    return NO_INDEX;
+}
+
+size_t Optimizer::labelTarget(const std::string &label) const {
+    auto it = labelIndices.find(label);
+    if (it == labelIndices.end()) {
+        return NO_INDEX;
+    }
+    return nextReachable(it->second);
+}
+
+void Optimizer::remove(size_t index) {
+    removed[index] = true;
+    removedInstructions++;
+    savedWords += commands[index].getMemorySizeWords();
+    savedCycles += estimateCycles(commands[index]);
+}
+
+void Optimizer::replace(size_t index, const Command &command, uint32_t bypassedCycles) {
+    uint32_t before = estimateCycles(commands[index]) + bypassedCycles;
+    uint32_t after = estimateCycles(command);
+    savedWords += commands[index].getMemorySizeWords() - command.getMemorySizeWords();
+    savedCycles += before > after ? before - after : 0;
+    commands[index] = command;
+}
+
+Command Optimizer::retarget(const Command &jump, const std::string &label) {
+    return Command::createInstruction(jump.getName(), AddressingMode::MemoryDirect, label, Command::Sign::Plus, jump.getR1(), jump.getR2());
+}
+
+// push rX; pop rX -> (nothing), push rX; pop rY -> load rY, rX
+bool Optimizer::removePushPop(Optimizer &optimizer, size_t index) {
+    const Command &push = optimizer.commands[index];
+    if (push.getName() != "push" || push.getAddressingMode() != AddressingMode::RegisterDirect) {
+        return false;
+    }
+    size_t next = optimizer.nextAdjacent(index);
+    if (!optimizer.isInstruction(next, "pop") || optimizer.commands[next].getAddressingMode() != AddressingMode::RegisterDirect) {
+        return false;
+    }
+    int source = push.getR1();
+    int destination = optimizer.commands[next].getR1();
+    if (source == destination) {
+        optimizer.remove(index);
+    }
+    else {
+        optimizer.replace(index, Command::createInstruction("load", AddressingMode::RegisterDirect, "", Command::Sign::Plus, destination, source));
+    }
+    optimizer.remove(next);
+    return true;
+}
+
+// add rX, rX, zero / add rX, zero, rX / sub rX, rX, zero
+bool Optimizer::removeIdentityArithmetic(Optimizer &optimizer, size_t index) {
+    const Command &command = optimizer.commands[index];
+    const std::string &name = command.getName();
+    int r1 = command.getR1(), r2 = command.getR2(), r3 = command.getR3();
+    bool identity =
+        (name == "add" && ((r1 == r2 && r3 == REGISTER_ZERO) || (r1 == r3 && r2 == REGISTER_ZERO))) ||
+        (name == "sub" && r1 == r2 && r3 == REGISTER_ZERO);
+    if (!identity) {
+        return false;
+    }
+    optimizer.remove(index);
+    return true;
+}
+
+// zero is hardwired, arithmetic targeting it has no effect
+bool Optimizer::removeZeroWrite(Optimizer &optimizer, size_t index) {
+    const Command &command = optimizer.commands[index];
+    if (!Isa::isKind(command.getName(), InstructionKind::Arithmetic) ||
+        command.getAddressingMode() != AddressingMode::RegisterDirect ||
+        command.getR1() != REGISTER_ZERO) {
+        return false;
+    }
+    optimizer.remove(index);
+    return true;
+}
+
+// load rX, rX
+bool Optimizer::removeSelfMove(Optimizer &optimizer, size_t index) {
+    const Command &command = optimizer.commands[index];
+    if (command.getName() != "load" ||
+        command.getAddressingMode() != AddressingMode::RegisterDirect ||
+        command.getR1() != command.getR2()) {
+        return false;
+    }
+    optimizer.remove(index);
+    return true;
+}
+
+// Branches on zero are either always or never taken
+bool Optimizer::foldZeroBranch(Optimizer &optimizer, size_t index) {
+    const Command &command = optimizer.commands[index];
+    const InstructionInfo *info = Isa::find(command.getName());
+    if (!info || info->kind != InstructionKind::Branch || command.getR1() != REGISTER_ZERO) {
+        return false;
+    }
+    if (!Isa::holds(info->condition, 0)) {
+        optimizer.remove(index);
+        return true;
+    }
+    optimizer.replace(index, Command::createInstruction("jmp", command.getAddressingMode(),
+        command.getNumberOrSymbol(), command.getSign(), command.getR2()));
+    return true;
+}
+
+// jmp L / jz rX, L where L labels the following instruction
+bool Optimizer::removeJumpToNext(Optimizer &optimizer, size_t index) {
+    if (!optimizer.isDirectJump(index)) {
+        return false;
+    }
+    size_t target = optimizer.labelTarget(optimizer.commands[index].getNumberOrSymbol());
+    if (target == NO_INDEX || target != optimizer.nextReachable(index)) {
+        return false;
+    }
+    optimizer.remove(index);
+    return true;
+}
+
+// Jumps to an unconditional jmp go straight to its final destination
+bool Optimizer::threadJump(Optimizer &optimizer, size_t index) {
+    if (!optimizer.isDirectJump(index)) {
+        return false;
+    }
+    std::string label = optimizer.commands[index].getNumberOrSymbol();
+    std::unordered_set<std::string> visited = { label };
+    uint32_t bypassedCycles = 0;
+    for (int depth = 0; depth < MAX_THREADING_DEPTH; ++depth) {
+        size_t target = optimizer.labelTarget(label);
+        if (target == NO_INDEX || target == index ||
+            !optimizer.isInstruction(target, "jmp") || !optimizer.isDirectJump(target)) {
+            break;
+        }
+        const std::string &next = optimizer.commands[target].getNumberOrSymbol();
+        if (!visited.insert(next).second) {
+            return false; // jump cycle, leave it alone
+        }
+        bypassedCycles += optimizer.estimateCycles(optimizer.commands[target]);
+        label = next;
+    }
+    if (label == optimizer.commands[index].getNumberOrSymbol()) {
+        return false;
+    }
+    optimizer.replace(index, retarget(optimizer.commands[index], label), bypassedCycles);
+    return true;
+}
+
+// jmp L where L: ret -> ret
+bool Optimizer::replaceJumpToReturn(Optimizer &optimizer, size_t index) {
+    if (optimizer.commands[index].getName() != "jmp" || !optimizer.isDirectJump(index)) {
+        return false;
+    }
+    size_t target = optimizer.labelTarget(optimizer.commands[index].getNumberOrSymbol());
+    if (!optimizer.isInstruction(target, "ret")) {
+        return false;
+    }
+    optimizer.replace(index, optimizer.commands[target], optimizer.estimateCycles(optimizer.commands[index]));
+    return true;
+}
+
+// Instructions after jmp/ret that no label can reach
+bool Optimizer::removeUnreachable(Optimizer &optimizer, size_t index) {
+    const std::string &name = optimizer.commands[index].getName();
+    if (name != "jmp" && !Isa::isKind(name, InstructionKind::Return)) {
+        return false;
+    }
+    bool changed = false;
+    for (size_t next = optimizer.nextAdjacent(index); next != NO_INDEX; next = optimizer.nextAdjacent(next)) {
+        optimizer.remove(next);
+        changed = true;
+    }
+    return changed;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "LatencyTable.hpp"
+#include <unordered_map>
+
+// Peephole optimizer that runs over the linked command stream.
+// Every rewrite is described by an entry in the rule table (Optimizer.cpp);
+// rules are applied repeatedly until the stream stops changing.
+class Optimizer {
+public:
+    Optimizer(const std::vector<Command> &commands, const std::unordered_map<std::string, uint32_t> &symbolTable,
+        const LatencyTable &latencies = LatencyTable::getDefault());
+    bool optimize();
+    const std::vector<Command> &getCommands() const;
+    const std::unordered_map<std::string, uint32_t> &getSymbolTable() const;
+    const std::unordered_map<std::string, size_t> &getRuleHits() const;
+    size_t getRemovedInstructions() const;
+    uint32_t getSavedWords() const;
+    uint64_t getSavedCycles() const;
+private:
+    struct Rule {
+        const char *name;
+        bool (*apply)(Optimizer &optimizer, size_t index);
+    };
+
+    static constexpr size_t NO_INDEX = ~0;
+    static constexpr int MAX_PASSES = 16;
+    static constexpr int MAX_THREADING_DEPTH = 32;
+
+    static const std::vector<Rule> rules;
+
+    std::vector<Command> commands;
+    std::vector<bool> removed;
+    std::unordered_map<std::string, size_t> labelIndices;
+    std::unordered_map<std::string, uint32_t> symbolTable;
+    std::unordered_map<std::string, size_t> ruleHits;
+    const LatencyTable &latencies;
+    size_t removedInstructions = 0;
+    uint32_t savedWords = 0;
+    uint64_t savedCycles = 0;
+
+    bool runPass();
+    void compact();
+    void indexLabels();
+    void relocateLabels();
+    uint32_t estimateCycles(const Command &command) const;
+
+    bool isInstruction(size_t index, const std::string &name = "") const;
+    bool isDirectJump(size_t index) const;
+    size_t nextAdjacent(size_t index) const;
+    size_t nextReachable(size_t index) const;
+    size_t labelTarget(const std::string &label) const;
+    void remove(size_t index);
+    void replace(size_t index, const Command &command, uint32_t bypassedCycles = 0);
+
+    static Command retarget(const Command &jump, const std::string &label);
+
+    static bool removePushPop(Optimizer &optimizer, size_t index);
+    static bool removeIdentityArithmetic(Optimizer &optimizer, size_t index);
+    static bool removeZeroWrite(Optimizer &optimizer, size_t index);
+    static bool removeSelfMove(Optimizer &optimizer, size_t index);
+    static bool foldZeroBranch(Optimizer &optimizer, size_t index);
+    static bool removeJumpToNext(Optimizer &optimizer, size_t index);
+    static bool threadJump(Optimizer &optimizer, size_t index);
+    static bool replaceJumpToReturn(Optimizer &optimizer, size_t index);
+    static bool removeUnreachable(Optimizer &optimizer, size_t index);
+};
@@ -0,0 +1,52 @@
+#include "ParseCache.hpp"
+
+std::shared_ptr<const ParsedFile> ParseCache::get(const SourceFile &file) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = entries.find(file.key);
+        if (entry != entries.end()) {
+            if (entry->second.modified == file.modified && entry->second.size == file.size) {
+                ++hits;
+                return entry->second.parsed;
+            }
+        }
+    }
+    // Hashing happens outside the lock, it reads the whole file
+    uint64_t contentHash = hash(file.data, file.size);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = entries.find(file.key);
+        if (entry != entries.end() && entry->second.size == file.size && entry->second.hash == contentHash) {
+            entry->second.modified = file.modified;
+            ++hits;
+            return entry->second.parsed;
+        }
+    }
+
+    ++misses;
+    auto parsed = std::make_shared<ParsedFile>();
+    Parser parser(file.path, file.data, file.size);
+    parser.parse();
+    parsed->commands = parser.getCommands();
+    parsed->diagnostics = parser.getDiagnostics();
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[file.key] = { file.modified, file.size, contentHash, parsed };
+    return parsed;
+}
+
+uint64_t ParseCache::getHitCount() const {
+    return hits;
+}
+
+uint64_t ParseCache::getMissCount() const {
+    return misses;
+}
+
+// FNV-1a over 64-bit
+uint64_t ParseCache::hash(const char *data, size_t size) {
+    uint64_t value = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        value = (value ^ static_cast<unsigned char>(data[i])) * 0x100000001B3ull;
+    }
+    return value;
+}
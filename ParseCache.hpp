@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Parser.hpp"
+#include "SourceManager.hpp"
+#include <atomic>
+#include <memory>
+
+// Commands and diagnostics of one parsed source file
+struct ParsedFile {
+    std::vector<Command> commands;
+    Diagnostics diagnostics;
+};
+
+// Parse results shared between builds, keyed by file identity. An entry is
+// reused while the file keeps its modification time and size; a file that
+// was touched but not changed is recognised by its content hash and still
+// reused. Thread-safe, a file missing from the cache may be parsed by two
+// threads at once and the later result wins.
+class ParseCache {
+public:
+    std::shared_ptr<const ParsedFile> get(const SourceFile &file);
+    uint64_t getHitCount() const;
+    uint64_t getMissCount() const;
+private:
+    struct Entry {
+        int64_t modified;
+        size_t size;
+        uint64_t hash;
+        std::shared_ptr<const ParsedFile> parsed;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<FileKey, Entry, FileKeyHash> entries;
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+
+    static uint64_t hash(const char *data, size_t size);
+};
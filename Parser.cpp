@@ -1,550 +1,853 @@
-#include "Parser.hpp"
-#include "Token.hpp"
-#include <iostream>
-#include <unordered_set>
-#include <unordered_map>
-#include <algorithm>
-
-// Categorizing instructions by type and arity
-const std::unordered_set<std::string> Parser::jump0 = { "ret" };
-const std::unordered_set<std::string> Parser::jump1 = { "jmp", "call" };
-const std::unordered_set<std::string> Parser::jump2 = { "jz", "jnz", "jlz", "jlez", "jgz", "jgez" };
-
-const std::unordered_set<std::string> Parser::arithmetic1 = { "inc", "dec", "neg", "push", "pop"};
-const std::unordered_set<std::string> Parser::arithmetic2 = {};
-const std::unordered_set<std::string> Parser::arithmetic3 = { "add", "sub", "mul" };
-
-const std::unordered_map<std::string, size_t> Parser::specialRegisters = {
-    {"zero", 0},
-    {"ra", 1},
-    {"sp", 2},
-    {"gp", 3},
-    {"fp", 8},
-    {"s0", 8},
-    {"s1", 9},
-    {"a0", 10},
-    {"a1", 11},
-    {"a2", 12},
-    {"a3", 13},
-    {"a4", 14},
-    {"a5", 15},
-    {"t0", 5}, 
-    {"t1", 6}, 
-    {"t2", 7}, 
-    {"t3", 28},
-    {"t4", 29},
-    {"t5", 30},
-    {"t6", 31},
-    {"ivtp", 26},
-    {"imr", 27}
-};
-
-size_t Parser::getRegisterIndex(const std::string &name) {
-    std::string normalized = name;
-    std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](unsigned char c) {
-        return std::tolower(c);
-        });
-    auto it = specialRegisters.find(normalized);
-    if (it != specialRegisters.end()) {
-        return it->second;
-    }
-    if (normalized[0] == 'r' && normalized.size() > 1) {
-        try {
-            int regIndex = std::stoi(normalized.substr(1));
-            if (regIndex >= 0 && regIndex <= 31) {
-                return static_cast<size_t>(regIndex);
-            }
-        }
-        catch (const std::exception &) {
-            return REGISTER_INVALID;
-        }
-    }
-    return REGISTER_INVALID;
-}
-
-const std::unordered_set<std::string> Parser::keywords = { "def", "include", "start", "org", "dd", "dup"};
-
-Parser::Parser(const std::string &filename) : filename(filename), currentTokenIndex(0), currentLine(1) {
-    Tokenizer tokenizer(filename);
-    if (!tokenizer.tokenize()) {
-        errors = tokenizer.getErrors();
-    }
-    else {
-        tokens = tokenizer.getTokens();
-    }
-}
-
-bool Parser::parse() {
-    while (currentTokenIndex < tokens.size()) {
-        parseCommand();
-    }
-    return errors.empty();
-}
-
-const std::vector<Command> &Parser::getCommands() const {
-    return commands;
-}
-
-const std::vector<Error> &Parser::getErrors() const {
-    return errors;
-}
-
-bool Parser::hasErrors() const {
-    return !errors.empty();
-}
-
-bool Parser::parseCommand() {
-    if (parseCommandUnaligned()) {
-        return true;
-    }
-    while (!currentToken().value.empty() && currentToken().value != "\n") {
-        nextToken();
-    }
-    nextToken(); // skip "\n"
-    return false;
-}
-
-bool Parser::parseCommandUnaligned() {
-    Token token = currentToken();
-    if (token.value == "\n") {
-        nextToken();
-        return true; // skip empty line
-    }
-    if (token.type != Token::Type::Name) {
-        addError("Command can't start with " + token.value);
-        return false;
-    }
-    if (keywords.count(token.value)) {
-        return parseDirective();
-    }
-    if (getToken(1).value == "def") {
-        return parseSymbolDefinition();
-    }
-    if (getToken(1).type == Token::Type::Symbol && getToken(1).value == ":") {
-        return parseLabel();
-    }
-    return parseInstruction();
-}
-
-bool Parser::parseInstruction() {
-    Token token = currentToken();
-
-    std::string name = token.value;
-    nextToken(); // skip the name
-
-    if (hasArity0(name)) {
-        return parseInstruction0(name);
-    }
-    else if (hasArity1(name)) {
-        return parseInstruction1(name);
-    }
-    else if (hasArity2(name)) {
-        return parseInstruction2(name);
-    }
-    else if (hasArity3(name)) {
-        return parseInstruction3(name);
-    }
-    else {
-        addError("Unknown instruction: " + name);
-        return false;
-    }
-    return parseNewline();
-}
-
-bool Parser::parseInstruction0(const std::string &name) {
-    commands.push_back(Command::createInstruction0(name));
-    return true;
-}
-
-bool Parser::parseInstruction1(const std::string &name) {
-    if (!isOperand()) {
-        addError("Expected an operand for " + name);
-        return false;
-    }
-    if (arithmetic1.count(name) > 0 && !isRegister()) {
-        addError("Invalid operand for " + name + ": " + currentToken().value + ", expected register");
-        return false;
-    }
-    AddressingMode mode;
-    if (isRegister()) {
-
-    }
-    AddressingMode addressingMode;
-    std::string numberOrSymbol;
-    Command::Sign sign;
-    int r;
-    getOperatorInfo(addressingMode, numberOrSymbol, sign, r);
-
-    Command command = Command::createInstruction(name, addressingMode, numberOrSymbol, sign, r);
-    commands.push_back(command);
-    consumeOperand();
-    return true;
-}
-
-bool Parser::parseInstruction2(const std::string &name) {
-    AddressingMode addressingMode;
-    std::string numberOrSymbol;
-    Command::Sign sign;
-    int r1, r2;
-
-    if (!isOperand()) {
-        addError("Expected an operand for " + name);
-        return false;
-    }
-    if (!isRegister()) {
-        addError("First operand for " + name + " must be a register");
-        return false;
-    }
-    r1 = getRegisterIndex(currentToken().value);
-    consumeOperand();
-    if (!currentToken().matchToken(Token::Type::Symbol, ",")) {
-        addError("Expected ',' after first operand for " + name);
-        return false;
-    }
-    nextToken(); // skip comma
-    if (!isOperand()) {
-        addError("Expected an operand for " + name);
-        return false;
-    }
-    if (name == "store" && currentToken().value == "#") {
-        addError("Can't store to a constant");
-        return false;
-    }
-    getOperatorInfo(addressingMode, numberOrSymbol, sign, r2);
-    commands.push_back(Command::createInstruction(name, addressingMode, numberOrSymbol, sign, r1, r2));
-    consumeOperand();
-    return true;
-}
-
-bool Parser::parseInstruction3(const std::string &name) {
-    int r[3];
-    for (int i = 0; i < 3; ++i) {
-        if (!isRegister()) {
-            addError("Invalid operand for " + name + ": " + currentToken().value + ", expected register");
-            return false;
-        }
-        r[i] = getRegisterIndex(currentToken().value);
-        consumeRegister();
-
-        if (i < 2 && !currentToken().matchToken(Token::Type::Symbol, ",")) {
-            addError("Expected ',' between operands for " + name);
-            return false;
-        }
-        nextToken(); // skip comma
-    }
-    commands.push_back(Command::createInstruction3(name, r[0], r[1], r[2]));
-    return true;
-}
-
-bool Parser::parseDup() {
-    std::string value;
-    size_t repetition;
-    nextToken(); // skip (
-    if (!isNumberOrSymbol()) {
-        addError("Expected number or symbol");
-        return false;
-    }
-    value = currentToken().value;
-    consumeNumberOrSymbol();
-    if (currentToken().value != "dup") {
-        addError("Invalid format for 'dd', expected 'dup'");
-        return false;
-    }
-    nextToken(); // skip dup
-    if (!isNumber()) {
-        addError("Expected number");
-        return false;
-    }
-    repetition = static_cast<uint32_t>(std::stoul(currentToken().value, nullptr, 16));
-    consumeNumber();
-    if (currentToken().value != ")") {
-        addError("Expected ')'");
-        return false;
-    }
-    nextToken(); // )
-    commands.push_back(Command::createDirective("dup", value, repetition));
-    return true;
-}
-
-bool Parser::parseDD() {
-    if (currentToken().value == "(") {
-        return parseDup();
-    }
-    std::vector<std::string> operands;
-    if (!isNumberOrSymbol()) {
-        addError("Expected number or symbol");
-        return false;
-    }
-    operands.push_back(currentToken().value);
-    consumeNumberOrSymbol();
-    while (true) {
-        if (currentToken().value != ",") {
-            break;
-        }
-        nextToken();  // skip commas
-        if (!isNumberOrSymbol()) {
-            addError("Expected number or symbol");
-            return false;
-        }
-        operands.push_back(currentToken().value);
-        consumeNumberOrSymbol();
-    }
-    bool front = true;
-    for (const std::string &operand : operands) {
-        commands.push_back(Command::createDirective("dd", operand));
-    }
-    return parseNewline();
-}
-
-bool Parser::parseDirective() {
-    Token token = currentToken();
-    std::string directiveName = token.value;
-    nextToken();
-
-    if (directiveName == "include") {
-        if (!isSymbol()) {
-            addError("Expected filename after 'include' directive");
-            return false;
-        }
-        commands.push_back(Command::createDirective(directiveName, currentToken().value));
-        nextToken(); // skip filename
-        return parseNewline();
-    }
-    else if (directiveName == "start" || directiveName == "org") {
-        if (!isNumberOrSymbol()) {
-            addError("Expected number for '" + directiveName + "'");
-            return false;
-        }
-        commands.push_back(Command::createDirective(directiveName, currentToken().value));
-        consumeNumberOrSymbol();
-        return parseNewline();
-    }
-    else if (directiveName == "dd") {
-        return parseDD();
-    }
-
-    addError("Unknown directive: " + directiveName);
-    return false;
-}
-
-
-bool Parser::parseSymbolDefinition() {
-    std::string symbol = currentToken().value;
-    nextToken();  // Skip symbol
-    nextToken();  // Skip 'def'
-    if (!isNumberOrSymbol()) {
-        addError("Expected number or symbol after 'def'");
-        return false;
-    }
-    std::string value = currentToken().value;
-    consumeNumberOrSymbol();
-    commands.push_back(Command::createSymbolDefinition(symbol, value));
-    return parseNewline();
-}
-
-bool Parser::parseNewline() {
-    if (currentToken().value.empty() || currentToken().value != "\n") {
-        addError("Only one command per line");
-        return false;
-    }
-    nextToken(); // skip "\n"
-    return true;
-}
-
-bool Parser::parseLabel() {
-    Token labelToken = currentToken();
-    nextToken();  // Skip label
-    nextToken();  // Skip ':'
-    commands.push_back(Command::createLabel(labelToken.value));
-    return true;
-}
-
-void Parser::addError(const std::string &message) {
-    errors.emplace_back(message, currentLine, filename);
-}
-
-Token Parser::getToken(int offset) const {
-    int index = currentTokenIndex + offset;
-    if (index < tokens.size()) {
-        return tokens[index];
-    }
-    return { Token::Type::Unknown, "" };
-}
-
-Token Parser::currentToken() const {
-    return getToken(0);
-}
-
-Token Parser::nextToken() {
-    currentTokenIndex++;
-    return currentToken();
-}
-
-bool Parser::isRegister(int offset) const {
-    return getRegisterIndex(getToken(offset).value) != REGISTER_INVALID;
-}
-
-bool Parser::isSymbol(int offset) const {
-    return 
-        getToken(offset).matchToken(Token::Type::Name) && 
-        keywords.find(getToken(offset).value) == keywords.end() && 
-        !isRegister(offset);
-}
-
-bool Parser::isNumber(int offset) const {
-    return getToken(offset).matchToken(Token::Type::Number);
-}
-
-bool Parser::isNumberOrSymbol(int offset) const {
-    return isSymbol(offset) || isNumber(offset);
-}
-
-bool Parser::isRegisterIndirect(int offset) const {
-    return
-        !getToken(offset).matchToken(Token::Type::Symbol, "[") &&
-        !isRegister(offset + 1) &&
-        !getToken(offset + 2).matchToken(Token::Type::Symbol, "]");
-}
-
-bool Parser::isRegisterIndirectWithDisplacement(int offset) const {
-    int currentDisplacement = offset;
-    if (!getToken(currentDisplacement).matchToken(Token::Type::Symbol, "[")) {
-        return false;
-    }
-
-    currentDisplacement++;
-
-    if (!isRegister(currentDisplacement) && !isNumberOrSymbol(currentDisplacement)) {
-        return false;
-    }
-    bool operand1IsRegister = isRegister(currentDisplacement);
-    currentDisplacement++;
-
-    std::string operand = getToken(currentDisplacement).value;
-    if (operand != "+" && operand != "-") {
-        return false;
-    }
-    currentDisplacement++;
-
-    if (!isRegister(currentDisplacement) && !isNumberOrSymbol(currentDisplacement)) {
-        return false;
-    }
-    bool operand2IsRegister = isRegister(currentDisplacement);
-    currentDisplacement++;
-
-    if (!getToken(currentDisplacement).matchToken(Token::Type::Symbol, "]")) {
-        return false;
-    }
-
-    // Check for illegal cases:
-    if (operand1IsRegister && operand2IsRegister) {
-        return false; // both are registers
-    }
-    if (!operand1IsRegister && !operand2IsRegister) {
-        return false; // both are displacements
-    }
-    if (operand == "-" && operand2IsRegister) {
-        return false; // register is being subtracted
-    }
-
-    return true;
-}
-
-bool Parser::isOperand(int offset) const {
-    return isRegister(offset) || isNumberOrSymbol(offset) || isRegisterIndirect(offset) || isRegisterIndirectWithDisplacement(offset);
-}
-
-void Parser::consumeNumber() {
-    if (currentToken().value == "#") {
-        currentTokenIndex += 2;
-    }
-    else {
-        currentTokenIndex++;
-    }
-}
-
-void Parser::consumeSymbol() {
-    currentTokenIndex++;
-}
-
-void Parser::consumeRegister() {
-    currentTokenIndex++;
-}
-
-void Parser::consumeNumberOrSymbol() {
-    if (isNumber()) {
-        consumeNumber();
-    }
-    else {
-        consumeSymbol();
-    }
-}
-
-void Parser::consumeRegisterIndirect() {
-    currentTokenIndex += 3;
-}
-
-void Parser::consumeRegisterIndirectWithDisplacement() {
-    currentTokenIndex += 5;
-}
-
-void Parser::consumeOperand() {
-    if (isRegister()) {
-        consumeRegister();
-    }
-    else if (isNumberOrSymbol()) {
-        consumeNumberOrSymbol();
-    }
-    else if (isRegisterIndirect()) {
-        consumeRegisterIndirect();
-    }
-    else if (isRegisterIndirectWithDisplacement()) {
-        consumeRegisterIndirectWithDisplacement();
-    }
-}
-
-void Parser::getOperatorInfo(AddressingMode &addressingMode, std::string &numberOrSymbol, Command::Sign &sign, int &r) {
-    sign = Command::Sign::Plus;
-    numberOrSymbol = "";
-    r = REGISTER_INVALID;
-    if (isRegister()) {
-        addressingMode = AddressingMode::RegisterDirect;
-        r = getRegisterIndex(getToken(0).value);
-    }
-    else if (isNumberOrSymbol()) {
-        addressingMode = AddressingMode::MemoryDirect;
-        numberOrSymbol = getToken(0).value;
-    }
-    else if (isRegisterIndirect()) {
-        addressingMode = AddressingMode::RegisterIndirect;
-        r = getRegisterIndex(getToken(1).value);
-    }
-    else if (isRegisterIndirectWithDisplacement()) {
-        addressingMode = AddressingMode::RegisterIndirectWithDisplacement;
-        if (isRegister(1)) {
-            r = getRegisterIndex(getToken(1).value);
-            numberOrSymbol = getToken(3).value;
-            sign = getToken(2).value == "+" ? Command::Sign::Plus : Command::Sign::Minus;
-        }
-        else {
-            r = getRegisterIndex(getToken(3).value);
-            numberOrSymbol = getToken(1).value;
-        }
-    }
-}
-
-bool Parser::hasArity0(const std::string &instruction) const {
-    return jump0.count(instruction) > 0;
-}
-
-bool Parser::hasArity1(const std::string &instruction) const {
-    return jump1.count(instruction) > 0 || arithmetic1.count(instruction) > 0;
-}
-
-bool Parser::hasArity2(const std::string &instruction) const {
-    return jump2.count(instruction) > 0 || arithmetic2.count(instruction) > 0 || instruction == "load" || instruction == "store";
-}
-
-bool Parser::hasArity3(const std::string &instruction) const {
-    return arithmetic3.count(instruction) > 0;
-}
+#include "Parser.hpp"
+#include "Token.hpp"
+#include "AllocationTracker.hpp"
+#include "Layout.hpp"
+#include <iostream>
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+
+// Categorizing instructions by type and arity
+const std::array<bool (Parser::*)(const InstructionInfo &), 4> Parser::instructionParsers = {
+    &Parser::parseInstruction0,
+    &Parser::parseInstruction1,
+    &Parser::parseInstruction2,
+    &Parser::parseInstruction3
+};
+
+const std::unordered_map<std::string, size_t> Parser::specialRegisters = {
+    {"zero", 0},
+    {"ra", 1},
+    {"sp", 2},
+    {"gp", 3},
+    {"fp", 8},
+    {"s0", 8},
+    {"s1", 9},
+    {"a0", 10},
+    {"a1", 11},
+    {"a2", 12},
+    {"a3", 13},
+    {"a4", 14},
+    {"a5", 15},
+    {"t0", 5}, 
+    {"t1", 6}, 
+    {"t2", 7}, 
+    {"t3", 28},
+    {"t4", 29},
+    {"t5", 30},
+    {"t6", 31},
+    {"ivtp", 26},
+    {"imr", 27}
+};
+
+size_t Parser::getRegisterIndex(const std::string &name) {
+    std::string normalized = name;
+    std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](unsigned char c) {
+        return std::tolower(c);
+        });
+    auto it = specialRegisters.find(normalized);
+    if (it != specialRegisters.end()) {
+        return it->second;
+    }
+    if (normalized[0] == 'r' && normalized.size() > 1) {
+        try {
+            int regIndex = std::stoi(normalized.substr(1));
+            if (regIndex >= 0 && regIndex <= 31) {
+                return static_cast<size_t>(regIndex);
+            }
+        }
+        catch (const std::exception &) {
+            return REGISTER_INVALID;
+        }
+    }
+    return REGISTER_INVALID;
+}
+
+const std::unordered_set<std::string> Parser::keywords = { "def", "include", "start", "org", "dd", "dup", "macro", "rept", "endm"};
+
+// Token as it is named in a message, a line break would split the message
+static std::string_view describe(const Token &token) {
+    return token.value == "\n" ? std::string_view("end of line") : std::string_view(token.value);
+}
+
+Parser::Parser(const std::string &filename) : filename(filename), currentTokenIndex(0), currentLine(1) {
+    fileId = diagnostics.addFile(filename);
+    Tokenizer tokenizer(filename);
+    takeTokens(tokenizer);
+}
+
+// The filename only labels errors, the content is read from data
+Parser::Parser(const std::string &filename, const char *data, size_t size) : filename(filename), currentTokenIndex(0), currentLine(1) {
+    fileId = diagnostics.addFile(filename);
+    Tokenizer tokenizer(data, size);
+    takeTokens(tokenizer);
+}
+
+// Lines the tokenizer choked on are skipped by the parser, the rest is
+// parsed so that one run reports every broken line
+void Parser::takeTokens(Tokenizer &tokenizer) {
+    AllocationScope scope("tokens");
+    if (!tokenizer.tokenize()) {
+        diagnostics.merge(tokenizer.getDiagnostics(), fileId);
+        for (const Diagnostic &diagnostic : tokenizer.getDiagnostics().getDiagnostics()) {
+            skippedLines.insert(diagnostic.line);
+        }
+    }
+    tokens = tokenizer.getTokens();
+}
+
+bool Parser::parse() {
+    AllocationScope scope("commands");
+    while (currentTokenIndex < tokens.size()) {
+        parseCommand();
+    }
+    return diagnostics.empty();
+}
+
+const std::vector<Command> &Parser::getCommands() const {
+    return commands;
+}
+
+std::vector<Error> Parser::getErrors() const {
+    return diagnostics.toErrors();
+}
+
+const Diagnostics &Parser::getDiagnostics() const {
+    return diagnostics;
+}
+
+bool Parser::hasErrors() const {
+    return !diagnostics.empty();
+}
+
+bool Parser::parseCommand() {
+    if (currentToken().line != Error::NO_LINE) {
+        currentLine = currentToken().line;
+    }
+    size_t firstCommand = commands.size();
+    bool parsed = (skippedLines.empty() || !skippedLines.count(currentLine)) && parseCommandUnaligned();
+    for (size_t i = firstCommand; i < commands.size(); ++i) {
+        if (commands[i].getLine() == Error::NO_LINE) {   // expanded commands keep the lines of their body
+            commands[i].setLine(currentLine);
+        }
+    }
+    if (parsed) {
+        return true;
+    }
+    while (!currentToken().value.empty() && currentToken().value != "\n") {
+        nextToken();
+    }
+    nextToken(); // skip "\n"
+    return false;
+}
+
+bool Parser::parseCommandUnaligned() {
+    Token token = currentToken();
+    if (token.value == "\n") {
+        nextToken();
+        return true; // skip empty line
+    }
+    if (token.type != Token::Type::Name) {
+        addError(DiagnosticCode::CommandStart, { describe(token) });
+        return false;
+    }
+    if (keywords.count(token.value)) {
+        return parseDirective();
+    }
+    if (getToken(1).value == "def") {
+        return parseSymbolDefinition();
+    }
+    if (getToken(1).type == Token::Type::Symbol && getToken(1).value == ":") {
+        return parseLabel();
+    }
+    if (macros.count(token.value)) {
+        return parseMacroCall();
+    }
+    return parseInstruction();
+}
+
+bool Parser::parseInstruction() {
+    Token token = currentToken();
+
+    std::string name = token.value;
+    const InstructionInfo *instruction = Isa::find(name);
+    if (!instruction) {
+        addError(DiagnosticCode::UnknownInstruction, { name });
+        return false;
+    }
+    nextToken(); // skip the name
+    return (this->*instructionParsers[instruction->arity])(*instruction);
+}
+
+bool Parser::parseInstruction0(const InstructionInfo &instruction) {
+    commands.push_back(Command::createInstruction0(std::string(instruction.mnemonic)));
+    return true;
+}
+
+bool Parser::parseInstruction1(const InstructionInfo &instruction) {
+    std::string name(instruction.mnemonic);
+    if (!isOperand()) {
+        addError(DiagnosticCode::ExpectedOperand, { name });
+        return false;
+    }
+    AddressingMode addressingMode;
+    std::string numberOrSymbol;
+    Command::Sign sign;
+    int r;
+    getOperatorInfo(addressingMode, numberOrSymbol, sign, r);
+    if (!Isa::allows(instruction, 0, addressingMode)) {
+        addOperandError(instruction, 0, addressingMode);
+        return false;
+    }
+
+    Command command = Command::createInstruction(name, addressingMode, numberOrSymbol, sign, r);
+    commands.push_back(command);
+    consumeOperand();
+    return true;
+}
+
+bool Parser::parseInstruction2(const InstructionInfo &instruction) {
+    std::string name(instruction.mnemonic);
+    AddressingMode addressingMode;
+    std::string numberOrSymbol;
+    Command::Sign sign;
+    int r1, r2;
+
+    if (!isOperand()) {
+        addError(DiagnosticCode::ExpectedOperand, { name });
+        return false;
+    }
+    if (!isRegister()) {
+        addError(DiagnosticCode::FirstOperandRegister, { name });
+        return false;
+    }
+    r1 = getRegisterIndex(currentToken().value);
+    consumeOperand();
+    if (!currentToken().matchToken(Token::Type::Symbol, ",")) {
+        addError(DiagnosticCode::ExpectedComma, { name });
+        return false;
+    }
+    nextToken(); // skip comma
+    if (!isOperand()) {
+        addError(DiagnosticCode::ExpectedOperand, { name });
+        return false;
+    }
+    getOperatorInfo(addressingMode, numberOrSymbol, sign, r2);
+    if (!Isa::allows(instruction, 1, addressingMode)) {
+        addOperandError(instruction, 1, addressingMode);
+        return false;
+    }
+    commands.push_back(Command::createInstruction(name, addressingMode, numberOrSymbol, sign, r1, r2));
+    consumeOperand();
+    return true;
+}
+
+bool Parser::parseInstruction3(const InstructionInfo &instruction) {
+    std::string name(instruction.mnemonic);
+    int r[3];
+    for (int i = 0; i < 3; ++i) {
+        if (!isRegister()) {
+            addError(DiagnosticCode::ExpectedRegister, { name, describe(currentToken()) });
+            return false;
+        }
+        r[i] = getRegisterIndex(currentToken().value);
+        consumeRegister();
+
+        if (i < 2 && !currentToken().matchToken(Token::Type::Symbol, ",")) {
+            addError(DiagnosticCode::ExpectedCommaBetween, { name });
+            return false;
+        }
+        nextToken(); // skip comma
+    }
+    commands.push_back(Command::createInstruction3(name, r[0], r[1], r[2]));
+    return true;
+}
+
+bool Parser::parseDup() {
+    std::string value;
+    size_t repetition;
+    nextToken(); // skip (
+    if (!isNumberOrSymbol()) {
+        addError(DiagnosticCode::ExpectedNumberOrSymbol);
+        return false;
+    }
+    value = currentToken().value;
+    consumeNumberOrSymbol();
+    if (currentToken().value != "dup") {
+        addError(DiagnosticCode::ExpectedDup);
+        return false;
+    }
+    nextToken(); // skip dup
+    if (!isNumber()) {
+        addError(DiagnosticCode::ExpectedNumber);
+        return false;
+    }
+    uint64_t count;
+    if (!Token::parseNumber(currentToken().value, count) || count > UINT32_MAX) {
+        addError(DiagnosticCode::NumberOutOfRange, { currentToken().value });
+        return false;
+    }
+    repetition = static_cast<uint32_t>(count);
+    consumeNumber();
+    if (currentToken().value != ")") {
+        addError(DiagnosticCode::ExpectedParenthesis);
+        return false;
+    }
+    nextToken(); // )
+    commands.push_back(Command::createDirective("dup", value, repetition));
+    return true;
+}
+
+bool Parser::parseDD() {
+    if (currentToken().value == "(") {
+        return parseDup();
+    }
+    std::vector<std::string> operands;
+    if (!isNumberOrSymbol()) {
+        addError(DiagnosticCode::ExpectedNumberOrSymbol);
+        return false;
+    }
+    operands.push_back(currentToken().value);
+    consumeNumberOrSymbol();
+    while (true) {
+        if (currentToken().value != ",") {
+            break;
+        }
+        nextToken();  // skip commas
+        if (!isNumberOrSymbol()) {
+            addError(DiagnosticCode::ExpectedNumberOrSymbol);
+            return false;
+        }
+        operands.push_back(currentToken().value);
+        consumeNumberOrSymbol();
+    }
+    bool front = true;
+    for (const std::string &operand : operands) {
+        commands.push_back(Command::createDirective("dd", operand));
+    }
+    return parseNewline();
+}
+
+bool Parser::parseDirective() {
+    Token token = currentToken();
+    std::string directiveName = token.value;
+    nextToken();
+
+    if (directiveName == "include") {
+        if (!isSymbol()) {
+            addError(DiagnosticCode::ExpectedFilename);
+            return false;
+        }
+        commands.push_back(Command::createDirective(directiveName, currentToken().value));
+        nextToken(); // skip filename
+        return parseNewline();
+    }
+    else if (directiveName == "start" || directiveName == "org") {
+        if (!isNumberOrSymbol()) {
+            addError(DiagnosticCode::ExpectedDirectiveNumber, { directiveName });
+            return false;
+        }
+        commands.push_back(Command::createDirective(directiveName, currentToken().value));
+        consumeNumberOrSymbol();
+        return parseNewline();
+    }
+    else if (directiveName == "dd") {
+        return parseDD();
+    }
+    else if (directiveName == "macro") {
+        return parseMacro();
+    }
+    else if (directiveName == "rept") {
+        return parseRepeat();
+    }
+    else if (directiveName == "endm") {
+        addError(DiagnosticCode::UnexpectedEndm);
+        return false;
+    }
+
+    addError(DiagnosticCode::UnknownDirective, { directiveName });
+    return false;
+}
+
+
+bool Parser::parseSymbolDefinition() {
+    std::string symbol = currentToken().value;
+    nextToken();  // Skip symbol
+    nextToken();  // Skip 'def'
+    if (!isNumberOrSymbol()) {
+        addError(DiagnosticCode::ExpectedDefinitionValue);
+        return false;
+    }
+    std::string value = currentToken().value;
+    consumeNumberOrSymbol();
+    commands.push_back(Command::createSymbolDefinition(symbol, value));
+    return parseNewline();
+}
+
+bool Parser::parseNewline() {
+    if (currentToken().value.empty() || currentToken().value != "\n") {
+        addError(DiagnosticCode::OneCommandPerLine);
+        return false;
+    }
+    nextToken(); // skip "\n"
+    return true;
+}
+
+bool Parser::parseLabel() {
+    Token labelToken = currentToken();
+    nextToken();  // Skip label
+    nextToken();  // Skip ':'
+    commands.push_back(Command::createLabel(labelToken.value));
+    return true;
+}
+
+// macro <name> [parameter, ...] starts a definition that runs to its endm.
+// A name can't be shared with an instruction, a keyword or a register.
+bool Parser::parseMacro() {
+    if (!currentToken().matchToken(Token::Type::Name)) {
+        addError(DiagnosticCode::ExpectedMacroName);
+        return false;
+    }
+    Template macro;
+    macro.name = currentToken().value;
+    if (Isa::find(macro.name) || keywords.count(macro.name) || isRegister() || macros.count(macro.name)) {
+        addError(DiagnosticCode::InvalidMacroName, { macro.name });
+        return false;
+    }
+    nextToken(); // skip the name
+    while (!currentToken().value.empty() && currentToken().value != "\n") {
+        if (!macro.parameters.empty()) {
+            if (currentToken().value != ",") {
+                addError(DiagnosticCode::ExpectedParameter, { macro.name });
+                return false;
+            }
+            nextToken(); // skip comma
+        }
+        if (!isSymbol()) {
+            addError(DiagnosticCode::ExpectedParameter, { macro.name });
+            return false;
+        }
+        macro.parameters.push_back(currentToken().value);
+        nextToken();
+    }
+    if (!parseNewline() || !collectBody(macro)) {
+        return false;
+    }
+    std::string name = macro.name;
+    macros.emplace(std::move(name), std::move(macro));
+    return true;
+}
+
+// rept <count> parses its body once and copies the commands count times
+bool Parser::parseRepeat() {
+    if (!isNumber()) {
+        addError(DiagnosticCode::ExpectedDirectiveNumber, { "rept" });
+        return false;
+    }
+    // A count past 64 bits reads as the largest one, which the size check rejects
+    uint64_t count;
+    if (!Token::parseNumber(currentToken().value, count)) {
+        count = UINT64_MAX;
+    }
+    Token countToken = currentToken();
+    int countLine = currentLine;
+    consumeNumber();
+    Template block;
+    block.name = "rept";
+    if (!parseNewline() || !collectBody(block)) {
+        return false;
+    }
+    // The body is consumed whether or not it parses, so errors in it don't
+    // skip the line after the endm
+    std::vector<Command> expanded;
+    if (!expand(block, {}, expanded) || expanded.empty()) {
+        return true;
+    }
+    // No image holds more words than that, and every command but a label
+    // takes one, so a larger count is a mistake rather than a program
+    uint64_t room = Layout::MAX_IMAGE_WORDS - std::min<uint64_t>(commands.size(), Layout::MAX_IMAGE_WORDS);
+    if (count > room / expanded.size()) {
+        uint16_t column = static_cast<uint16_t>(std::min(countToken.column, static_cast<int>(UINT16_MAX)));
+        uint16_t endColumn = static_cast<uint16_t>(std::min(countToken.column + static_cast<int>(countToken.value.size()), static_cast<int>(UINT16_MAX)));
+        diagnostics.report(DiagnosticCode::RepeatCountTooLarge, fileId, countLine,
+            { countToken.value, std::to_string(Layout::MAX_IMAGE_WORDS) }, column, endColumn);
+        return true;
+    }
+    commands.reserve(commands.size() + expanded.size() * count);
+    for (uint64_t i = 0; i < count; ++i) {
+        instantiate(expanded);
+    }
+    return true;
+}
+
+// Arguments are separated by commas outside brackets, so any operand,
+// [t0 + 1] or #value, can be passed
+bool Parser::parseMacroCall() {
+    Template &macro = macros.at(currentToken().value);
+    nextToken(); // skip the name
+    std::vector<std::vector<Token>> arguments;
+    int depth = 0;
+    while (!currentToken().value.empty() && currentToken().value != "\n") {
+        if (arguments.empty()) {
+            arguments.emplace_back();
+        }
+        Token token = currentToken();
+        if (token.type == Token::Type::Symbol && token.value == "," && depth == 0) {
+            if (arguments.back().empty()) {
+                addError(DiagnosticCode::ExpectedOperand, { macro.name });
+                return false;
+            }
+            arguments.emplace_back();
+        }
+        else {
+            depth += token.value == "[" ? 1 : token.value == "]" ? -1 : 0;
+            arguments.back().push_back(token);
+        }
+        nextToken();
+    }
+    if (!arguments.empty() && arguments.back().empty()) {
+        addError(DiagnosticCode::ExpectedOperand, { macro.name });
+        return false;
+    }
+    if (arguments.size() != macro.parameters.size()) {
+        addError(DiagnosticCode::ArgumentCount,
+            { macro.name, std::to_string(macro.parameters.size()), std::to_string(arguments.size()) });
+        return false;
+    }
+    std::vector<Command> expanded;
+    if (!expand(macro, arguments, expanded)) {
+        return false;
+    }
+    instantiate(expanded);
+    return parseNewline();
+}
+
+// Takes the lines up to the endm that closes the block, counting the macro
+// and rept blocks nested in it
+bool Parser::collectBody(Template &block) {
+    int depth = 0;
+    while (static_cast<size_t>(currentTokenIndex) < tokens.size()) {
+        const std::string &first = currentToken().value;
+        if (first == "macro" || first == "rept") {
+            ++depth;
+        }
+        else if (first == "endm" && depth-- == 0) {
+            nextToken(); // skip endm
+            return parseNewline();
+        }
+        while (static_cast<size_t>(currentTokenIndex) < tokens.size() && currentToken().value != "\n") {
+            block.body.push_back(currentToken());
+            nextToken();
+        }
+        if (static_cast<size_t>(currentTokenIndex) < tokens.size()) {
+            block.body.push_back(currentToken());
+            nextToken(); // skip "\n"
+        }
+    }
+    addError(DiagnosticCode::MissingEndm, { block.name });
+    return false;
+}
+
+// Parameters in the body are replaced by the tokens of their arguments and
+// the body is parsed in place of the file, errors point into the body
+bool Parser::expand(Template &block, const std::vector<std::vector<Token>> &arguments, std::vector<Command> &expanded) {
+    std::string key;
+    for (const std::vector<Token> &argument : arguments) {
+        for (const Token &token : argument) {
+            key += token.value;
+            key += ' ';
+        }
+        key += ',';
+    }
+    auto cached = block.expansions.find(key);
+    if (cached != block.expansions.end()) {
+        expanded = cached->second;
+        return true;
+    }
+    if (expansionDepth == MAX_EXPANSION_DEPTH) {
+        addError(DiagnosticCode::ExpansionTooDeep, { block.name });
+        return false;
+    }
+
+    std::vector<Token> body;
+    body.reserve(block.body.size());
+    for (const Token &token : block.body) {
+        auto parameter = token.type == Token::Type::Name ?
+            std::find(block.parameters.begin(), block.parameters.end(), token.value) : block.parameters.end();
+        if (parameter == block.parameters.end()) {
+            body.push_back(token);
+            continue;
+        }
+        for (Token argument : arguments[parameter - block.parameters.begin()]) {
+            argument.line = token.line;
+            argument.column = token.column;
+            body.push_back(argument);
+        }
+    }
+
+    std::vector<Token> file = std::move(tokens);
+    int fileTokenIndex = currentTokenIndex;
+    int fileLine = currentLine;
+    size_t firstCommand = commands.size();
+    uint64_t reported = diagnostics.size() + diagnostics.getDuplicateCount() + diagnostics.getSuppressedCount();
+    tokens = std::move(body);
+    currentTokenIndex = 0;
+    ++expansionDepth;
+    while (static_cast<size_t>(currentTokenIndex) < tokens.size()) {
+        parseCommand();
+    }
+    --expansionDepth;
+    tokens = std::move(file);
+    currentTokenIndex = fileTokenIndex;
+    currentLine = fileLine;
+
+    expanded.assign(commands.begin() + firstCommand, commands.end());
+    commands.erase(commands.begin() + firstCommand, commands.end());
+    if (diagnostics.size() + diagnostics.getDuplicateCount() + diagnostics.getSuppressedCount() != reported) {
+        return false;
+    }
+    if (block.expansions.size() < MAX_CACHED_EXPANSIONS) {
+        block.expansions.emplace(std::move(key), expanded);
+    }
+    return true;
+}
+
+// Labels defined in a body are local to each use of it: they are renamed
+// to <label>@<use>, along with the operands that refer to them, so a body
+// with a loop can be used more than once. Source names can't contain '@'.
+void Parser::instantiate(const std::vector<Command> &expanded) {
+    size_t firstCommand = commands.size();
+    commands.insert(commands.end(), expanded.begin(), expanded.end());
+    std::unordered_map<std::string, std::string> renamed;
+    std::string suffix;
+    for (size_t i = firstCommand; i < commands.size(); ++i) {
+        Command &command = commands[i];
+        if (command.getType() != Command::Type::Label) {
+            continue;
+        }
+        if (suffix.empty()) {
+            suffix = "@" + std::to_string(++instantiations);
+        }
+        std::string name = command.getName() + suffix;
+        renamed.emplace(command.getName(), name);
+        command.setName(name);
+    }
+    if (renamed.empty()) {
+        return;
+    }
+    for (size_t i = firstCommand; i < commands.size(); ++i) {
+        Command &command = commands[i];
+        auto label = command.getType() != Command::Type::Label ? renamed.find(command.getNumberOrSymbol()) : renamed.end();
+        if (label != renamed.end()) {
+            command.setNumberOrSymbol(label->second);
+        }
+    }
+}
+
+// Points at the current token
+void Parser::addError(DiagnosticCode code, std::initializer_list<std::string_view> arguments) {
+    Token token = currentToken();
+    uint16_t column = static_cast<uint16_t>(std::min(token.column, static_cast<int>(UINT16_MAX)));
+    uint16_t endColumn = static_cast<uint16_t>(std::min(token.column + static_cast<int>(token.value.size()), static_cast<int>(UINT16_MAX)));
+    diagnostics.report(code, fileId, currentLine, arguments, column, endColumn);
+}
+
+void Parser::addOperandError(const InstructionInfo &instruction, size_t operand, AddressingMode addressingMode) {
+    std::string name(instruction.mnemonic);
+    if (addressingMode == AddressingMode::Immediate) {
+        addError(DiagnosticCode::ConstantOperand, { name });
+    }
+    else if (instruction.operands[operand] == MODES_REGISTER) {
+        addError(DiagnosticCode::ExpectedRegister, { name, describe(currentToken()) });
+    }
+    else {
+        addError(DiagnosticCode::InvalidOperand, { name, describe(currentToken()) });
+    }
+}
+
+Token Parser::getToken(int offset) const {
+    int index = currentTokenIndex + offset;
+    if (index < tokens.size()) {
+        return tokens[index];
+    }
+    return { Token::Type::Unknown, "" };
+}
+
+Token Parser::currentToken() const {
+    return getToken(0);
+}
+
+Token Parser::nextToken() {
+    currentTokenIndex++;
+    return currentToken();
+}
+
+bool Parser::isRegister(int offset) const {
+    return getRegisterIndex(getToken(offset).value) != REGISTER_INVALID;
+}
+
+bool Parser::isSymbol(int offset) const {
+    return 
+        getToken(offset).matchToken(Token::Type::Name) && 
+        keywords.find(getToken(offset).value) == keywords.end() && 
+        !isRegister(offset);
+}
+
+bool Parser::isNumber(int offset) const {
+    return getToken(offset).matchToken(Token::Type::Number);
+}
+
+bool Parser::isNumberOrSymbol(int offset) const {
+    return isSymbol(offset) || isNumber(offset);
+}
+
+bool Parser::isImmediate(int offset) const {
+    return
+        getToken(offset).matchToken(Token::Type::Symbol, "#") &&
+        isNumberOrSymbol(offset + 1);
+}
+
+bool Parser::isRegisterIndirect(int offset) const {
+    return
+        getToken(offset).matchToken(Token::Type::Symbol, "[") &&
+        isRegister(offset + 1) &&
+        getToken(offset + 2).matchToken(Token::Type::Symbol, "]");
+}
+
+bool Parser::isRegisterIndirectWithDisplacement(int offset) const {
+    int currentDisplacement = offset;
+    if (!getToken(currentDisplacement).matchToken(Token::Type::Symbol, "[")) {
+        return false;
+    }
+
+    currentDisplacement++;
+
+    if (!isRegister(currentDisplacement) && !isNumberOrSymbol(currentDisplacement)) {
+        return false;
+    }
+    bool operand1IsRegister = isRegister(currentDisplacement);
+    currentDisplacement++;
+
+    std::string operand = getToken(currentDisplacement).value;
+    if (operand != "+" && operand != "-") {
+        return false;
+    }
+    currentDisplacement++;
+
+    if (!isRegister(currentDisplacement) && !isNumberOrSymbol(currentDisplacement)) {
+        return false;
+    }
+    bool operand2IsRegister = isRegister(currentDisplacement);
+    currentDisplacement++;
+
+    if (!getToken(currentDisplacement).matchToken(Token::Type::Symbol, "]")) {
+        return false;
+    }
+
+    // Check for illegal cases:
+    if (operand1IsRegister && operand2IsRegister) {
+        return false; // both are registers
+    }
+    if (!operand1IsRegister && !operand2IsRegister) {
+        return false; // both are displacements
+    }
+    if (operand == "-" && operand2IsRegister) {
+        return false; // register is being subtracted
+    }
+
+    return true;
+}
+
+bool Parser::isOperand(int offset) const {
+    return isRegister(offset) || isNumberOrSymbol(offset) || isImmediate(offset) || isRegisterIndirect(offset) || isRegisterIndirectWithDisplacement(offset);
+}
+
+void Parser::consumeNumber() {
+    if (currentToken().value == "#") {
+        currentTokenIndex += 2;
+    }
+    else {
+        currentTokenIndex++;
+    }
+}
+
+void Parser::consumeSymbol() {
+    currentTokenIndex++;
+}
+
+void Parser::consumeRegister() {
+    currentTokenIndex++;
+}
+
+void Parser::consumeNumberOrSymbol() {
+    if (isNumber()) {
+        consumeNumber();
+    }
+    else {
+        consumeSymbol();
+    }
+}
+
+void Parser::consumeImmediate() {
+    currentTokenIndex += 2;
+}
+
+void Parser::consumeRegisterIndirect() {
+    currentTokenIndex += 3;
+}
+
+void Parser::consumeRegisterIndirectWithDisplacement() {
+    currentTokenIndex += 5;
+}
+
+void Parser::consumeOperand() {
+    if (isRegister()) {
+        consumeRegister();
+    }
+    else if (isNumberOrSymbol()) {
+        consumeNumberOrSymbol();
+    }
+    else if (isImmediate()) {
+        consumeImmediate();
+    }
+    else if (isRegisterIndirect()) {
+        consumeRegisterIndirect();
+    }
+    else if (isRegisterIndirectWithDisplacement()) {
+        consumeRegisterIndirectWithDisplacement();
+    }
+}
+
+void Parser::getOperatorInfo(AddressingMode &addressingMode, std::string &numberOrSymbol, Command::Sign &sign, int &r) {
+    sign = Command::Sign::Plus;
+    numberOrSymbol = "";
+    r = REGISTER_INVALID;
+    if (isRegister()) {
+        addressingMode = AddressingMode::RegisterDirect;
+        r = getRegisterIndex(getToken(0).value);
+    }
+    else if (isNumberOrSymbol()) {
+        addressingMode = AddressingMode::MemoryDirect;
+        numberOrSymbol = getToken(0).value;
+    }
+    else if (isImmediate()) {
+        addressingMode = AddressingMode::Immediate;
+        numberOrSymbol = getToken(1).value;
+    }
+    else if (isRegisterIndirect()) {
+        addressingMode = AddressingMode::RegisterIndirect;
+        r = getRegisterIndex(getToken(1).value);
+    }
+    else if (isRegisterIndirectWithDisplacement()) {
+        addressingMode = AddressingMode::RegisterIndirectWithDisplacement;
+        if (isRegister(1)) {
+            r = getRegisterIndex(getToken(1).value);
+            numberOrSymbol = getToken(3).value;
+            sign = getToken(2).value == "+" ? Command::Sign::Plus : Command::Sign::Minus;
+        }
+        else {
+            r = getRegisterIndex(getToken(3).value);
+            numberOrSymbol = getToken(1).value;
+        }
+    }
+}
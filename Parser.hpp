@@ -1,74 +1,95 @@
-#pragma once
-
-#include "Command.hpp"
-#include <unordered_map>
-class Parser {
-public:
-    Parser(const std::string &filename);
-    bool parse();
-    const std::vector<Command> &getCommands() const;
-    const std::vector<Error> &getErrors() const;
-    bool hasErrors() const;
-private:
-    std::string filename;
-    std::vector<Command> commands;
-    std::vector<Error> errors;
-    std::vector<Token> tokens;
-    int currentTokenIndex;
-    int currentLine;
-
-    static const std::unordered_set<std::string> jump0;
-    static const std::unordered_set<std::string> jump1;
-    static const std::unordered_set<std::string> jump2;
-    static const std::unordered_set<std::string> arithmetic1;
-    static const std::unordered_set<std::string> arithmetic2;
-    static const std::unordered_set<std::string> arithmetic3;
-    static const std::unordered_set<std::string> keywords;
-    static const std::unordered_map<std::string, size_t> specialRegisters;
-    static size_t getRegisterIndex(const std::string &name);
-
-    static constexpr size_t REGISTER_INVALID = ~0;
-
-    bool parseCommand();
-    bool parseCommandUnaligned();
-    bool parseInstruction();
-    bool parseInstruction0(const std::string &name);
-    bool parseInstruction1(const std::string &name);
-    bool parseInstruction2(const std::string &name);
-    bool parseInstruction3(const std::string &name);
-    bool parseDirective();
-    bool parseDup();
-    bool parseDD();
-    bool parseSymbolDefinition();
-    bool parseLabel();
-    bool parseNewline();
-
-    void addError(const std::string &message);
-
-    bool isRegister(int offset = 0) const;
-    bool isSymbol(int offset = 0) const;
-    bool isNumber(int offset = 0) const;
-    bool isNumberOrSymbol(int offset = 0) const;
-    bool isRegisterIndirect(int offset = 0) const;
-    bool isRegisterIndirectWithDisplacement(int offset = 0) const;
-    bool isOperand(int offset = 0) const;
-
-    void consumeNumber();
-    void consumeSymbol();
-    void consumeRegister();
-    void consumeNumberOrSymbol();
-    void consumeRegisterIndirect();
-    void consumeRegisterIndirectWithDisplacement(); // todo: refactor number
-    void consumeOperand();
-
-    void getOperatorInfo(AddressingMode &addressingMode, std::string &numberOrSymbol, Command::Sign &sign, int &r); // todo: implement
-
-    Token getToken(int offset) const;
-    Token currentToken() const;
-    Token nextToken();
-
-    bool hasArity0(const std::string &instruction) const;
-    bool hasArity1(const std::string &instruction) const;
-    bool hasArity2(const std::string &instruction) const;
-    bool hasArity3(const std::string &instruction) const;
-};
+#pragma once
+
+#include "Isa.hpp"
+#include <unordered_map>
+class Parser {
+public:
+    Parser(const std::string &filename);
+    Parser(const std::string &filename, const char *data, size_t size);
+    bool parse();
+    const std::vector<Command> &getCommands() const;
+    std::vector<Error> getErrors() const;
+    const Diagnostics &getDiagnostics() const;
+    bool hasErrors() const;
+
+    static size_t getRegisterIndex(const std::string &name);
+
+    static constexpr size_t REGISTER_INVALID = ~0;
+    static constexpr int MAX_EXPANSION_DEPTH = 64;
+    static constexpr size_t MAX_CACHED_EXPANSIONS = 1024;   // per macro
+private:
+    // Body of a macro or rept, lexed once when it is defined. Each distinct
+    // argument list is parsed once, later expansions copy its commands and
+    // give the labels in them new names.
+    struct Template {
+        std::string name;
+        std::vector<std::string> parameters;
+        std::vector<Token> body;        // whole lines, without the endm
+        std::unordered_map<std::string, std::vector<Command>> expansions;
+    };
+
+    std::string filename;
+    std::vector<Command> commands;
+    Diagnostics diagnostics;
+    uint32_t fileId;
+    std::unordered_set<int> skippedLines;   // lines with lexical errors
+    std::vector<Token> tokens;
+    int currentTokenIndex;
+    int currentLine;
+    std::unordered_map<std::string, Template> macros;
+    int expansionDepth = 0;
+    size_t instantiations = 0;              // uses of macro and rept bodies, numbers their labels
+
+    static const std::array<bool (Parser::*)(const InstructionInfo &), 4> instructionParsers; // by arity
+    static const std::unordered_set<std::string> keywords;
+    static const std::unordered_map<std::string, size_t> specialRegisters;
+
+    void takeTokens(Tokenizer &tokenizer);
+    bool parseCommand();
+    bool parseCommandUnaligned();
+    bool parseInstruction();
+    bool parseInstruction0(const InstructionInfo &instruction);
+    bool parseInstruction1(const InstructionInfo &instruction);
+    bool parseInstruction2(const InstructionInfo &instruction);
+    bool parseInstruction3(const InstructionInfo &instruction);
+    bool parseDirective();
+    bool parseDup();
+    bool parseDD();
+    bool parseSymbolDefinition();
+    bool parseLabel();
+    bool parseMacro();
+    bool parseRepeat();
+    bool parseMacroCall();
+    bool collectBody(Template &block);
+    bool expand(Template &block, const std::vector<std::vector<Token>> &arguments, std::vector<Command> &expanded);
+    void instantiate(const std::vector<Command> &expanded);
+    bool parseNewline();
+
+    void addError(DiagnosticCode code, std::initializer_list<std::string_view> arguments = {});
+    void addOperandError(const InstructionInfo &instruction, size_t operand, AddressingMode addressingMode);
+
+    bool isRegister(int offset = 0) const;
+    bool isSymbol(int offset = 0) const;
+    bool isNumber(int offset = 0) const;
+    bool isNumberOrSymbol(int offset = 0) const;
+    bool isImmediate(int offset = 0) const;
+    bool isRegisterIndirect(int offset = 0) const;
+    bool isRegisterIndirectWithDisplacement(int offset = 0) const;
+    bool isOperand(int offset = 0) const;
+
+    void consumeNumber();
+    void consumeSymbol();
+    void consumeRegister();
+    void consumeNumberOrSymbol();
+    void consumeImmediate();
+    void consumeRegisterIndirect();
+    void consumeRegisterIndirectWithDisplacement(); // todo: refactor number
+    void consumeOperand();
+
+    void getOperatorInfo(AddressingMode &addressingMode, std::string &numberOrSymbol, Command::Sign &sign, int &r); // todo: implement
+
+    Token getToken(int offset) const;
+    Token currentToken() const;
+    Token nextToken();
+
+};
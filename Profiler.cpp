@@ -0,0 +1,134 @@
+#include "Profiler.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+Profiler::Profiler(const Program &program, uint32_t samplePeriod)
+    : program(program), samplePeriod(std::max<uint32_t>(samplePeriod, 1)) {
+    reset();
+}
+
+void Profiler::reset() {
+    countdown = samplePeriod;
+    instructionCounts.assign(program.getCode().size(), 0);
+    cycleCounts.assign(program.getCode().size(), 0);
+    takenCounts.assign(program.getCode().size(), 0);
+    stackSamples.clear();
+    callStack.clear();
+    if (program.getEntry() != Program::NO_OP) {
+        callStack.push_back(program.getCode()[program.getEntry()].address);
+    }
+}
+
+uint64_t Profiler::getInstructionCount(uint32_t op) const {
+    return instructionCounts[op];
+}
+
+uint64_t Profiler::getCycleCount(uint32_t op) const {
+    return cycleCounts[op];
+}
+
+uint64_t Profiler::getTakenBranchCount() const {
+    uint64_t taken = 0;
+    for (uint64_t count : takenCounts) {
+        taken += count;
+    }
+    return taken;
+}
+
+// Every jmp and conditional branch that ran, by the source line it came from
+BranchProfile Profiler::getBranchProfile() const {
+    BranchProfile profile;
+    const std::vector<MicroOp> &code = program.getCode();
+    for (size_t i = 0; i < code.size(); ++i) {
+        Opcode opcode = code[i].opcode;
+        if (!instructionCounts[i] || (opcode != Opcode::Jmp && (opcode < Opcode::Jz || opcode > Opcode::Jgez))) {
+            continue;
+        }
+        const Command &command = program.getCommands()[code[i].command];
+        profile.add(program.getLineTable().getFilename(command.getFileIndex()), command.getLine(),
+            takenCounts[i], instructionCounts[i] - takenCounts[i]);
+    }
+    return profile;
+}
+
+// Leaf frame is the closest label, so loops inside a routine show up under it
+void Profiler::sample(uint32_t op) {
+    std::vector<uint32_t> stack = callStack;
+    uint32_t offset;
+    uint32_t address = program.getCode()[op].address;
+    program.getNearestLabel(address, offset);
+    uint32_t leaf = address - offset;
+    if (leaf != stack.back()) {
+        stack.push_back(leaf);
+    }
+    stackSamples[stack]++;
+}
+
+std::string Profiler::frameName(uint32_t address) const {
+    uint32_t offset;
+    std::string label = program.getNearestLabel(address, offset);
+    if (label.empty() || offset) {
+        std::ostringstream oss;
+        oss << "0x" << std::hex << address;
+        return oss.str();
+    }
+    return label;
+}
+
+// Instructions and cycles aggregated per source line, hottest first
+std::string Profiler::flatProfile(size_t maxRows) const {
+    struct Row {
+        uint32_t address;
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+    };
+    const LineTable &lineTable = program.getLineTable();
+    std::map<std::pair<uint32_t, int>, Row> lines;
+    uint64_t totalCycles = 0, totalInstructions = 0;
+
+    const std::vector<MicroOp> &code = program.getCode();
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (!instructionCounts[i]) {
+            continue;
+        }
+        LineTable::Location location = { 0, Error::NO_LINE };
+        lineTable.find(code[i].address, location);
+        auto inserted = lines.emplace(std::make_pair(location.fileIndex, location.line), Row{ code[i].address });
+        Row &row = inserted.first->second;
+        row.instructions += instructionCounts[i];
+        row.cycles += cycleCounts[i];
+        totalInstructions += instructionCounts[i];
+        totalCycles += cycleCounts[i];
+    }
+
+    std::vector<Row> rows;
+    for (const auto &line : lines) {
+        rows.push_back(line.second);
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+        return a.cycles > b.cycles;
+        });
+
+    std::ostringstream oss;
+    oss << "Instructions: " << totalInstructions << ", Cycles: " << totalCycles << "\n";
+    oss << "  Cycles      %       Instructions  Location\n";
+    for (size_t i = 0; i < rows.size() && i < maxRows; ++i) {
+        double percent = totalCycles ? 100.0 * rows[i].cycles / totalCycles : 0.0;
+        oss << "  " << std::left << std::setw(12) << rows[i].cycles
+            << std::setw(8) << std::fixed << std::setprecision(2) << percent
+            << std::setw(14) << rows[i].instructions
+            << program.describeAddress(rows[i].address) << "\n";
+    }
+    return oss.str();
+}
+
+// One "frame;frame;frame count" line per distinct stack, as read by flamegraph.pl
+void Profiler::writeFoldedStacks(std::ostream &out) const {
+    for (const auto &stack : stackSamples) {
+        for (size_t i = 0; i < stack.first.size(); ++i) {
+            out << (i ? ";" : "") << frameName(stack.first[i]);
+        }
+        out << " " << stack.second << "\n";
+    }
+}
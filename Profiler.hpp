@@ -0,0 +1,59 @@
+#pragma once
+
+#include "BranchProfile.hpp"
+#include "Program.hpp"
+#include <map>
+#include <ostream>
+
+// Per-instruction execution and taken counts plus periodic call stack samples.
+// The emulator calls the inline hooks from its dispatch loop; everything
+// else only runs when a report is requested.
+class Profiler {
+public:
+    static constexpr uint32_t DEFAULT_SAMPLE_PERIOD = 997; // prime, so samples don't alias with loop lengths
+
+    Profiler(const Program &program, uint32_t samplePeriod = DEFAULT_SAMPLE_PERIOD);
+    void reset();
+    std::string flatProfile(size_t maxRows = 20) const;
+    void writeFoldedStacks(std::ostream &out) const;
+    uint64_t getInstructionCount(uint32_t op) const;
+    uint64_t getCycleCount(uint32_t op) const;
+    uint64_t getTakenBranchCount() const;
+    BranchProfile getBranchProfile() const;
+
+    void onInstruction(uint32_t op, uint32_t cycles) {
+        instructionCounts[op]++;
+        cycleCounts[op] += cycles;
+        if (--countdown == 0) {
+            countdown = samplePeriod;
+            sample(op);
+        }
+    }
+
+    // A jmp, or a conditional branch that jumped
+    void onTaken(uint32_t op) {
+        takenCounts[op]++;
+    }
+
+    void onCall(uint32_t target) {
+        callStack.push_back(program.getCode()[target].address);
+    }
+
+    void onReturn() {
+        if (callStack.size() > 1) {
+            callStack.pop_back();
+        }
+    }
+private:
+    const Program &program;
+    uint32_t samplePeriod;
+    uint32_t countdown;
+    std::vector<uint64_t> instructionCounts;
+    std::vector<uint64_t> cycleCounts;
+    std::vector<uint64_t> takenCounts;
+    std::vector<uint32_t> callStack;                    // entry addresses of active routines
+    std::map<std::vector<uint32_t>, uint64_t> stackSamples;
+
+    void sample(uint32_t op);
+    std::string frameName(uint32_t address) const;
+};
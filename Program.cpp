@@ -0,0 +1,340 @@
+#include "Program.hpp"
+#include "Linker.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+// Operands that aren't registers carry REGISTER_INVALID
+static uint8_t registerIndex(int r) {
+    return r >= 0 && r < 32 ? static_cast<uint8_t>(r) : 0;
+}
+
+Program::Program(const std::vector<Command> &commands, const std::unordered_map<std::string, uint32_t> &symbolTable,
+    const std::vector<std::string> &sourceFiles, const LatencyTable &latencies)
+    : commands(commands), symbolTable(symbolTable), latencies(latencies) {
+    lineTable.setFiles(sourceFiles);
+}
+
+bool Program::load() {
+    code.clear();
+    image.clear();
+    addressOps.clear();
+    labels.clear();
+    errors.clear();
+    entry = NO_OP;
+
+    // Segments may be placed out of source order. Runs of commands without
+    // a gap between them, in address order, become the segments of the
+    // image; the line table is filled in the same order.
+    std::vector<std::pair<uint32_t, size_t>> placed;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const Command &command = commands[i];
+        uint32_t size = command.getMemorySizeWords();
+        if (size == 0) {
+            continue;
+        }
+        if (static_cast<uint64_t>(command.getAddress()) + size > (1ull << 32)) {
+            addError(command, "Command extends beyond the address space");
+            continue;
+        }
+        placed.emplace_back(command.getAddress(), i);
+    }
+    std::stable_sort(placed.begin(), placed.end(), [](const auto &a, const auto &b) {
+        return a.first < b.first;
+    });
+    for (const auto &command : placed) {
+        uint64_t end = static_cast<uint64_t>(command.first) + commands[command.second].getMemorySizeWords();
+        if (image.empty() || command.first > image.back().getEnd()) {
+            image.push_back({ command.first, {} });
+        }
+        ImageSegment &segment = image.back();
+        if (end > segment.getEnd()) {
+            segment.words.resize(static_cast<size_t>(end - segment.base), 0);
+        }
+    }
+
+    uint32_t startAddress = NO_OP;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const Command &command = commands[i];
+        uint32_t memoryIndex = command.getAddress();
+        uint32_t size = command.getMemorySizeWords();
+        size_t segment = size > 0 ? findSegment(memoryIndex) : NO_SEGMENT;
+        uint32_t *words = segment != NO_SEGMENT ? &image[segment].words[memoryIndex - image[segment].base] : nullptr;
+
+        if (command.getType() == Command::Type::Instruction) {
+            MicroOp op;
+            op.command = static_cast<uint32_t>(i);
+            if (words && decodeInstruction(command, memoryIndex, op)) {
+                uint32_t operand = command.getSign() == Command::Sign::Minus ? 0u - op.value : op.value;
+                Isa::encode(command, operand, words);
+                code.push_back(op);
+            }
+        }
+        else if (command.getType() == Command::Type::Label) {
+            labels.emplace_back(memoryIndex, command.getName());
+        }
+        else if (command.getType() == Command::Type::Directive) {
+            uint32_t value;
+            if (command.getName() == "dd" || command.getName() == "dup") {
+                if (words && resolve(command, value)) {
+                    std::fill(words, words + size, value);
+                }
+            }
+            else if (command.getName() == "start" && resolve(command, value)) {
+                startAddress = value;
+            }
+        }
+    }
+
+    // Gaps between segments belong to no line
+    for (size_t i = 0; i < placed.size(); ++i) {
+        const Command &command = commands[placed[i].second];
+        lineTable.addEntry(placed[i].first, command.getFileIndex(), command.getLine());
+        uint64_t end = static_cast<uint64_t>(placed[i].first) + command.getMemorySizeWords();
+        if (i + 1 < placed.size() && placed[i + 1].first > end) {
+            lineTable.addEntry(static_cast<uint32_t>(end), command.getFileIndex(), Error::NO_LINE);
+        }
+    }
+
+    addressOps.resize(image.size());
+    for (size_t i = 0; i < image.size(); ++i) {
+        addressOps[i].assign(image[i].words.size(), NO_OP);
+    }
+    for (size_t i = 0; i < code.size(); ++i) {
+        size_t segment = findSegment(code[i].address);
+        addressOps[segment][code[i].address - image[segment].base] = static_cast<uint32_t>(i);
+    }
+    for (MicroOp &op : code) {
+        uint64_t next = static_cast<uint64_t>(op.address) + op.size;
+        op.next = next <= UINT32_MAX ? findOp(static_cast<uint32_t>(next)) : NO_OP;
+        bool direct =
+            op.addressingMode == AddressingMode::MemoryDirect &&
+            op.opcode >= Opcode::Jmp && op.opcode != Opcode::Ret && op.opcode != Opcode::Iret;
+        if (direct) {
+            op.target = findOp(op.value);
+            if (op.target == NO_OP) {
+                addError(commands[op.command], "Jump target isn't an instruction");
+            }
+        }
+    }
+
+    entry = findOp(startAddress);
+    if (entry == NO_OP) {
+        errors.emplace_back("Start address isn't an instruction");
+    }
+    std::stable_sort(labels.begin(), labels.end(), [](const auto &a, const auto &b) {
+        return a.first < b.first;
+        });
+    return errors.empty();
+}
+
+const std::vector<MicroOp> &Program::getCode() const {
+    return code;
+}
+
+const std::vector<ImageSegment> &Program::getImage() const {
+    return image;
+}
+
+uint64_t Program::getImageWordCount() const {
+    uint64_t words = 0;
+    for (const ImageSegment &segment : image) {
+        words += segment.words.size();
+    }
+    return words;
+}
+
+const std::vector<Command> &Program::getCommands() const {
+    return commands;
+}
+
+const LineTable &Program::getLineTable() const {
+    return lineTable;
+}
+
+uint32_t Program::getEntry() const {
+    return entry;
+}
+
+// Returns and indirect jumps look up their target here, the segment at the
+// lowest address, where code usually starts, is tried before searching
+uint32_t Program::findOp(uint32_t address) const {
+    if (!image.empty() && address - image[0].base < image[0].words.size()) {
+        return addressOps[0][address - image[0].base];
+    }
+    size_t segment = findSegment(address);
+    return segment != NO_SEGMENT ? addressOps[segment][address - image[segment].base] : NO_OP;
+}
+
+bool Program::findSymbol(const std::string &name, uint32_t &value) const {
+    auto it = symbolTable.find(name);
+    if (it == symbolTable.end()) {
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
+std::string Program::getNearestLabel(uint32_t address, uint32_t &offset) const {
+    auto it = std::upper_bound(labels.begin(), labels.end(), address, [](uint32_t address, const auto &label) {
+        return address < label.first;
+        });
+    if (it == labels.begin()) {
+        offset = address;
+        return "";
+    }
+    --it;
+    offset = address - it->first;
+    return it->second;
+}
+
+// "label+offset (file:line)"
+std::string Program::describeAddress(uint32_t address) const {
+    std::ostringstream oss;
+    uint32_t offset;
+    std::string label = getNearestLabel(address, offset);
+    if (label.empty()) {
+        oss << "0x" << std::hex << std::setw(8) << std::setfill('0') << address << std::dec;
+    }
+    else {
+        oss << label;
+        if (offset) {
+            oss << "+" << offset;
+        }
+    }
+    oss << " (" << lineTable.describe(address) << ")";
+    return oss.str();
+}
+
+// Little-endian words, independent of the host byte order. An image of one
+// segment at address 0 is written as its raw words; any other starts with
+// IMAGE_MAGIC and the segment count, and every segment follows as its base,
+// its size and its words.
+bool Program::writeImage(const std::string &filename) {
+    bool raw = image.empty() || (image.size() == 1 && image[0].base == 0);
+    std::vector<char> bytes;
+    bytes.reserve((getImageWordCount() + (raw ? 0 : 2 + 2 * image.size())) * sizeof(uint32_t));
+    auto put = [&bytes](uint32_t word) {
+        for (size_t b = 0; b < sizeof(uint32_t); ++b) {
+            bytes.push_back(static_cast<char>(word >> (8 * b)));
+        }
+    };
+    if (!raw) {
+        put(IMAGE_MAGIC);
+        put(static_cast<uint32_t>(image.size()));
+    }
+    for (const ImageSegment &segment : image) {
+        if (!raw) {
+            put(segment.base);
+            put(static_cast<uint32_t>(segment.words.size()));
+        }
+        for (uint32_t word : segment.words) {
+            put(word);
+        }
+    }
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.write(bytes.data(), bytes.size())) {
+        errors.emplace_back("Couldn't write image", Error::NO_LINE, filename);
+        return false;
+    }
+    return true;
+}
+
+// One "<address> <label>" line per label, addresses in hex
+bool Program::writeSymbols(const std::string &filename) {
+    std::ofstream file(filename);
+    for (const auto &label : labels) {
+        file << "0x" << std::hex << std::setw(8) << std::setfill('0') << label.first << " " << label.second << "\n";
+    }
+    if (!file) {
+        errors.emplace_back("Couldn't write symbols", Error::NO_LINE, filename);
+        return false;
+    }
+    return true;
+}
+
+const std::vector<Error> &Program::getErrors() const {
+    return errors;
+}
+
+bool Program::hasErrors() const {
+    return !errors.empty();
+}
+
+// The segment holding the address, by binary search over their bases
+size_t Program::findSegment(uint32_t address) const {
+    auto it = std::upper_bound(image.begin(), image.end(), address, [](uint32_t address, const ImageSegment &segment) {
+        return address < segment.base;
+        });
+    if (it == image.begin() || address - (it - 1)->base >= (it - 1)->words.size()) {
+        return NO_SEGMENT;
+    }
+    return static_cast<size_t>(it - 1 - image.begin());
+}
+
+bool Program::decodeInstruction(const Command &command, uint32_t address, MicroOp &op) {
+    const InstructionInfo *info = Isa::find(command.getName());
+    if (!info) {
+        addError(command, "Instruction can't be executed: " + command.getName());
+        return false;
+    }
+    op.opcode = info->opcode;
+    op.addressingMode = command.getAddressingMode();
+    op.rd = op.rs = op.rt = 0;
+    op.size = static_cast<uint8_t>(command.getMemorySizeWords());
+    op.value = 0;
+    op.address = address;
+    op.next = op.target = NO_OP;
+    op.cycles = latencies.getLatency(command);
+
+    switch (op.opcode) {
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+        op.rd = registerIndex(command.getR1());
+        op.rs = registerIndex(command.getR2());
+        op.rt = registerIndex(command.getR3());
+        break;
+    case Opcode::Inc:
+    case Opcode::Dec:
+    case Opcode::Neg:
+    case Opcode::Push:
+    case Opcode::Pop:
+        op.rd = registerIndex(command.getR1());
+        break;
+    case Opcode::Jmp:
+    case Opcode::Call:
+        op.rs = registerIndex(command.getR1());
+        break;
+    case Opcode::Ret:
+    case Opcode::Iret:
+        break;
+    default: // load, store and conditional jumps
+        op.rd = registerIndex(command.getR1());
+        op.rs = registerIndex(command.getR2());
+        break;
+    }
+
+    if (op.size > 1) {
+        uint32_t value;
+        if (!resolve(command, value)) {
+            return false;
+        }
+        op.value = command.getSign() == Command::Sign::Minus ? 0u - value : value;
+    }
+    return true;
+}
+
+bool Program::resolve(const Command &command, uint32_t &value) {
+    if (!Linker::resolveValue(symbolTable, command.getNumberOrSymbol(), value)) {
+        const std::string &numberOrSymbol = command.getNumberOrSymbol();
+        addError(command, Linker::isNumber(numberOrSymbol) ? "Number " + numberOrSymbol + " doesn't fit in 32 bits" : "Undefined symbol: " + numberOrSymbol);
+        return false;
+    }
+    return true;
+}
+
+void Program::addError(const Command &command, const std::string &message) {
+    errors.emplace_back(message, command.getLine(), lineTable.getFilename(command.getFileIndex()));
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Isa.hpp"
+#include "LatencyTable.hpp"
+#include "LineTable.hpp"
+#include <unordered_map>
+
+// Pre-decoded instruction, operands are normalized so the emulator
+// never has to look at the arity of the original command
+struct MicroOp {
+    Opcode opcode;
+    AddressingMode addressingMode;
+    uint8_t rd;         // destination, pushed/popped or tested register
+    uint8_t rs;         // operand register
+    uint8_t rt;         // second source of three-register arithmetic
+    uint8_t size;       // words in memory
+    uint32_t value;     // immediate, memory address or displacement (sign applied)
+    uint32_t address;
+    uint32_t next;      // op index of the fall-through instruction
+    uint32_t target;    // op index of a direct jump target
+    uint32_t cycles;
+    uint32_t command;   // index into the command stream
+};
+
+// Words at consecutive addresses from base. An image is a list of them in
+// address order, the gaps between org segments take no space.
+struct ImageSegment {
+    uint32_t base;
+    std::vector<uint32_t> words;
+
+    uint64_t getEnd() const {
+        return static_cast<uint64_t>(base) + words.size();
+    }
+};
+
+// Linked program decoded into an emulator-ready form: the micro-op stream,
+// the initial memory image with every instruction encoded into it and the
+// maps back to addresses and source lines.
+class Program {
+public:
+    static constexpr uint32_t NO_OP = ~0u;
+    static constexpr uint32_t IMAGE_MAGIC = 0x47455352;   // "RSEG", starts an image file of several segments
+
+    Program(const std::vector<Command> &commands, const std::unordered_map<std::string, uint32_t> &symbolTable,
+        const std::vector<std::string> &sourceFiles = {}, const LatencyTable &latencies = LatencyTable::getDefault());
+    bool load();
+    const std::vector<MicroOp> &getCode() const;
+    const std::vector<ImageSegment> &getImage() const;
+    uint64_t getImageWordCount() const;
+    const std::vector<Command> &getCommands() const;
+    const LineTable &getLineTable() const;
+    uint32_t getEntry() const;
+    uint32_t findOp(uint32_t address) const;
+    bool findSymbol(const std::string &name, uint32_t &value) const;
+    std::string getNearestLabel(uint32_t address, uint32_t &offset) const;
+    std::string describeAddress(uint32_t address) const;
+    bool writeImage(const std::string &filename);
+    bool writeSymbols(const std::string &filename);
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+private:
+    std::vector<Command> commands;
+    std::unordered_map<std::string, uint32_t> symbolTable;
+    const LatencyTable &latencies;
+    std::vector<MicroOp> code;
+    std::vector<ImageSegment> image;
+    std::vector<std::vector<uint32_t>> addressOps;     // op index of each word of each image segment
+    std::vector<std::pair<uint32_t, std::string>> labels;
+    LineTable lineTable;
+    uint32_t entry = NO_OP;
+    std::vector<Error> errors;
+
+    static constexpr size_t NO_SEGMENT = ~0;
+
+    size_t findSegment(uint32_t address) const;
+    bool decodeInstruction(const Command &command, uint32_t address, MicroOp &op);
+    bool resolve(const Command &command, uint32_t &value);
+    void addError(const Command &command, const std::string &message);
+};
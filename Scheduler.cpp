@@ -0,0 +1,331 @@
+#include "Scheduler.hpp"
+#include "Isa.hpp"
+#include <algorithm>
+
+static constexpr int REGISTER_ZERO = 0;
+static constexpr int REGISTER_SP = 2;
+static constexpr size_t NO_NODE = ~0;
+
+// Registers an instruction reads and writes, as bit masks. The zero register
+// reads as zero whatever was written to it, so it never carries a dependence.
+struct Access {
+    uint32_t uses = 0;
+    uint32_t defines = 0;
+    bool memory = false;
+    bool control = false;
+
+    void use(int r) {
+        uses |= r == REGISTER_ZERO ? 0 : 1u << r;
+    }
+
+    void define(int r) {
+        defines |= r == REGISTER_ZERO ? 0 : 1u << r;
+    }
+};
+
+static bool readsOperandRegister(AddressingMode mode) {
+    return
+        mode == AddressingMode::RegisterDirect ||
+        mode == AddressingMode::RegisterIndirect ||
+        mode == AddressingMode::RegisterIndirectWithDisplacement;
+}
+
+static bool accessesMemory(AddressingMode mode) {
+    return
+        mode == AddressingMode::MemoryDirect ||
+        mode == AddressingMode::RegisterIndirect ||
+        mode == AddressingMode::RegisterIndirectWithDisplacement;
+}
+
+// r1 is the destination, the stored or the tested register, the operand
+// register is r2 for two operand instructions and r1 for jmp and call
+static Access accessOf(const Command &command) {
+    Access access;
+    const InstructionInfo *info = Isa::find(command.getName());
+    if (!info) {
+        access.control = true;
+        return access;
+    }
+    AddressingMode mode = command.getAddressingMode();
+    switch (info->opcode) {
+    case Opcode::Load:
+        access.define(command.getR1());
+        if (readsOperandRegister(mode)) {
+            access.use(command.getR2());
+        }
+        access.memory = accessesMemory(mode);
+        break;
+    case Opcode::Store:
+        access.use(command.getR1());
+        if (mode == AddressingMode::RegisterDirect) {
+            access.define(command.getR2());
+        }
+        else if (readsOperandRegister(mode)) {
+            access.use(command.getR2());
+        }
+        access.memory = accessesMemory(mode);
+        break;
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+        access.define(command.getR1());
+        access.use(command.getR2());
+        access.use(command.getR3());
+        break;
+    case Opcode::Inc:
+    case Opcode::Dec:
+    case Opcode::Neg:
+        access.use(command.getR1());
+        access.define(command.getR1());
+        break;
+    case Opcode::Push:
+    case Opcode::Pop:
+        if (info->opcode == Opcode::Push) {
+            access.use(command.getR1());
+        }
+        else {
+            access.define(command.getR1());
+        }
+        access.use(REGISTER_SP);
+        access.define(REGISTER_SP);
+        access.memory = true;
+        break;
+    case Opcode::Jmp:
+    case Opcode::Call:
+        if (readsOperandRegister(mode)) {
+            access.use(command.getR1());
+        }
+        access.memory = true;
+        access.control = true;
+        break;
+    default:
+        if (info->kind == InstructionKind::Branch) {
+            access.use(command.getR1());
+            if (readsOperandRegister(mode)) {
+                access.use(command.getR2());
+            }
+        }
+        access.memory = true;
+        access.control = true;
+        break;
+    }
+    return access;
+}
+
+Scheduler::Scheduler(const std::vector<Command> &commands, const LatencyTable &latencies)
+    : commands(commands), latencies(latencies) {}
+
+// Returns whether any block was reordered
+bool Scheduler::schedule() {
+    bool changed = false;
+    size_t index = 0;
+    while (index < commands.size()) {
+        if (commands[index].getType() != Command::Type::Instruction) {
+            ++index;
+            continue;
+        }
+        size_t begin = index;
+        while (index < commands.size() && index - begin < MAX_BLOCK_INSTRUCTIONS &&
+            commands[index].getType() == Command::Type::Instruction) {
+            if (Isa::transfersControl(commands[index++].getName())) {
+                break;
+            }
+        }
+        changed |= scheduleBlock(begin, index);
+    }
+    return changed;
+}
+
+const std::vector<Command> &Scheduler::getCommands() const {
+    return commands;
+}
+
+size_t Scheduler::getBlockCount() const {
+    return blocks;
+}
+
+size_t Scheduler::getScheduledBlockCount() const {
+    return scheduledBlocks;
+}
+
+size_t Scheduler::getMovedInstructions() const {
+    return movedInstructions;
+}
+
+uint64_t Scheduler::getOriginalCycles() const {
+    return originalCycles;
+}
+
+uint64_t Scheduler::getScheduledCycles() const {
+    return scheduledCycles;
+}
+
+uint64_t Scheduler::getSavedCycles() const {
+    return originalCycles - scheduledCycles;
+}
+
+// Greedy list scheduling: of the instructions whose predecessors are all
+// placed, take the one that can issue first, and among those the one heading
+// the longest latency path to the end of the block.
+bool Scheduler::scheduleBlock(size_t begin, size_t end) {
+    std::vector<Node> nodes = buildGraph(begin, end);
+    size_t count = nodes.size();
+    std::vector<size_t> original(count);
+    for (size_t i = 0; i < count; ++i) {
+        original[i] = i;
+    }
+
+    std::vector<size_t> order;
+    std::vector<size_t> ready;
+    std::vector<uint64_t> issue(count, 0);
+    order.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (nodes[i].unscheduledPredecessors == 0) {
+            ready.push_back(i);
+        }
+    }
+    uint64_t next = 0;
+    while (!ready.empty()) {
+        size_t best = 0;
+        uint64_t bestStart = ~0ull;
+        for (size_t candidate = 0; candidate < ready.size(); ++candidate) {
+            const Node &node = nodes[ready[candidate]];
+            uint64_t start = next;
+            for (size_t producer : node.producers) {
+                start = std::max(start, issue[producer] + nodes[producer].latency);
+            }
+            const Node &chosen = nodes[ready[best]];
+            if (start < bestStart ||
+                (start == bestStart && (node.height > chosen.height ||
+                (node.height == chosen.height && ready[candidate] < ready[best])))) {
+                best = candidate;
+                bestStart = start;
+            }
+        }
+        size_t node = ready[best];
+        ready.erase(ready.begin() + best);
+        order.push_back(node);
+        issue[node] = bestStart;
+        next = bestStart + 1;
+        for (size_t successor : nodes[node].successors) {
+            if (--nodes[successor].unscheduledPredecessors == 0) {
+                ready.push_back(successor);
+            }
+        }
+    }
+
+    uint64_t before = estimateCycles(nodes, original);
+    uint64_t after = estimateCycles(nodes, order);
+    ++blocks;
+    originalCycles += before;
+    if (after >= before) {
+        scheduledCycles += before;
+        return false;
+    }
+    scheduledCycles += after;
+    ++scheduledBlocks;
+
+    // Sizes don't change, so the block keeps its words and only the
+    // addresses inside it move
+    std::vector<Command> block(commands.begin() + begin, commands.begin() + end);
+    uint32_t address = commands[begin].getAddress();
+    for (size_t i = 0; i < count; ++i) {
+        movedInstructions += order[i] != i;
+        commands[begin + i] = block[order[i]];
+        commands[begin + i].setAddress(address);
+        address += commands[begin + i].getMemorySizeWords();
+    }
+    return true;
+}
+
+// Edges keep every read after the write it sees (the only edges that carry
+// a latency), every write after the reads and the write before it, memory
+// accesses in program order and the control transfer that ends a block last
+std::vector<Scheduler::Node> Scheduler::buildGraph(size_t begin, size_t end) const {
+    std::vector<Node> nodes(end - begin);
+    size_t lastDefinition[32];
+    std::vector<size_t> readers[32];
+    std::fill(std::begin(lastDefinition), std::end(lastDefinition), NO_NODE);
+    size_t lastMemory = NO_NODE;
+
+    auto addEdge = [&nodes](size_t from, size_t to) {
+        nodes[from].successors.push_back(to);
+        ++nodes[to].unscheduledPredecessors;
+    };
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const Command &command = commands[begin + i];
+        Access access = accessOf(command);
+        nodes[i].latency = latencies.getLatency(command);
+        if (access.control) {
+            for (size_t before = 0; before < i; ++before) {
+                addEdge(before, i);
+            }
+        }
+        for (int r = 0; r < 32; ++r) {
+            if ((access.uses & (1u << r)) && lastDefinition[r] != NO_NODE) {
+                nodes[i].producers.push_back(lastDefinition[r]);
+                if (!access.control) {
+                    addEdge(lastDefinition[r], i);
+                }
+            }
+        }
+        if (!access.control) {
+            for (int r = 0; r < 32; ++r) {
+                if (!(access.defines & (1u << r))) {
+                    continue;
+                }
+                if (lastDefinition[r] != NO_NODE) {
+                    addEdge(lastDefinition[r], i);
+                }
+                for (size_t reader : readers[r]) {
+                    addEdge(reader, i);
+                }
+            }
+            if (access.memory && lastMemory != NO_NODE) {
+                addEdge(lastMemory, i);
+            }
+        }
+        for (int r = 0; r < 32; ++r) {
+            if (access.uses & (1u << r)) {
+                readers[r].push_back(i);
+            }
+        }
+        for (int r = 0; r < 32; ++r) {
+            if (access.defines & (1u << r)) {
+                lastDefinition[r] = i;
+                readers[r].clear();
+            }
+        }
+        if (access.memory) {
+            lastMemory = i;
+        }
+    }
+
+    for (size_t i = nodes.size(); i-- > 0;) {
+        uint32_t longest = 0;
+        for (size_t successor : nodes[i].successors) {
+            longest = std::max(longest, nodes[successor].height);
+        }
+        nodes[i].height = nodes[i].latency + longest;
+    }
+    return nodes;
+}
+
+// In-order issue, one instruction a cycle, each waiting for the results it
+// reads. The block takes until its last result is ready.
+uint64_t Scheduler::estimateCycles(const std::vector<Node> &nodes, const std::vector<size_t> &order) {
+    std::vector<uint64_t> issue(nodes.size(), 0);
+    uint64_t next = 0;
+    uint64_t finish = 0;
+    for (size_t node : order) {
+        uint64_t start = next;
+        for (size_t producer : nodes[node].producers) {
+            start = std::max(start, issue[producer] + nodes[producer].latency);
+        }
+        issue[node] = start;
+        next = start + 1;
+        finish = std::max(finish, start + nodes[node].latency);
+    }
+    return finish;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "LatencyTable.hpp"
+
+// Post-link list scheduler. Straight-line runs of instructions, cut at labels,
+// directives and control transfers, are reordered so that independent
+// instructions fill the cycles an in-order pipeline would otherwise stall
+// waiting for a result. The model issues one instruction per cycle; a result
+// is ready the latency of its instruction after issue. Registers are never
+// renamed and memory accesses keep their order, devices included, so only
+// instructions with no dependence between them change places. A block is
+// only rewritten when the model says it gets faster.
+class Scheduler {
+public:
+    static constexpr size_t MAX_BLOCK_INSTRUCTIONS = 256;
+
+    Scheduler(const std::vector<Command> &commands, const LatencyTable &latencies = LatencyTable::getDefault());
+    bool schedule();
+    const std::vector<Command> &getCommands() const;
+    size_t getBlockCount() const;
+    size_t getScheduledBlockCount() const;
+    size_t getMovedInstructions() const;
+    uint64_t getOriginalCycles() const;
+    uint64_t getScheduledCycles() const;
+    uint64_t getSavedCycles() const;
+private:
+    struct Node {
+        uint32_t latency;
+        uint32_t height = 0;                // longest latency path to the end of the block
+        std::vector<size_t> successors;
+        std::vector<size_t> producers;      // nodes whose results this one reads
+        size_t unscheduledPredecessors = 0;
+    };
+
+    std::vector<Command> commands;
+    const LatencyTable &latencies;
+    size_t blocks = 0;
+    size_t scheduledBlocks = 0;
+    size_t movedInstructions = 0;
+    uint64_t originalCycles = 0;
+    uint64_t scheduledCycles = 0;
+
+    bool scheduleBlock(size_t begin, size_t end);
+    std::vector<Node> buildGraph(size_t begin, size_t end) const;
+    static uint64_t estimateCycles(const std::vector<Node> &nodes, const std::vector<size_t> &order);
+};
@@ -0,0 +1,194 @@
+#include "SourceManager.hpp"
+#include "AllocationTracker.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceManager::SourceManager(bool mapFiles) : mapFiles(mapFiles) {}
+
+SourceManager::SourceManager(FileProvider provider) : mapFiles(false), provider(std::move(provider)) {}
+
+void SourceManager::addIncludePath(const std::string &directory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    includePaths.push_back(directory);
+}
+
+// Paths let go of the versions they found, a version some file has replaced
+// is freed here unless a build still holds it
+void SourceManager::revalidate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.clear();
+    listings.clear();
+    filesByPath.clear();
+}
+
+// Returns null with a message in error when the name can't be found or read
+std::shared_ptr<const SourceFile> SourceManager::open(const std::string &name, const std::string &directory, std::string &error) {
+    AllocationScope scope("sources");
+    std::lock_guard<std::mutex> lock(mutex);
+    std::filesystem::path relative(name);
+    std::vector<std::string> candidates;
+    if (relative.is_absolute()) {
+        candidates.push_back(name);
+    }
+    else {
+        candidates.push_back((std::filesystem::path(directory) / relative).string());
+        for (const std::string &includePath : includePaths) {
+            candidates.push_back((std::filesystem::path(includePath) / relative).string());
+        }
+    }
+    if (provider) {
+        for (std::string &path : candidates) {
+            path = std::filesystem::path(path).lexically_normal().generic_string();
+        }
+    }
+    for (const std::string &path : candidates) {
+        auto known = filesByPath.find(path);
+        if (known != filesByPath.end()) {
+            return known->second;
+        }
+        if (provider) {
+            std::shared_ptr<const SourceFile> file = provide(path);
+            if (file) {
+                return file;
+            }
+            continue;
+        }
+        if (!listed(path)) {
+            continue;
+        }
+        const StatEntry &entry = stat(path);
+        if (!entry.exists) {
+            continue;
+        }
+        auto same = files.find(entry.key);
+        bool current = same != files.end() &&
+            same->second->modified == entry.modified && same->second->size == entry.size;
+        std::shared_ptr<const SourceFile> file = current ? same->second : load(path, entry, error);
+        if (file) {
+            filesByPath.emplace(path, file);
+        }
+        return file;
+    }
+    error = "File doesn't exist: " + candidates.front();
+    return nullptr;
+}
+
+// Files held now, one version each
+size_t SourceManager::getFileCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return files.size();
+}
+
+// Versions loaded over the lifetime of the manager
+uint64_t SourceManager::getLoadCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return nextId;
+}
+
+uint64_t SourceManager::getStatCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return statCount;
+}
+
+uint64_t SourceManager::getListingCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return listingCount;
+}
+
+// Whether the directory listing of path has its filename, a directory that
+// can't be read lists nothing
+bool SourceManager::listed(const std::string &path) {
+    std::filesystem::path full(path);
+    std::string directory = full.parent_path().string();
+    auto listing = listings.find(directory);
+    if (listing == listings.end()) {
+        ++listingCount;
+        listing = listings.emplace(directory, std::unordered_set<std::string>()).first;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(directory.empty() ? "." : directory, ec), end; !ec && it != end; it.increment(ec)) {
+            listing->second.insert(it->path().filename().string());
+        }
+    }
+    return listing->second.count(full.filename().string()) > 0;
+}
+
+const SourceManager::StatEntry &SourceManager::stat(const std::string &path) {
+    auto cached = stats.find(path);
+    if (cached != stats.end()) {
+        return cached->second;
+    }
+    ++statCount;
+    struct stat status;
+    StatEntry entry = {};
+    if (::stat(path.c_str(), &status) == 0 && S_ISREG(status.st_mode)) {
+        entry.exists = true;
+        entry.key = { static_cast<uint64_t>(status.st_dev), static_cast<uint64_t>(status.st_ino) };
+        entry.size = static_cast<uint64_t>(status.st_size);
+        entry.modified = static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+    }
+    return stats.emplace(path, entry).first->second;
+}
+
+// Provided files have no modification time, the id of the version stands in
+// for it so that parse caches tell the versions of a path apart
+std::shared_ptr<const SourceFile> SourceManager::provide(const std::string &path) {
+    auto content = std::make_shared<std::string>();
+    if (!provider(path, *content)) {
+        return nullptr;
+    }
+    FileKey key = { VIRTUAL_DEVICE, providedInodes.emplace(path, providedInodes.size()).first->second };
+    std::shared_ptr<const SourceFile> &current = files[key];
+    if (!current || current->size != content->size() || std::memcmp(current->data, content->data(), content->size()) != 0) {
+        uint32_t id = nextId++;
+        const char *data = content->data();
+        current = std::make_shared<SourceFile>(SourceFile{ id, path, key, data, content->size(), id, std::move(content) });
+    }
+    filesByPath.emplace(path, current);
+    return current;
+}
+
+// Replaces the version the file had, if any
+std::shared_ptr<const SourceFile> SourceManager::load(const std::string &path, const StatEntry &entry, std::string &error) {
+    const char *data = "";
+    size_t size = static_cast<size_t>(entry.size);
+    std::shared_ptr<const void> storage;
+    if (size > 0) {
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            error = "Failed to open file: " + path;
+            return nullptr;
+        }
+        if (mapFiles) {
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            ::close(descriptor);
+            if (mapped == MAP_FAILED) {
+                error = "Failed to map file: " + path;
+                return nullptr;
+            }
+            data = static_cast<const char *>(mapped);
+            storage = std::shared_ptr<const void>(mapped, [size](const void *mapping) {
+                munmap(const_cast<void *>(mapping), size);
+            });
+        }
+        else {
+            // The file may have changed since the stat, what was read counts
+            auto content = std::make_shared<std::string>(size, '\0');
+            ssize_t count;
+            size = 0;
+            while (size < content->size() && (count = ::read(descriptor, &(*content)[size], content->size() - size)) > 0) {
+                size += static_cast<size_t>(count);
+            }
+            ::close(descriptor);
+            content->resize(size);
+            data = content->data();
+            storage = std::move(content);
+        }
+    }
+    auto file = std::make_shared<SourceFile>(SourceFile{ nextId++, path, entry.key, data, size, entry.modified, std::move(storage) });
+    files[entry.key] = file;
+    return file;
+}
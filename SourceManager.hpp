@@ -0,0 +1,106 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Error.hpp"
+
+// Identity of a file on disk, the same for every path that leads to it
+struct FileKey {
+    uint64_t device;
+    uint64_t inode;
+
+    bool operator==(const FileKey &other) const {
+        return device == other.device && inode == other.inode;
+    }
+};
+
+struct FileKeyHash {
+    size_t operator()(const FileKey &key) const {
+        return std::hash<uint64_t>()(key.inode * 0x9E3779B97F4A7C15ull ^ key.device);
+    }
+};
+
+// One version of a source file. A changed file is loaded again under a new
+// id and the version it replaces is dropped from its manager; the content
+// stays valid as long as someone still holds the version.
+struct SourceFile {
+    uint32_t id;                // in order of loading, never reused
+    std::string path;           // as first found, used in messages
+    FileKey key;
+    const char *data;
+    size_t size;
+    int64_t modified;           // nanoseconds since the epoch
+    std::shared_ptr<const void> storage;    // owns data, the read content or the mapping
+};
+
+// Supplies the content of a file by path, false when there is no such file.
+// Called from the thread that links, possibly from several at once.
+using FileProvider = std::function<bool(const std::string &path, std::string &content)>;
+
+// Owns the source files of a build. Files are keyed by device and inode, so
+// every spelling of a path maps to one SourceFile and is read once. Lookups
+// go through a stat cache and a cache of directory listings: a name that
+// isn't in the listing of its directory is missing without asking the file
+// system, and each path is stat'ed at most once.
+//
+// Relative names are searched in the given directory first and then in the
+// include paths in the order they were added.
+//
+// A long-lived manager is shared between threads and revalidated before
+// each build, which forgets the cached stats and listings while keeping
+// the loaded files. Files that still match their stat are reused, edited
+// ones load again and replace their old version, so the manager holds one
+// version of each file however often it is edited. Such a manager should
+// read files rather than map them, since a file truncated while mapped
+// faults on access.
+//
+// A manager built on a FileProvider never touches the file system. Its files
+// are keyed by their lexically normalized path, content that comes back
+// unchanged keeps its version.
+class SourceManager {
+public:
+    explicit SourceManager(bool mapFiles = true);
+    explicit SourceManager(FileProvider provider);
+    SourceManager(const SourceManager &) = delete;
+    SourceManager &operator=(const SourceManager &) = delete;
+
+    void addIncludePath(const std::string &directory);
+    void revalidate();
+    std::shared_ptr<const SourceFile> open(const std::string &name, const std::string &directory, std::string &error);
+    size_t getFileCount() const;
+    uint64_t getLoadCount() const;
+    uint64_t getStatCount() const;
+    uint64_t getListingCount() const;
+private:
+    struct StatEntry {
+        bool exists;
+        FileKey key;
+        uint64_t size;
+        int64_t modified;
+    };
+
+    static constexpr uint64_t VIRTUAL_DEVICE = ~0ull;
+
+    bool mapFiles;
+    FileProvider provider;
+    mutable std::mutex mutex;
+    std::vector<std::string> includePaths;
+    std::unordered_map<FileKey, std::shared_ptr<const SourceFile>, FileKeyHash> files;  // current version of each file
+    std::unordered_map<std::string, std::shared_ptr<const SourceFile>> filesByPath;
+    std::unordered_map<std::string, uint64_t> providedInodes;   // stand-in inodes of provided paths
+    uint32_t nextId = 0;
+    std::unordered_map<std::string, StatEntry> stats;
+    std::unordered_map<std::string, std::unordered_set<std::string>> listings;
+    uint64_t statCount = 0;
+    uint64_t listingCount = 0;
+
+    bool listed(const std::string &path);
+    const StatEntry &stat(const std::string &path);
+    std::shared_ptr<const SourceFile> provide(const std::string &path);
+    std::shared_ptr<const SourceFile> load(const std::string &path, const StatEntry &entry, std::string &error);
+};
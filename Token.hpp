@@ -1,49 +1,59 @@
-#pragma once
-
-#include <string>
-#include <vector>
-#include "Error.hpp"
-
-struct Token {
-    enum class Type {
-        Name,
-        Number,
-        Symbol,
-        Unknown
-    };
-    Type type;
-    std::string value;
-
-    Token(Type type, const std::string &value) : type(type), value(value) {}
-
-    bool matchToken(Token::Type expectedType, const std::string &expectedValue = "");
-};
-
-class Tokenizer {
-public:
-    Tokenizer(const std::string &filename);
-    bool tokenize();
-    const std::vector<Token> &getTokens() const;
-    const std::vector<Error> &getErrors() const;
-    bool hasErrors() const;
-private:
-    static const std::vector<std::string> allowedSymbols;
-    std::vector<Token> tokens;
-    std::vector<Error> errors;
-    std::string fileContent;
-    int currentLine;
-
-    void addToken(Token token);
-    void addError(const std::string &message);
-    bool isNameStart(char c) const;
-    bool isNamePart(char c) const;
-    bool isDigit(char c) const;
-    bool isHexDigit(char c) const;
-    bool isWhitespace(char c) const;
-    bool isSymbol(char c) const;
-    void skipWhitespaceAndComments(const std::string &content, size_t &i);
-    std::string parseNumber(const std::string &content, size_t &i);
-    std::string parseName(const std::string &content, size_t &i);
-    std::string parseSymbol(const std::string &content, size_t &i);
-    void tokenizeFile(const std::string &content);
-};
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Diagnostics.hpp"
+
+struct Token {
+    enum class Type {
+        Name,
+        Number,
+        Symbol,
+        Unknown
+    };
+    Type type;
+    std::string value;
+    int line;
+    int column = 0;     // 1-based
+
+    Token(Type type, const std::string &value, int line = Error::NO_LINE) : type(type), value(value), line(line) {}
+
+    bool matchToken(Token::Type expectedType, const std::string &expectedValue = "");
+
+    static bool parseNumber(std::string_view value, uint64_t &number);
+};
+
+class Tokenizer {
+public:
+    Tokenizer(const std::string &filename);
+    Tokenizer(const char *data, size_t size);   // content already in memory, not copied
+    bool tokenize();
+    const std::vector<Token> &getTokens() const;
+    std::vector<Error> getErrors() const;
+    const Diagnostics &getDiagnostics() const;
+    bool hasErrors() const;
+private:
+    static const std::vector<std::string> allowedSymbols;
+    std::vector<Token> tokens;
+    Diagnostics diagnostics;
+    uint32_t fileId = Diagnostics::NO_FILE;
+    size_t lineStart = 0;
+    std::string fileContent;
+    std::string_view content;
+    int currentLine;
+
+    void addToken(Token token, size_t start);
+    void addError(DiagnosticCode code, size_t start, std::string_view argument = {});
+    bool isNameStart(char c) const;
+    bool isNamePart(char c) const;
+    bool isDigit(char c) const;
+    bool isHexDigit(char c) const;
+    bool isWhitespace(char c) const;
+    bool isSymbol(char c) const;
+    void skipWhitespaceAndComments(std::string_view content, size_t &i);
+    std::string parseNumber(std::string_view content, size_t &i);
+    std::string parseName(std::string_view content, size_t &i);
+    std::string parseSymbol(std::string_view content, size_t &i);
+    void tokenizeFile(std::string_view content);
+};
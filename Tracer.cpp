@@ -0,0 +1,181 @@
+#include "Tracer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+static const size_t WRITE_CHUNK = 4096;
+
+TraceBuffer::TraceBuffer(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    records.resize(size);
+    mask = size - 1;
+}
+
+size_t TraceBuffer::pop(TraceRecord *out, size_t max) {
+    uint64_t position = tail.load(std::memory_order_relaxed);
+    if (cachedHead == position) {
+        cachedHead = head.load(std::memory_order_acquire);
+    }
+    size_t count = static_cast<size_t>(std::min<uint64_t>(cachedHead - position, max));
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = records[(position + i) & mask];
+    }
+    tail.store(position + count, std::memory_order_release);
+    return count;
+}
+
+Tracer::Tracer(uint32_t fileRecords) : fileRecords(std::max<uint32_t>(fileRecords, 1)), buffer(BUFFER_RECORDS) {}
+
+Tracer::~Tracer() {
+    close();
+}
+
+bool Tracer::open(const std::string &filename) {
+    close();
+    file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        errors.emplace_back("Couldn't create trace file", Error::NO_LINE, filename);
+        return false;
+    }
+    this->filename = filename;
+    written = 0;
+    dropped = 0;
+    gap = false;
+    writeHeader();
+    stopping = false;
+    writer = std::thread(&Tracer::writeLoop, this);
+    return true;
+}
+
+// Whatever is still in the ring is written before the header is finalised
+void Tracer::close() {
+    if (!writer.joinable()) {
+        return;
+    }
+    stopping = true;
+    writer.join();
+    drain();
+    writeHeader();
+    file.close();
+    if (!file) {
+        errors.emplace_back("Couldn't write trace file", Error::NO_LINE, filename);
+    }
+}
+
+uint64_t Tracer::getWrittenCount() const {
+    return written;
+}
+
+uint64_t Tracer::getDroppedCount() const {
+    return dropped;
+}
+
+const std::vector<Error> &Tracer::getErrors() const {
+    return errors;
+}
+
+bool Tracer::hasErrors() const {
+    return !errors.empty();
+}
+
+void Tracer::writeLoop() {
+    while (!stopping.load(std::memory_order_acquire)) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+void Tracer::drain() {
+    TraceRecord chunk[WRITE_CHUNK];
+    size_t count;
+    while ((count = buffer.pop(chunk, WRITE_CHUNK)) > 0) {
+        for (size_t done = 0; done < count; ) {
+            uint64_t slot = written % fileRecords;
+            if (slot == 0 && written > 0) {
+                file.seekp(sizeof(Header));
+            }
+            size_t run = static_cast<size_t>(std::min<uint64_t>(count - done, fileRecords - slot));
+            file.write(reinterpret_cast<const char *>(chunk + done), run * sizeof(TraceRecord));
+            written += run;
+            done += run;
+        }
+    }
+}
+
+void Tracer::writeHeader() {
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.capacity = fileRecords;
+    header.reserved = 0;
+    header.written = written;
+    header.dropped = dropped;
+    std::streampos position = file.tellp();
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (position > std::streampos(sizeof(header))) {
+        file.seekp(position);
+    }
+}
+
+// Prints the last maxRecords records, oldest first
+bool Tracer::decode(const std::string &filename, const Program &program, std::ostream &out, uint64_t maxRecords, std::vector<Error> &errors) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        errors.emplace_back("Couldn't open trace file", Error::NO_LINE, filename);
+        return false;
+    }
+    Header header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.capacity == 0) {
+        errors.emplace_back("Not a trace file", Error::NO_LINE, filename);
+        return false;
+    }
+
+    uint64_t stored = std::min<uint64_t>(header.written, header.capacity);
+    uint64_t count = std::min(stored, maxRecords);
+    uint64_t first = header.written - count;
+    out << "Records: " << header.written << ", Dropped: " << header.dropped << ", Showing: " << count << std::endl;
+
+    const std::vector<MicroOp> &code = program.getCode();
+    const std::vector<Command> &commands = program.getCommands();
+    TraceRecord record;
+    for (uint64_t i = first; i < header.written; ++i) {
+        file.seekg(sizeof(Header) + (i % header.capacity) * sizeof(TraceRecord));
+        if (!file.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+            errors.emplace_back("Trace file is truncated", Error::NO_LINE, filename);
+            return false;
+        }
+        if (record.flags & GAP) {
+            out << "  -- records dropped --" << std::endl;
+        }
+        uint32_t op = program.findOp(record.address);
+        std::string source;
+        if (op != Program::NO_OP) {
+            source = commands[code[op].command].toSource();
+        }
+        else {
+            source = record.opcode < INSTRUCTION_COUNT ? std::string(Isa::get(static_cast<Opcode>(record.opcode)).mnemonic) : "?";
+        }
+
+        std::ostringstream line;
+        line << "0x" << std::hex << std::setw(8) << std::setfill('0') << record.address << std::dec << std::setfill(' ')
+            << "  " << std::left << std::setw(20) << program.getLineTable().describe(record.address)
+            << std::setw(28) << source << std::right;
+        if (record.reg != NO_REGISTER) {
+            line << " r" << static_cast<int>(record.reg) << " = 0x" << std::hex << record.value << std::dec;
+        }
+        if (record.flags & HAS_MEMORY) {
+            line << " [0x" << std::hex << record.memoryAddress << std::dec << "]";
+        }
+        std::string text = line.str();
+        text.erase(text.find_last_not_of(' ') + 1);
+        out << text << std::endl;
+    }
+    return true;
+}
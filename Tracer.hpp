@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Program.hpp"
+#include <atomic>
+#include <fstream>
+#include <ostream>
+#include <thread>
+
+// One executed instruction as stored in a trace file
+struct TraceRecord {
+    uint32_t address;           // instruction address
+    uint32_t memoryAddress;     // word accessed, valid with HAS_MEMORY
+    uint32_t value;             // value left in reg
+    uint8_t opcode;
+    uint8_t reg;                // register written, NO_REGISTER for none
+    uint8_t flags;
+    uint8_t reserved;
+};
+static_assert(sizeof(TraceRecord) == 16, "trace records are stored as is");
+
+// Lock-free single producer single consumer ring of trace records.
+// Each side keeps a stale copy of the other's index and only reloads the
+// shared one when the ring looks full or empty.
+class TraceBuffer {
+public:
+    explicit TraceBuffer(size_t capacity);
+
+    bool push(const TraceRecord &record) {
+        uint64_t position = head.load(std::memory_order_relaxed);
+        if (position - cachedTail > mask) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (position - cachedTail > mask) {
+                return false;
+            }
+        }
+        records[position & mask] = record;
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t pop(TraceRecord *out, size_t max);
+private:
+    std::vector<TraceRecord> records;
+    uint64_t mask;
+    alignas(64) std::atomic<uint64_t> head{ 0 };     // written by the producer
+    uint64_t cachedTail = 0;
+    alignas(64) std::atomic<uint64_t> tail{ 0 };     // written by the consumer
+    uint64_t cachedHead = 0;
+};
+
+// Records executed instructions for one emulator. The emulator thread only
+// pushes into the ring; a writer thread drains it into a file that itself
+// wraps after fileRecords, so the file always ends with the latest records.
+// A full ring drops records instead of stalling, the first record after a
+// drop carries GAP.
+//
+// File layout: a 32-byte header (magic, version, capacity, total records
+// written, records dropped) followed by capacity record slots.
+class Tracer {
+public:
+    static constexpr uint32_t DEFAULT_FILE_RECORDS = 1u << 20;
+    static constexpr size_t BUFFER_RECORDS = 1u << 16;
+    static constexpr uint8_t NO_REGISTER = 0xFF;
+    static constexpr uint8_t HAS_MEMORY = 1;
+    static constexpr uint8_t GAP = 2;
+
+    explicit Tracer(uint32_t fileRecords = DEFAULT_FILE_RECORDS);
+    ~Tracer();
+    bool open(const std::string &filename);
+    void close();
+    uint64_t getWrittenCount() const;
+    uint64_t getDroppedCount() const;
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+
+    static bool decode(const std::string &filename, const Program &program, std::ostream &out, uint64_t maxRecords, std::vector<Error> &errors);
+
+    void record(TraceRecord record) {
+        if (gap) {
+            record.flags |= GAP;
+        }
+        gap = !buffer.push(record);
+        dropped += gap;
+    }
+private:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t capacity;
+        uint32_t reserved;
+        uint64_t written;
+        uint64_t dropped;
+    };
+    static_assert(sizeof(Header) == 32, "the header is stored as is");
+
+    static constexpr char MAGIC[4] = { 'R', 'T', 'R', 'C' };
+    static constexpr uint32_t VERSION = 2;
+
+    uint32_t fileRecords;
+    TraceBuffer buffer;
+    bool gap = false;
+    uint64_t dropped = 0;               // emulator thread only
+    std::atomic<bool> stopping{ false };
+    std::thread writer;
+    std::ofstream file;
+    std::string filename;
+    uint64_t written = 0;               // writer thread until close
+    std::vector<Error> errors;
+
+    void writeLoop();
+    void drain();
+    void writeHeader();
+};
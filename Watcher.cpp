@@ -0,0 +1,227 @@
+#include "Watcher.hpp"
+#include "Linker.hpp"
+#include "Program.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+static constexpr uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+
+static std::string normalize(const std::filesystem::path &path) {
+    std::string normal = path.lexically_normal().generic_string();
+    return normal.empty() ? "." : normal;
+}
+
+static std::string directoryOf(const std::string &path) {
+    return normalize(std::filesystem::path(path).parent_path());
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+Watcher::Watcher(const std::string &root, std::ostream &out, int quietMs) :
+    root(root), base(root.substr(0, root.size() - 4)), out(out), quietMs(quietMs) {}
+
+Watcher::~Watcher() {
+    if (notify >= 0) {
+        close(notify);
+    }
+}
+
+void Watcher::addIncludePath(const std::string &directory) {
+    sources.addIncludePath(directory);
+    includePaths.push_back(directory);
+}
+
+// Builds once, then rebuilds on every change until maxRebuilds rebuilds are
+// done or a line is entered on standard input
+bool Watcher::watch(uint64_t maxRebuilds) {
+    notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify < 0) {
+        errors.emplace_back(std::string("Couldn't start watching: ") + std::strerror(errno));
+        return false;
+    }
+    build(std::chrono::steady_clock::now(), {});
+
+    bool readInput = true;
+    while (rebuilds < maxRebuilds) {
+        pollfd descriptors[2] = { { notify, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+        if (poll(descriptors, readInput ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errors.emplace_back(std::string("Couldn't wait for changes: ") + std::strerror(errno));
+            return false;
+        }
+        if (readInput && (descriptors[1].revents & (POLLIN | POLLHUP))) {
+            std::string line;
+            if (std::getline(std::cin, line)) {
+                return true;
+            }
+            readInput = false;  // no terminal, only the rebuild limit ends the watch
+        }
+        if (!(descriptors[0].revents & POLLIN)) {
+            continue;
+        }
+        std::vector<std::string> changedFiles;
+        if (!readEvents(changedFiles)) {
+            return false;
+        }
+        if (changedFiles.empty()) {
+            continue;
+        }
+
+        // An editor saving or a checkout touches several files in a burst,
+        // they go into one rebuild
+        auto changed = std::chrono::steady_clock::now();
+        pollfd quiet = { notify, POLLIN, 0 };
+        while (poll(&quiet, 1, quietMs) > 0) {
+            if (!readEvents(changedFiles)) {
+                return false;
+            }
+        }
+        std::sort(changedFiles.begin(), changedFiles.end());
+        changedFiles.erase(std::unique(changedFiles.begin(), changedFiles.end()), changedFiles.end());
+        build(changed, changedFiles);
+        ++rebuilds;
+    }
+    return true;
+}
+
+uint64_t Watcher::getRebuildCount() const {
+    return rebuilds;
+}
+
+const std::vector<Error> &Watcher::getErrors() const {
+    return errors;
+}
+
+bool Watcher::hasErrors() const {
+    return !errors.empty();
+}
+
+// Latency is counted from the first event of the change to the outputs
+// being written
+bool Watcher::build(std::chrono::steady_clock::time_point changed, const std::vector<std::string> &changedFiles) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t misses = parses.getMissCount();
+    if (!changedFiles.empty()) {
+        out << "Changed:";
+        for (const std::string &file : changedFiles) {
+            out << " " << file;
+        }
+        out << std::endl;
+    }
+
+    sources.revalidate();
+    Linker linker(root, sources);
+    linker.setParseCache(&parses);
+    bool linked = linker.link();
+    updateWatches(linker.getSourceFiles());
+    lastBuildFailed = true;
+    if (!linked) {
+        for (const auto &error : linker.getErrors()) {
+            out << error.getMessage() << std::endl;
+        }
+        out << "Build failed in " << std::fixed << std::setprecision(2) << millisecondsSince(start) << " ms"
+            << std::defaultfloat << std::endl;
+        return false;
+    }
+    Program program(linker.getCommands(), linker.getSymbolTable(), linker.getSourceFiles());
+    if (!program.load() || !program.writeImage(base + ".bin") || !program.writeSymbols(base + ".sym")) {
+        for (const auto &error : program.getErrors()) {
+            out << error.getMessage() << std::endl;
+        }
+        out << "Build failed in " << std::fixed << std::setprecision(2) << millisecondsSince(start) << " ms"
+            << std::defaultfloat << std::endl;
+        return false;
+    }
+    lastBuildFailed = false;
+    out << "Wrote " << program.getImageWordCount() << " words to " << base << ".bin from " << linker.getSourceFiles().size()
+        << " files, parsed " << parses.getMissCount() - misses << ", in " << std::fixed << std::setprecision(2)
+        << millisecondsSince(start) << " ms";
+    if (!changedFiles.empty()) {
+        out << ", " << millisecondsSince(changed) << " ms after the change";
+    }
+    out << std::defaultfloat << std::endl;
+    return true;
+}
+
+// Watches exactly the directories the next change can come from. A file that
+// failed to open is looked for next to the root and along the include paths,
+// so those are always watched.
+void Watcher::updateWatches(const std::vector<std::string> &sourceFiles) {
+    closure.clear();
+    closure.insert(normalize(root));
+    std::unordered_set<std::string> needed = { directoryOf(root) };
+    for (const std::string &path : includePaths) {
+        needed.insert(normalize(path));
+    }
+    for (const std::string &file : sourceFiles) {
+        closure.insert(normalize(file));
+        needed.insert(directoryOf(file));
+    }
+
+    for (auto watch = watches.begin(); watch != watches.end();) {
+        if (needed.count(watch->first) == 0) {
+            inotify_rm_watch(notify, watch->second);
+            directories.erase(watch->second);
+            watch = watches.erase(watch);
+        }
+        else {
+            ++watch;
+        }
+    }
+    for (const std::string &directory : needed) {
+        if (watches.count(directory) > 0) {
+            continue;
+        }
+        int descriptor = inotify_add_watch(notify, directory.c_str(), WATCH_EVENTS);
+        if (descriptor < 0) {
+            out << "Couldn't watch " << directory << ": " << std::strerror(errno) << std::endl;
+            continue;
+        }
+        watches.emplace(directory, descriptor);
+        directories[descriptor] = directory;
+    }
+}
+
+// Adds the sources among the changed files. While the last build is broken
+// any source may be the one that fixes it, a missing include for instance.
+bool Watcher::readEvents(std::vector<std::string> &changedFiles) {
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t length = read(notify, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return true;
+            }
+            errors.emplace_back(std::string("Couldn't read changes: ") + std::strerror(errno));
+            return false;
+        }
+        for (char *next = buffer; next < buffer + length;) {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(next);
+            next += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                changedFiles.push_back(normalize(root));
+                continue;
+            }
+            auto directory = directories.find(event->wd);
+            if (event->len == 0 || directory == directories.end()) {
+                continue;
+            }
+            std::string path = normalize(std::filesystem::path(directory->second) / event->name);
+            bool source = lastBuildFailed ? std::filesystem::path(path).extension() == ".asm" : closure.count(path) > 0;
+            if (source) {
+                changedFiles.push_back(path);
+            }
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ParseCache.hpp"
+#include <chrono>
+#include <ostream>
+#include <unordered_map>
+
+// Rebuilds a root file into <root>.bin and <root>.sym whenever one of its
+// sources changes. The directories of the root file, of every file it
+// includes and the include paths are watched with inotify; directories
+// rather than files, so that editors that save by renaming a new file over
+// the old one are seen. Events are collected until the sources have been
+// quiet for a moment, then the build relinks through a long-lived source
+// manager and parse cache, so only the edited files are read and parsed
+// again. The watched set follows the include closure of the last build.
+class Watcher {
+public:
+    static constexpr int DEFAULT_QUIET_MS = 50;
+    static constexpr uint64_t UNLIMITED = ~0ull;
+
+    Watcher(const std::string &root, std::ostream &out, int quietMs = DEFAULT_QUIET_MS);
+    Watcher(const Watcher &) = delete;
+    Watcher &operator=(const Watcher &) = delete;
+    ~Watcher();
+    void addIncludePath(const std::string &directory);
+    bool watch(uint64_t maxRebuilds = UNLIMITED);
+    uint64_t getRebuildCount() const;
+    const std::vector<Error> &getErrors() const;
+    bool hasErrors() const;
+private:
+    std::string root;
+    std::string base;                   // root without .asm, for the outputs
+    std::ostream &out;
+    int quietMs;
+    int notify = -1;
+    SourceManager sources{ false };
+    ParseCache parses;
+    std::vector<std::string> includePaths;
+    std::unordered_map<int, std::string> directories;      // watch descriptor to directory
+    std::unordered_map<std::string, int> watches;          // directory to watch descriptor
+    std::unordered_set<std::string> closure;               // sources of the last build
+    bool lastBuildFailed = false;
+    uint64_t rebuilds = 0;
+    std::vector<Error> errors;
+
+    bool build(std::chrono::steady_clock::time_point changed, const std::vector<std::string> &changedFiles);
+    void updateWatches(const std::vector<std::string> &sourceFiles);
+    bool readEvents(std::vector<std::string> &changedFiles);
+};
@@ -0,0 +1,29 @@
+; Naive recursive fibonacci, dominated by call, ret, push and pop
+start main
+
+main:
+load a0, #27
+call fib
+store a0, result
+ret
+
+fib:
+load t0, #2
+sub t0, a0, t0
+jlz t0, fib_base
+push a0
+dec a0
+call fib
+pop t1
+push a0
+load a0, t1
+load t2, #2
+sub a0, a0, t2
+call fib
+pop t1
+add a0, a0, t1
+fib_base:
+ret
+
+result:
+dd 0
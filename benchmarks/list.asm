@@ -0,0 +1,41 @@
+; Linked list traversal: 1024 three-word nodes (value, weight, next) are
+; linked back to front, then summed 500 times following the next fields
+start main
+
+main:
+load t0, #nodes
+load t1, #0
+load t2, #1
+load a1, #1024
+build:
+store t2, [t0]
+add a2, t2, t2
+store a2, [t0 + 1]
+store t1, [t0 + 2]
+load t1, t0
+load a2, #3
+add t0, t0, a2
+inc t2
+dec a1
+jnz a1, build
+
+load s1, #500
+load a0, #0
+repeat:
+load t0, t1
+walk:
+load a2, [t0]
+add a0, a0, a2
+load a2, [t0 + 1]
+add a0, a0, a2
+load t0, [t0 + 2]
+jnz t0, walk
+dec s1
+jnz s1, repeat
+store a0, result
+ret
+
+result:
+dd 0
+nodes:
+dd (0 dup 3072)
@@ -0,0 +1,65 @@
+; Dense 32x32 integer matrix multiply C = A * B repeated 20 times,
+; B is walked down its columns so every other load strides by a row
+start main
+
+main:
+load t0, #matrix_a
+load t1, #matrix_b
+load t2, #0
+load a1, #1024
+load a2, #3
+init:
+store t2, [t0]
+mul a3, t2, a2
+inc a3
+store a3, [t1]
+inc t0
+inc t1
+inc t2
+dec a1
+jnz a1, init
+
+load s1, #20
+load a4, #32
+repeat:
+load r18, #matrix_a
+load r19, #matrix_c
+load r20, #32
+row:
+load r21, #matrix_b
+load r22, #32
+column:
+load t0, r18
+load t1, r21
+load t2, #32
+load a0, #0
+dot:
+load a1, [t0]
+load a2, [t1]
+mul a1, a1, a2
+add a0, a0, a1
+inc t0
+add t1, t1, a4
+dec t2
+jnz t2, dot
+store a0, [r19]
+inc r19
+inc r21
+dec r22
+jnz r22, column
+add r18, r18, a4
+dec r20
+jnz r20, row
+dec s1
+jnz s1, repeat
+store a0, result
+ret
+
+result:
+dd 0
+matrix_a:
+dd (0 dup 1024)
+matrix_b:
+dd (0 dup 1024)
+matrix_c:
+dd (0 dup 1024)
@@ -0,0 +1,43 @@
+; Block fill and copy: memset a 4096-word buffer, then copy it four words
+; per iteration through displacement addressing, 200 times over
+start main
+
+main:
+load s1, #200
+load t2, #4
+repeat:
+load t0, #source
+load t1, #4096
+fill:
+store s1, [t0]
+inc t0
+dec t1
+jnz t1, fill
+load t0, #source
+load a1, #destination
+load t1, #1024
+copy:
+load a2, [t0]
+store a2, [a1]
+load a2, [t0 + 1]
+store a2, [a1 + 1]
+load a2, [t0 + 2]
+store a2, [a1 + 2]
+load a2, [t0 + 3]
+store a2, [a1 + 3]
+add t0, t0, t2
+add a1, a1, t2
+dec t1
+jnz t1, copy
+dec s1
+jnz s1, repeat
+load a0, [a1 - 1]
+store a0, result
+ret
+
+result:
+dd 0
+source:
+dd (0 dup 4096)
+destination:
+dd (0 dup 4096)
@@ -0,0 +1,26 @@
+; Top-tested loop whose common path branches over rare work every sixteenth
+; iteration. In source order an iteration takes the branch over the rare
+; work and the jmp back to the test; laid out for its profile, one of them.
+start main
+
+main:
+load t0, #100000
+load s1, #0
+load t1, #10
+loop:
+jz t0, done
+dec t1
+jnz t1, common
+load t1, #10
+add s1, s1, t0
+common:
+inc s1
+dec t0
+jmp loop
+done:
+store s1, result
+load a0, result
+ret
+
+result:
+dd 0
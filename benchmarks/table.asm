@@ -0,0 +1,31 @@
+; Table lookups: squares come from a dd table and index a histogram
+; reserved with dup, 20000 passes over the 16 entries
+start main
+
+main:
+load s1, #20000
+repeat:
+load t0, #squares
+load t1, #16
+lookup:
+load a1, [t0]
+load a2, #histogram
+add a2, a2, a1
+load a3, [a2]
+inc a3
+store a3, [a2]
+inc t0
+dec t1
+jnz t1, lookup
+dec s1
+jnz s1, repeat
+load a0, histogram
+store a0, result
+ret
+
+result:
+dd 0
+squares:
+dd 0, 1, 4, 9, 16, 25, 36, 49, 64, 81, 100, 121, 144, 169, 196, 225
+histogram:
+dd (0 dup 256)
@@ -0,0 +1,28 @@
+; Timer-driven firmware loop: the main loop sums a counter while the timer
+; interrupt on line 0 counts ticks.
+start main
+
+main:
+load ivtp, #vectors
+load imr, #1
+load t0, #5000000
+load a0, #0
+loop:
+add a0, a0, t0
+dec t0
+jnz t0, loop
+load imr, #0
+ret
+
+timer_handler:
+push t1
+load t1, ticks
+inc t1
+store t1, ticks
+pop t1
+iret
+
+vectors:
+dd timer_handler
+ticks:
+dd 0
@@ -1,167 +1,1214 @@
-#include "Token.hpp"
-#include "Parser.hpp"
-#include "Linker.hpp"
-#include <iostream>
-#include <filesystem>
-#include <algorithm>
-#include <sstream>
-
-static const std::string directoryPath = "C:/assembly/";
-
-void displayError(const std::string &message) {
-    std::cout << "Error: " << message << std::endl;
-    std::cout << "Available commands: " << std::endl;
-    std::cout << "  exit              - Exit the program" << std::endl;
-    std::cout << "  list              - List all files in the directory" << std::endl;
-    std::cout << "  tokenize <file>   - Tokenize a file with .asm extension" << std::endl;
-    std::cout << "  parse <file>      - Parse a file with .asm extension" << std::endl;
-}
-
-void handleListCommand() {
-    try {
-        std::cout << "Files in directory '" << directoryPath << "':" << std::endl;
-        for (const auto &entry : std::filesystem::directory_iterator(directoryPath)) {
-            if (entry.is_regular_file()) {
-                std::cout << "  " << entry.path().filename().string() << std::endl;
-            }
-        }
-    }
-    catch (const std::filesystem::filesystem_error &e) {
-        displayError("Could not access the directory: " + std::string(e.what()));
-    }
-}
-
-void handleTokenizeCommand(const std::string &filename) {
-    std::string fullFilePath = directoryPath + filename + ".asm";
-
-    Tokenizer tokenizer(fullFilePath);
-
-    if (tokenizer.tokenize()) {
-        std::cout << "Successfully tokenized: " << filename << ".asm" << std::endl;
-        std::cout << "Tokens:" << std::endl;
-        for (const auto &token : tokenizer.getTokens()) {
-            std::string typeStr;
-            switch (token.type) {
-            case Token::Type::Name: typeStr = "Name  "; break;
-            case Token::Type::Number: typeStr = "Number"; break;
-            case Token::Type::Symbol: typeStr = "Symbol"; break;
-            default: typeStr = "Unknown"; break;
-            }
-            std::cout << "  [" << typeStr << "] " << token.value << std::endl;
-        }
-    }
-    else {
-        std::cout << "Errors occurred during tokenization:" << std::endl;
-        for (const auto &error : tokenizer.getErrors()) {
-            std::cout << error.getMessage() << std::endl;
-        }
-    }
-}
-
-// New function to handle the 'parse' command
-void handleParseCommand(const std::string &filename) {
-    std::string fullFilePath = directoryPath + filename + ".asm";
-
-    Parser parser(fullFilePath);
-
-    if (parser.parse()) {
-        std::cout << "Successfully parsed: " << filename << ".asm" << std::endl;
-        std::cout << "Commands:" << std::endl;
-        for (const auto &command : parser.getCommands()) {
-            std::cout << command.toString() << std::endl;
-        }
-    }
-    else {
-        std::cout << "Errors occurred during parsing:" << std::endl;
-        for (const auto &error : parser.getErrors()) {
-            std::cout << error.getMessage() << std::endl;
-        }
-    }
-}
-void handleLinkCommand(const std::string &filename) {
-    std::string fullFilePath = directoryPath + filename + ".asm";
-
-    Linker linker(fullFilePath);
-
-    if (linker.link()) {
-        std::cout << "Successfully linked: " << filename << ".asm" << std::endl;
-        std::cout << "Linked commands:" << std::endl;
-        for (const auto &command : linker.getCommands()) {
-            std::cout << command.toString() << std::endl;
-        }
-    }
-    else {
-        std::cout << "Errors occurred during linking:" << std::endl;
-        for (const auto &error : linker.getErrors()) {
-            std::cout << error.getMessage() << std::endl;
-        }
-    }
-}
-
-void processCommand(const std::string &input) {
-    std::istringstream iss(input);
-    std::string command;
-    iss >> command;
-
-    // Convert command to lowercase for case-insensitive comparison
-    std::transform(command.begin(), command.end(), command.begin(), ::tolower);
-
-    if (command == "exit") {
-        std::cout << "Exiting the program." << std::endl;
-        exit(0);
-    }
-    else if (command == "list") {
-        handleListCommand();
-    }
-    else if (command == "tokenize") {
-        std::string filename;
-        iss >> filename;
-        if (filename.empty()) {
-            displayError("You must specify a filename to tokenize. Usage: tokenize <file>");
-        }
-        else {
-            handleTokenizeCommand(filename);
-        }
-    }
-    else if (command == "parse") {
-        std::string filename;
-        iss >> filename;
-        if (filename.empty()) {
-            displayError("You must specify a filename to parse. Usage: parse <file>");
-        }
-        else {
-            handleParseCommand(filename);
-        }
-    }
-    else if (command == "link") {
-        std::string filename;
-        iss >> filename;
-        if (filename.empty()) {
-            displayError("You must specify a filename to link. Usage: link <file>");
-        }
-        else {
-            handleLinkCommand(filename);
-        }
-    }
-    else {
-        displayError("Unknown command: " + command);
-    }
-}
-
-int main() {
-    std::string input;
-
-    std::cout << "Welcome to the Assembly Tokenizer and Parser CLI!" << std::endl;
-    std::cout << "Type 'exit' to quit, 'list' to list files, 'tokenize <filename>' to tokenize an assembly file, or 'parse <filename>' to parse a file." << std::endl;
-
-    while (true) {
-        std::cout << "$ ";  // Prompt for user input
-        std::getline(std::cin, input);
-
-        if (!input.empty()) {
-            processCommand(input);
-        }
-    }
-
-    return 0;
-}
+#include "Token.hpp"
+#include "Parser.hpp"
+#include "Linker.hpp"
+#include "Optimizer.hpp"
+#include "Scheduler.hpp"
+#include "ControlFlowGraph.hpp"
+#include "Emulator.hpp"
+#include "BatchRunner.hpp"
+#include "Disassembler.hpp"
+#include "AssemblerDaemon.hpp"
+#include "AllocationTracker.hpp"
+#include "Watcher.hpp"
+#include "MultiHartEmulator.hpp"
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <memory>
+#include <iomanip>
+#include <cmath>
+
+static const std::string directoryPath = "C:/assembly/";
+static std::vector<std::string> includePaths;      // searched after the directory of the root file
+static int exitStatus = 0;                          // of a command given on the command line
+static const uint64_t DEFAULT_DEBUG_STOPS = 100;
+static const uint64_t DEFAULT_TRACE_DUMP = 20;
+static const uint64_t BENCH_STEP_LIMIT = 1ull << 32;
+static const unsigned DEFAULT_BENCH_REPEATS = 3;
+
+void displayError(const std::string &message) {
+    std::cout << "Error: " << message << std::endl;
+    std::cout << "Available commands: " << std::endl;
+    std::cout << "  exit              - Exit the program" << std::endl;
+    std::cout << "  list              - List all files in the directory" << std::endl;
+    std::cout << "  includepath <directory>    - Search a directory for includes not found next to the root file" << std::endl;
+    std::cout << "  tokenize <file>   - Tokenize a file with .asm extension" << std::endl;
+    std::cout << "  parse <file>      - Parse a file with .asm extension" << std::endl;
+    std::cout << "  optimize <file>   - Link a file and run the peephole optimizer over it" << std::endl;
+    std::cout << "  analyze <file> [latencies] - Print basic blocks, loops and static cycle estimates" << std::endl;
+    std::cout << "  schedule <file> [latencies] - Reorder instructions to avoid pipeline stalls and assemble the result" << std::endl;
+    std::cout << "  memmap <file>              - Link a file and print where its org segments were placed" << std::endl;
+    std::cout << "  check <file>               - Link a file and list all of its errors with their columns" << std::endl;
+    std::cout << "  assemble <file>            - Encode a file into <file>.bin with its labels in <file>.sym" << std::endl;
+    std::cout << "  disassemble <file> [threads] - List <file>.bin with the labels of <file>.sym into <file>.dis" << std::endl;
+    std::cout << "  run <file> [steps] [input] - Link a file and execute it with console, input and counter devices" << std::endl;
+    std::cout << "  multirun <file> <harts> [quantum] [steps] - Run a file on several harts over shared memory, one thread each" << std::endl;
+    std::cout << "  profile <file> [period]    - Execute a file and print its flat profile, folded stacks and branch profile" << std::endl;
+    std::cout << "  pgo <file>                 - Lay out the blocks of a file for the branch profile in <file>.prof" << std::endl;
+    std::cout << "  batch <file> <inputs> [threads] [steps] - Run a file once per input file in a directory" << std::endl;
+    std::cout << "  irqbench <file> <period>   - Compare throughput with and without a timer interrupt on line 0" << std::endl;
+    std::cout << "  bench <directory> [repeats]  - Run every program in a directory and report MIPS and peak heap" << std::endl;
+    std::cout << "  memprofile <file>          - Link and load a file reporting allocations and peak heap per phase" << std::endl;
+    std::cout << "  xref <file>                - Write the symbol definitions, uses and calls of a file to <file>.xref" << std::endl;
+    std::cout << "  xquery <file> <symbol>     - Look a symbol up in <file>.xref" << std::endl;
+    std::cout << "  watch <file> [rebuilds]    - Assemble a file again whenever it or an include changes" << std::endl;
+    std::cout << "  serve <socket> [threads]   - Serve assemble and link requests on a Unix socket until shut down" << std::endl;
+    std::cout << "  request <socket> <request> - Send assemble <file>, link <file>, stats or shutdown to a server" << std::endl;
+    std::cout << "  trace <file> [records]     - Execute a file keeping its last records instructions in <file>.trace" << std::endl;
+    std::cout << "  tracedump <file> [count]   - Print the last count instructions of a trace with their source lines" << std::endl;
+    std::cout << "  debug <file> [points]      - Run a file reporting breakpoints (b:<loc>) and watchpoints (r:, w:, rw:<loc>)" << std::endl;
+}
+
+void handleListCommand() {
+    try {
+        std::cout << "Files in directory '" << directoryPath << "':" << std::endl;
+        for (const auto &entry : std::filesystem::directory_iterator(directoryPath)) {
+            if (entry.is_regular_file()) {
+                std::cout << "  " << entry.path().filename().string() << std::endl;
+            }
+        }
+    }
+    catch (const std::filesystem::filesystem_error &e) {
+        displayError("Could not access the directory: " + std::string(e.what()));
+    }
+}
+
+void handleTokenizeCommand(const std::string &filename) {
+    std::string fullFilePath = directoryPath + filename + ".asm";
+
+    Tokenizer tokenizer(fullFilePath);
+
+    if (tokenizer.tokenize()) {
+        std::cout << "Successfully tokenized: " << filename << ".asm" << std::endl;
+        std::cout << "Tokens:" << std::endl;
+        for (const auto &token : tokenizer.getTokens()) {
+            std::string typeStr;
+            switch (token.type) {
+            case Token::Type::Name: typeStr = "Name  "; break;
+            case Token::Type::Number: typeStr = "Number"; break;
+            case Token::Type::Symbol: typeStr = "Symbol"; break;
+            default: typeStr = "Unknown"; break;
+            }
+            std::cout << "  [" << typeStr << "] " << token.value << std::endl;
+        }
+    }
+    else {
+        std::cout << "Errors occurred during tokenization:" << std::endl;
+        for (const auto &error : tokenizer.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+    }
+}
+
+// New function to handle the 'parse' command
+void handleParseCommand(const std::string &filename) {
+    std::string fullFilePath = directoryPath + filename + ".asm";
+
+    Parser parser(fullFilePath);
+
+    if (parser.parse()) {
+        std::cout << "Successfully parsed: " << filename << ".asm" << std::endl;
+        std::cout << "Commands:" << std::endl;
+        for (const auto &command : parser.getCommands()) {
+            std::cout << command.toString() << std::endl;
+        }
+    }
+    else {
+        std::cout << "Errors occurred during parsing:" << std::endl;
+        for (const auto &error : parser.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+    }
+}
+void addIncludePaths(Linker &linker) {
+    for (const auto &path : includePaths) {
+        linker.addIncludePath(path);
+    }
+}
+
+void handleIncludePathCommand(const std::string &path) {
+    std::filesystem::path directory(path);
+    includePaths.push_back(directory.is_absolute() ? path : directoryPath + path);
+    std::cout << "Include paths:" << std::endl;
+    for (const auto &includePath : includePaths) {
+        std::cout << "  " << includePath << std::endl;
+    }
+}
+
+void handleLinkCommand(const std::string &filename) {
+    std::string fullFilePath = directoryPath + filename + ".asm";
+
+    Linker linker(fullFilePath);
+    addIncludePaths(linker);
+
+    if (linker.link()) {
+        std::cout << "Successfully linked: " << filename << ".asm" << std::endl;
+        std::cout << "Linked commands:" << std::endl;
+        for (const auto &command : linker.getCommands()) {
+            std::cout << command.toString() << std::endl;
+        }
+    }
+    else {
+        std::cout << "Errors occurred during linking:" << std::endl;
+        for (const auto &error : linker.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+    }
+}
+
+void handleOptimizeCommand(const std::string &filename) {
+    std::string fullFilePath = directoryPath + filename + ".asm";
+
+    Linker linker(fullFilePath);
+    addIncludePaths(linker);
+
+    if (!linker.link()) {
+        std::cout << "Errors occurred during linking:" << std::endl;
+        for (const auto &error : linker.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+
+    Optimizer optimizer(linker.getCommands(), linker.getSymbolTable());
+    optimizer.optimize();
+
+    std::cout << "Successfully optimized: " << filename << ".asm" << std::endl;
+    std::cout << "Optimized commands:" << std::endl;
+    for (const auto &command : optimizer.getCommands()) {
+        std::cout << command.toString() << std::endl;
+    }
+    std::cout << "Removed instructions: " << optimizer.getRemovedInstructions() << std::endl;
+    std::cout << "Saved words: " << optimizer.getSavedWords() << std::endl;
+    std::cout << "Saved cycles (static): " << optimizer.getSavedCycles() << std::endl;
+    for (const auto &hit : optimizer.getRuleHits()) {
+        std::cout << "  " << hit.first << ": " << hit.second << std::endl;
+    }
+}
+
+void handleAnalyzeCommand(const std::string &filename, const std::string &latencyFilename) {
+    std::string fullFilePath = directoryPath + filename + ".asm";
+
+    LatencyTable latencies;
+    if (!latencyFilename.empty() && !latencies.load(directoryPath + latencyFilename)) {
+        std::cout << "Errors occurred while loading latencies:" << std::endl;
+        for (const auto &error : latencies.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+
+    Linker linker(fullFilePath);
+    addIncludePaths(linker);
+
+    if (!linker.link()) {
+        std::cout << "Errors occurred during linking:" << std::endl;
+        for (const auto &error : linker.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+
+    ControlFlowGraph graph(linker.getCommands(), latencies);
+    graph.build();
+    std::cout << graph.report();
+}
+
+// Reorders the linked program for an in-order pipeline and writes it out
+// like assemble does
+void handleScheduleCommand(const std::string &filename, const std::string &latencyFilename) {
+    std::string fullFilePath = directoryPath + filename + ".asm";
+
+    LatencyTable latencies;
+    if (!latencyFilename.empty() && !latencies.load(directoryPath + latencyFilename)) {
+        std::cout << "Errors occurred while loading latencies:" << std::endl;
+        for (const auto &error : latencies.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+
+    Linker linker(fullFilePath);
+    addIncludePaths(linker);
+
+    if (!linker.link()) {
+        std::cout << "Errors occurred during linking:" << std::endl;
+        for (const auto &error : linker.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+
+    Scheduler scheduler(linker.getCommands(), latencies);
+    scheduler.schedule();
+
+    Program program(scheduler.getCommands(), linker.getSymbolTable(), linker.getSourceFiles());
+    std::string imagePath = directoryPath + filename + ".bin";
+    std::string symbolPath = directoryPath + filename + ".sym";
+    if (!program.load() || !program.writeImage(imagePath) || !program.writeSymbols(symbolPath)) {
+        for (const auto &error : program.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    std::cout << "Scheduled " << scheduler.getScheduledBlockCount() << " of " << scheduler.getBlockCount()
+        << " blocks, moved " << scheduler.getMovedInstructions() << " instructions" << std::endl;
+    std::cout << "Estimated cycles (static, one pass over every block): " << scheduler.getOriginalCycles() << " -> "
+        << scheduler.getScheduledCycles() << ", saved " << scheduler.getSavedCycles() << std::endl;
+    std::cout << "Wrote " << program.getImageWordCount() << " words to " << imagePath << " and symbols to " << symbolPath << std::endl;
+}
+
+std::unique_ptr<Program> loadProgram(const std::string &filename) {
+    std::string fullFilePath = directoryPath + filename + ".asm";
+
+    Linker linker(fullFilePath);
+    addIncludePaths(linker);
+
+    if (!linker.link()) {
+        std::cout << "Errors occurred during linking:" << std::endl;
+        for (const auto &error : linker.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return nullptr;
+    }
+
+    AllocationScope scope("program");
+    auto program = std::make_unique<Program>(linker.getCommands(), linker.getSymbolTable(), linker.getSourceFiles());
+    if (!program->load()) {
+        std::cout << "Errors occurred while loading the program:" << std::endl;
+        for (const auto &error : program->getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return nullptr;
+    }
+    return program;
+}
+
+void printRunResult(const Emulator &emulator, double seconds) {
+    switch (emulator.getState()) {
+    case Emulator::State::Halted: std::cout << "Program halted" << std::endl; break;
+    case Emulator::State::StepLimit: std::cout << "Step limit reached" << std::endl; break;
+    case Emulator::State::Breakpoint:
+    case Emulator::State::Watchpoint: std::cout << "Stopped at " << (emulator.getState() == Emulator::State::Breakpoint ? "a breakpoint" : "a watchpoint") << std::endl; break;
+    default: break;
+    }
+    for (const auto &error : emulator.getErrors()) {
+        std::cout << error.getMessage() << std::endl;
+    }
+    for (int i = 1; i < Emulator::REGISTER_COUNT; ++i) {
+        if (emulator.getRegister(i)) {
+            std::cout << "  r" << i << " = " << emulator.getRegister(i) << std::endl;
+        }
+    }
+    std::cout << "Instructions: " << emulator.getInstructionCount() << ", Cycles: " << emulator.getCycleCount() << std::endl;
+    if (seconds > 0) {
+        std::cout << "MIPS: " << emulator.getInstructionCount() / seconds / 1e6 << std::endl;
+    }
+}
+
+void handleAssembleCommand(const std::string &filename) {
+    std::unique_ptr<Program> program = loadProgram(filename);
+    if (!program) {
+        return;
+    }
+    std::string imagePath = directoryPath + filename + ".bin";
+    std::string symbolPath = directoryPath + filename + ".sym";
+    if (!program->writeImage(imagePath) || !program->writeSymbols(symbolPath)) {
+        for (const auto &error : program->getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    std::cout << "Wrote " << program->getImageWordCount() << " words to " << imagePath << " and symbols to " << symbolPath << std::endl;
+}
+
+// The symbol file is optional, without it operands stay numeric
+void handleDisassembleCommand(const std::string &filename, unsigned threads) {
+    Disassembler disassembler(threads);
+    std::string symbolPath = directoryPath + filename + ".sym";
+    bool loaded = (!std::filesystem::exists(symbolPath) || disassembler.loadSymbols(symbolPath)) &&
+        disassembler.loadImage(directoryPath + filename + ".bin");
+    std::string listingPath = directoryPath + filename + ".dis";
+    if (!loaded || !disassembler.disassemble(listingPath)) {
+        for (const auto &error : disassembler.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    uint64_t words = disassembler.getInstructionCount() + disassembler.getDataWordCount();
+    double seconds = disassembler.getElapsedSeconds();
+    std::cout << "Wrote " << disassembler.getInstructionCount() << " instructions and " << disassembler.getDataWordCount()
+        << " data words to " << listingPath << " in " << seconds << " s with " << disassembler.getThreadCount() << " threads";
+    if (seconds > 0) {
+        std::cout << " (" << std::fixed << std::setprecision(1) << words * sizeof(uint32_t) / seconds / 1e6 << " MB/s in, "
+            << disassembler.getOutputBytes() / seconds / 1e6 << " MB/s out)" << std::defaultfloat;
+    }
+    std::cout << std::endl;
+}
+
+// Console, input and counter devices sit at their default bases, the input
+// device reads from the given file when there is one
+void handleRunCommand(const std::string &filename, uint64_t maxSteps, const std::string &inputFilename) {
+    std::unique_ptr<Program> program = loadProgram(filename);
+    if (!program) {
+        return;
+    }
+    InputDevice input;
+    if (!inputFilename.empty() && !input.load(directoryPath + inputFilename)) {
+        for (const auto &error : input.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    Emulator emulator(*program);
+    ConsoleDevice console(std::cout);
+    CycleCounterDevice counter(emulator);
+    emulator.getMemory().mapDevice(ConsoleDevice::DEFAULT_BASE, &console);
+    emulator.getMemory().mapDevice(InputDevice::DEFAULT_BASE, &input);
+    emulator.getMemory().mapDevice(CycleCounterDevice::DEFAULT_BASE, &counter);
+    auto start = std::chrono::steady_clock::now();
+    emulator.run(maxSteps);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printRunResult(emulator, elapsed.count());
+}
+
+// The harts share the console, output of one quantum may interleave with
+// that of the others
+void handleMultiRunCommand(const std::string &filename, unsigned hartCount, uint64_t quantum, uint64_t maxSteps) {
+    std::unique_ptr<Program> program = loadProgram(filename);
+    if (!program) {
+        return;
+    }
+    MultiHartEmulator machine(*program, hartCount, quantum);
+    ConsoleDevice console(std::cout);
+    machine.getMemory().mapDevice(ConsoleDevice::DEFAULT_BASE, &console);
+    machine.run(maxSteps);
+
+    for (size_t i = 0; i < machine.getHartCount(); ++i) {
+        const Emulator &hart = machine.getHart(i);
+        const char *state = hart.getState() == Emulator::State::Halted ? "halted" :
+            hart.getState() == Emulator::State::StepLimit ? "step limit" : "fault";
+        std::cout << "Hart " << i << ": " << state << ", a0 = " << hart.getRegister(MultiHartEmulator::REGISTER_HART)
+            << ", Instructions: " << hart.getInstructionCount() << ", Cycles: " << hart.getCycleCount() << std::endl;
+        for (const auto &error : hart.getErrors()) {
+            std::cout << "  " << error.getMessage() << std::endl;
+        }
+    }
+    double seconds = machine.getElapsedSeconds();
+    std::cout << "Instructions: " << machine.getInstructionCount() << " in " << machine.getQuantumCount() << " quanta" << std::endl;
+    if (seconds > 0) {
+        std::cout << "MIPS: " << machine.getInstructionCount() / seconds / 1e6 << " on " << machine.getHartCount() << " harts" << std::endl;
+    }
+}
+
+void handleProfileCommand(const std::string &filename, uint32_t samplePeriod) {
+    std::unique_ptr<Program> program = loadProgram(filename);
+    if (!program) {
+        return;
+    }
+    Profiler profiler(*program, samplePeriod);
+    Emulator emulator(*program);
+    emulator.setProfiler(&profiler);
+    auto start = std::chrono::steady_clock::now();
+    emulator.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printRunResult(emulator, elapsed.count());
+    std::cout << profiler.flatProfile();
+    std::cout << "Taken branches: " << profiler.getTakenBranchCount() << std::endl;
+
+    std::string foldedPath = directoryPath + filename + ".folded";
+    std::ofstream folded(foldedPath);
+    profiler.writeFoldedStacks(folded);
+    std::cout << "Folded stacks written to " << foldedPath << std::endl;
+
+    std::string branchPath = directoryPath + filename + ".prof";
+    BranchProfile branches = profiler.getBranchProfile();
+    if (!branches.save(branchPath)) {
+        for (const auto &error : branches.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    std::cout << "Branch profile of " << branches.size() << " branches written to " << branchPath << std::endl;
+}
+
+// Lays the blocks out for the branch profile the profile command wrote, then
+// runs the program in both layouts to measure the taken branches
+void handlePgoCommand(const std::string &filename) {
+    BranchProfile branches;
+    if (!branches.load(directoryPath + filename + ".prof")) {
+        std::cout << "Errors occurred while loading the branch profile:" << std::endl;
+        for (const auto &error : branches.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+
+    Linker linker(directoryPath + filename + ".asm");
+    addIncludePaths(linker);
+    linker.setBranchProfile(&branches);
+    if (!linker.link()) {
+        std::cout << "Errors occurred during linking:" << std::endl;
+        for (const auto &error : linker.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    Program program(linker.getCommands(), linker.getSymbolTable(), linker.getSourceFiles());
+    std::string imagePath = directoryPath + filename + ".bin";
+    std::string symbolPath = directoryPath + filename + ".sym";
+    if (!program.load() || !program.writeImage(imagePath) || !program.writeSymbols(symbolPath)) {
+        for (const auto &error : program.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    const BlockOrderStatistics &statistics = linker.getBlockOrderStatistics();
+    std::cout << "Moved " << statistics.movedBlocks << " of " << statistics.blocks << " blocks, inverted "
+        << statistics.invertedBranches << " branches, added " << statistics.insertedJumps << " and removed "
+        << statistics.removedJumps << " jumps" << std::endl;
+    std::cout << "Taken branches (estimated from the profile): " << statistics.takenBefore << " -> "
+        << statistics.takenAfter << std::endl;
+    std::cout << "Wrote " << program.getImageWordCount() << " words to " << imagePath << " and symbols to " << symbolPath << std::endl;
+
+    std::unique_ptr<Program> original = loadProgram(filename);
+    if (!original) {
+        return;
+    }
+    const Program *layouts[] = { original.get(), &program };
+    const char *names[] = { "Source order", "Profile order" };
+    for (size_t i = 0; i < 2; ++i) {
+        Profiler profiler(*layouts[i]);
+        Emulator emulator(*layouts[i]);
+        emulator.setProfiler(&profiler);
+        emulator.run();
+        std::cout << std::left << std::setw(15) << names[i] << std::right << "Taken branches: " << std::setw(12)
+            << profiler.getTakenBranchCount() << " Instructions: " << std::setw(12) << emulator.getInstructionCount()
+            << " Cycles: " << emulator.getCycleCount() << std::endl;
+    }
+}
+
+void handleBatchCommand(const std::string &filename, const std::string &inputDirectory, unsigned threads, uint64_t maxSteps) {
+    std::unique_ptr<Program> program = loadProgram(filename);
+    if (!program) {
+        return;
+    }
+
+    std::vector<BatchInput> inputs;
+    std::vector<Error> errors;
+    try {
+        for (const auto &entry : std::filesystem::directory_iterator(directoryPath + inputDirectory)) {
+            if (entry.is_regular_file()) {
+                inputs.emplace_back();
+                BatchRunner::loadInput(entry.path().string(), *program, inputs.back(), errors);
+            }
+        }
+    }
+    catch (const std::filesystem::filesystem_error &e) {
+        displayError("Could not access the directory: " + std::string(e.what()));
+        return;
+    }
+    if (!errors.empty()) {
+        std::cout << "Errors occurred while loading inputs:" << std::endl;
+        for (const auto &error : errors) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    std::sort(inputs.begin(), inputs.end(), [](const BatchInput &a, const BatchInput &b) {
+        return a.name < b.name;
+        });
+
+    BatchRunner runner(*program, threads);
+    runner.setStepLimit(maxSteps);
+    std::vector<BatchResult> results = runner.run(inputs);
+
+    size_t halted = 0, faulted = 0, limited = 0;
+    uint64_t instructions = 0;
+    for (const auto &result : results) {
+        instructions += result.instructions;
+        switch (result.state) {
+        case Emulator::State::Halted: halted++; break;
+        case Emulator::State::StepLimit: limited++; break;
+        default: faulted++; break;
+        }
+        if (result.state != Emulator::State::Halted) {
+            std::cout << "  " << result.name << ": " << (result.error.empty() ? "step limit reached" : result.error) << std::endl;
+        }
+    }
+    std::cout << "Instances: " << results.size() << " on " << runner.getThreadCount() << " threads" << std::endl;
+    std::cout << "Halted: " << halted << ", Faulted: " << faulted << ", Step limit: " << limited << std::endl;
+    std::cout << "Instructions: " << instructions << ", Time: " << runner.getElapsedSeconds() << " s";
+    if (runner.getElapsedSeconds() > 0) {
+        std::cout << ", MIPS: " << instructions / runner.getElapsedSeconds() / 1e6;
+    }
+    std::cout << std::endl;
+}
+
+void handleInterruptBenchmarkCommand(const std::string &filename, uint64_t period) {
+    std::unique_ptr<Program> program = loadProgram(filename);
+    if (!program) {
+        return;
+    }
+
+    Emulator emulator(*program);
+    auto start = std::chrono::steady_clock::now();
+    emulator.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Without interrupts:" << std::endl;
+    printRunResult(emulator, elapsed.count());
+
+    InterruptController interrupts;
+    TimerDevice timer(interrupts, 0, period);
+    emulator.reset();
+    emulator.setInterruptController(&interrupts);
+    timer.start(0);
+    start = std::chrono::steady_clock::now();
+    emulator.run();
+    elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "With a timer every " << period << " cycles:" << std::endl;
+    printRunResult(emulator, elapsed.count());
+    std::cout << "Timer ticks: " << timer.getTickCount() << ", Interrupts delivered: " << interrupts.getDeliveredCount() << std::endl;
+}
+
+// Tracks the heap while a file is linked and loaded, the way run would
+// prepare it, and reports it per phase
+void handleMemoryProfileCommand(const std::string &filename) {
+    AllocationTracker::enable();
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<Program> program = loadProgram(filename);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    AllocationTracker::disable();
+    if (!program) {
+        return;
+    }
+    std::cout << AllocationTracker::report();
+    std::cout << "Linked and loaded " << program->getImageWordCount() << " words in " << std::fixed << std::setprecision(2)
+        << elapsed.count() * 1e3 << " ms" << std::defaultfloat << std::endl;
+}
+
+void handleMemoryMapCommand(const std::string &filename) {
+    std::string fullFilePath = directoryPath + filename + ".asm";
+    Linker linker(fullFilePath);
+    addIncludePaths(linker);
+    if (!linker.link()) {
+        std::cout << "Errors occurred during linking:" << std::endl;
+        for (const auto &error : linker.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    std::cout << Layout::memoryMap(linker.getSegments(), linker.getSourceFiles());
+}
+
+// Links a file without loading it and lists every diagnostic with its column,
+// so all mistakes of a build can be fixed in one pass
+void handleCheckCommand(const std::string &filename) {
+    std::string fullFilePath = directoryPath + filename + ".asm";
+    Linker linker(fullFilePath);
+    addIncludePaths(linker);
+    bool linked = linker.link();
+    const Diagnostics &diagnostics = linker.getDiagnostics();
+    for (const Diagnostic &diagnostic : diagnostics.getDiagnostics()) {
+        std::cout << diagnostics.format(diagnostic) << std::endl;
+    }
+    std::cout << (linked ? "No errors" : diagnostics.formatSummary()) << std::endl;
+    exitStatus = linked ? 0 : 1;
+}
+
+void handleXrefCommand(const std::string &filename) {
+    std::string fullFilePath = directoryPath + filename + ".asm";
+    Linker linker(fullFilePath);
+    addIncludePaths(linker);
+    if (!linker.link()) {
+        std::cout << "Errors occurred during linking:" << std::endl;
+        for (const auto &error : linker.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    CrossReference xref = linker.buildCrossReference();
+    std::string xrefPath = directoryPath + filename + ".xref";
+    if (!xref.write(xrefPath)) {
+        for (const auto &error : xref.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    std::cout << "Wrote " << xref.getSymbolCount() << " symbols, " << xref.getUseCount() << " uses and "
+        << xref.getEdgeCount() << " call edges to " << xrefPath << std::endl;
+}
+
+void handleXqueryCommand(const std::string &filename, const std::string &name) {
+    CrossReferenceIndex index;
+    if (!index.open(directoryPath + filename + ".xref")) {
+        for (const auto &error : index.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    const XrefSymbol *symbol = index.find(name);
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    if (!symbol) {
+        std::cout << "No symbol " << name << std::endl;
+        return;
+    }
+    auto where = [&index](uint32_t file, int line) {
+        std::ostringstream oss;
+        oss << index.getFilename(file) << ":" << line;
+        return oss.str();
+    };
+    std::cout << name << " = 0x" << std::hex << std::setw(8) << std::setfill('0') << symbol->value << std::dec << std::setfill(' ')
+        << (symbol->kind == CrossReference::LABEL ? ", label at " : ", defined at ") << where(symbol->file, symbol->line)
+        << " (found in " << elapsed.count() << " us)" << std::endl;
+    std::cout << "Uses: " << symbol->useCount << std::endl;
+    const XrefUse *uses = index.getUses(*symbol);
+    for (uint32_t i = 0; i < symbol->useCount; ++i) {
+        const XrefUse &use = uses[i];
+        std::cout << "  " << where(use.file, use.line) << "  "
+            << (use.opcode == CrossReference::NO_OPCODE ? std::string_view("directive") : INSTRUCTION_TABLE[use.opcode].mnemonic)
+            << " " << toString(static_cast<AddressingMode>(use.mode));
+        if (use.routine != CrossReference::NONE) {
+            std::cout << " in " << index.getName(index.getSymbol(use.routine));
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "Calls:";
+    for (uint32_t i = 0; i < symbol->calleeCount; ++i) {
+        std::cout << " " << index.getName(index.getSymbol(index.getCallees(*symbol)[i]));
+    }
+    std::cout << std::endl << "Called by:";
+    for (uint32_t i = 0; i < symbol->callerCount; ++i) {
+        std::cout << " " << index.getName(index.getSymbol(index.getCallers(*symbol)[i]));
+    }
+    std::cout << std::endl;
+}
+
+void handleWatchCommand(const std::string &filename, uint64_t maxRebuilds) {
+    Watcher watcher(directoryPath + filename + ".asm", std::cout);
+    for (const auto &path : includePaths) {
+        watcher.addIncludePath(path);
+    }
+    std::cout << "Watching " << filename << ", press Enter to stop" << std::endl;
+    if (!watcher.watch(maxRebuilds)) {
+        for (const auto &error : watcher.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        exitStatus = 1;
+        return;
+    }
+    std::cout << "Stopped watching after " << watcher.getRebuildCount() << " rebuilds" << std::endl;
+}
+
+void handleServeCommand(const std::string &socketPath, unsigned threads) {
+    AssemblerDaemon daemon(socketPath, directoryPath, threads);
+    for (const auto &path : includePaths) {
+        daemon.addIncludePath(path);
+    }
+    std::cout << "Serving on " << socketPath << std::endl;
+    if (!daemon.serve()) {
+        for (const auto &error : daemon.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    std::cout << "Server stopped" << std::endl;
+}
+
+void handleRequestCommand(const std::string &socketPath, const std::string &request) {
+    exitStatus = AssemblerDaemon::request(socketPath, request, std::cout) ? 0 : 1;
+}
+
+// Every .asm file in the directory is linked, loaded and run repeats times from
+// a reset; the fastest run counts. Throughput is summarised as a geometric mean
+// so no single program dominates. Peak is the heap high-water mark of linking
+// and loading, so memory regressions of the front end show up here too.
+void handleBenchCommand(const std::string &directory, unsigned repeats) {
+    std::vector<std::string> names;
+    try {
+        for (const auto &entry : std::filesystem::directory_iterator(directoryPath + directory)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".asm") {
+                names.push_back(entry.path().stem().string());
+            }
+        }
+    }
+    catch (const std::filesystem::filesystem_error &e) {
+        std::cout << "Error accessing directory: " << e.what() << std::endl;
+        return;
+    }
+    std::sort(names.begin(), names.end());
+
+    double logSum = 0;
+    int measured = 0;
+    std::cout << std::left << std::setw(16) << "Program" << std::right << std::setw(14) << "Instructions"
+        << std::setw(14) << "Cycles" << std::setw(12) << "Time (ms)" << std::setw(10) << "MIPS" << std::setw(12) << "Peak (KiB)" << std::endl;
+    for (const auto &name : names) {
+        AllocationTracker::enable();
+        std::unique_ptr<Program> program = loadProgram(directory + "/" + name);
+        AllocationTracker::disable();
+        if (!program) {
+            continue;
+        }
+        Emulator emulator(*program);
+        double best = 0;
+        for (unsigned i = 0; i < std::max(repeats, 1u); ++i) {
+            emulator.reset();
+            auto start = std::chrono::steady_clock::now();
+            emulator.run(BENCH_STEP_LIMIT);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (i == 0 || elapsed.count() < best) {
+                best = elapsed.count();
+            }
+        }
+        if (emulator.getState() != Emulator::State::Halted) {
+            printRunResult(emulator, 0);
+            continue;
+        }
+        double mips = best > 0 ? emulator.getInstructionCount() / best / 1e6 : 0;
+        std::cout << std::left << std::setw(16) << name << std::right << std::setw(14) << emulator.getInstructionCount()
+            << std::setw(14) << emulator.getCycleCount() << std::setw(12) << std::fixed << std::setprecision(2) << best * 1e3
+            << std::setw(10) << mips << std::setw(12) << AllocationTracker::getPeakBytes() / 1024.0 << std::defaultfloat << std::endl;
+        if (mips > 0) {
+            logSum += std::log(mips);
+            measured++;
+        }
+    }
+    if (measured) {
+        std::cout << "Geometric mean: " << std::fixed << std::setprecision(2) << std::exp(logSum / measured) << " MIPS" << std::defaultfloat << std::endl;
+    }
+}
+
+void handleTraceCommand(const std::string &filename, uint32_t fileRecords) {
+    std::unique_ptr<Program> program = loadProgram(filename);
+    if (!program) {
+        return;
+    }
+    std::string tracePath = directoryPath + filename + ".trace";
+    Tracer tracer(fileRecords);
+    if (!tracer.open(tracePath)) {
+        for (const auto &error : tracer.getErrors()) {
+            std::cout << error.getMessage() << std::endl;
+        }
+        return;
+    }
+    Emulator emulator(*program);
+    emulator.setTracer(&tracer);
+    auto start = std::chrono::steady_clock::now();
+    emulator.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    tracer.close();
+    printRunResult(emulator, elapsed.count());
+    for (const auto &error : tracer.getErrors()) {
+        std::cout << error.getMessage() << std::endl;
+    }
+    std::cout << "Trace written to " << tracePath << ", Records: " << tracer.getWrittenCount()
+        << ", Dropped: " << tracer.getDroppedCount() << std::endl;
+}
+
+void handleTraceDumpCommand(const std::string &filename, uint64_t count) {
+    std::unique_ptr<Program> program = loadProgram(filename);
+    if (!program) {
+        return;
+    }
+    std::vector<Error> errors;
+    Tracer::decode(directoryPath + filename + ".trace", *program, std::cout, count, errors);
+    for (const auto &error : errors) {
+        std::cout << error.getMessage() << std::endl;
+    }
+}
+
+// Points are b:<location> for a breakpoint and r:, w: or rw: for a watchpoint,
+// a location is a label or a number. Stops are reported until the program ends.
+void handleDebugCommand(const std::string &filename, const std::vector<std::string> &points, uint64_t maxStops) {
+    std::unique_ptr<Program> program = loadProgram(filename);
+    if (!program) {
+        return;
+    }
+    Emulator emulator(*program);
+    for (const auto &point : points) {
+        size_t colon = point.find(':');
+        std::string kind = colon == std::string::npos ? "" : point.substr(0, colon);
+        std::string location = colon == std::string::npos ? point : point.substr(colon + 1);
+        uint32_t address;
+        if (!program->findSymbol(location, address)) {
+            try {
+                address = static_cast<uint32_t>(std::stoul(location, nullptr, 0));
+            }
+            catch (const std::exception &) {
+                std::cout << "Unknown location: " << location << std::endl;
+                return;
+            }
+        }
+        if (kind == "b") {
+            if (!emulator.addBreakpoint(address)) {
+                std::cout << "No instruction at " << program->describeAddress(address) << std::endl;
+                return;
+            }
+        }
+        else if (kind == "r" || kind == "w" || kind == "rw") {
+            emulator.addWatchpoint(address, (kind != "w" ? Memory::WATCH_READ : 0) | (kind != "r" ? Memory::WATCH_WRITE : 0));
+        }
+        else {
+            std::cout << "Unknown point: " << point << std::endl;
+            return;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t stops = 0; stops < maxStops; ++stops) {
+        Emulator::State state = emulator.run();
+        if (state == Emulator::State::Breakpoint) {
+            std::cout << "Breakpoint at " << program->describeAddress(emulator.getPc()) << std::endl;
+        }
+        else if (state == Emulator::State::Watchpoint) {
+            const Memory::WatchHit &hit = emulator.getWatchHit();
+            std::cout << (hit.write ? "Write to " : "Read from ") << program->describeAddress(hit.address)
+                << " at " << program->describeAddress(emulator.getPc()) << std::endl;
+        }
+        else {
+            break;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printRunResult(emulator, elapsed.count());
+}
+
+void processCommand(const std::string &input) {
+    std::istringstream iss(input);
+    std::string command;
+    iss >> command;
+
+    // Convert command to lowercase for case-insensitive comparison
+    std::transform(command.begin(), command.end(), command.begin(), ::tolower);
+
+    if (command == "exit") {
+        std::cout << "Exiting the program." << std::endl;
+        exit(0);
+    }
+    else if (command == "list") {
+        handleListCommand();
+    }
+    else if (command == "includepath") {
+        std::string path;
+        iss >> path;
+        if (path.empty()) {
+            displayError("You must specify a directory. Usage: includepath <directory>");
+        }
+        else {
+            handleIncludePathCommand(path);
+        }
+    }
+    else if (command == "tokenize") {
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to tokenize. Usage: tokenize <file>");
+        }
+        else {
+            handleTokenizeCommand(filename);
+        }
+    }
+    else if (command == "parse") {
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to parse. Usage: parse <file>");
+        }
+        else {
+            handleParseCommand(filename);
+        }
+    }
+    else if (command == "link") {
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to link. Usage: link <file>");
+        }
+        else {
+            handleLinkCommand(filename);
+        }
+    }
+    else if (command == "optimize") {
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to optimize. Usage: optimize <file>");
+        }
+        else {
+            handleOptimizeCommand(filename);
+        }
+    }
+    else if (command == "analyze") {
+        std::string filename, latencyFilename;
+        iss >> filename >> latencyFilename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to analyze. Usage: analyze <file> [latencies]");
+        }
+        else {
+            handleAnalyzeCommand(filename, latencyFilename);
+        }
+    }
+    else if (command == "schedule") {
+        std::string filename, latencyFilename;
+        iss >> filename >> latencyFilename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to schedule. Usage: schedule <file> [latencies]");
+        }
+        else {
+            handleScheduleCommand(filename, latencyFilename);
+        }
+    }
+    else if (command == "assemble") {
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to assemble. Usage: assemble <file>");
+        }
+        else {
+            handleAssembleCommand(filename);
+        }
+    }
+    else if (command == "disassemble") {
+        std::string filename;
+        unsigned threads = 0;
+        iss >> filename >> threads;
+        if (filename.empty()) {
+            displayError("You must specify a filename to disassemble. Usage: disassemble <file> [threads]");
+        }
+        else {
+            handleDisassembleCommand(filename, threads);
+        }
+    }
+    else if (command == "run") {
+        std::string filename, inputFilename;
+        uint64_t maxSteps = UINT64_MAX;
+        iss >> filename >> maxSteps >> inputFilename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to run. Usage: run <file> [steps] [input]");
+        }
+        else {
+            handleRunCommand(filename, maxSteps, inputFilename);
+        }
+    }
+    else if (command == "multirun") {
+        std::string filename;
+        unsigned hartCount = 0;
+        uint64_t quantum = MultiHartEmulator::DEFAULT_QUANTUM;
+        uint64_t maxSteps = UINT64_MAX;
+        iss >> filename >> hartCount >> quantum >> maxSteps;
+        if (filename.empty() || hartCount == 0) {
+            displayError("You must specify a filename and a hart count. Usage: multirun <file> <harts> [quantum] [steps]");
+        }
+        else {
+            handleMultiRunCommand(filename, hartCount, quantum, maxSteps);
+        }
+    }
+    else if (command == "profile") {
+        std::string filename;
+        uint32_t samplePeriod = Profiler::DEFAULT_SAMPLE_PERIOD;
+        iss >> filename >> samplePeriod;
+        if (filename.empty()) {
+            displayError("You must specify a filename to profile. Usage: profile <file> [period]");
+        }
+        else {
+            handleProfileCommand(filename, samplePeriod);
+        }
+    }
+    else if (command == "pgo") {
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to lay out. Usage: pgo <file>");
+        }
+        else {
+            handlePgoCommand(filename);
+        }
+    }
+    else if (command == "batch") {
+        std::string filename, inputDirectory;
+        unsigned threads = 0;
+        uint64_t maxSteps = BatchRunner::DEFAULT_STEP_LIMIT;
+        iss >> filename >> inputDirectory >> threads >> maxSteps;
+        if (filename.empty() || inputDirectory.empty()) {
+            displayError("You must specify a filename and an input directory. Usage: batch <file> <inputs> [threads] [steps]");
+        }
+        else {
+            handleBatchCommand(filename, inputDirectory, threads, maxSteps);
+        }
+    }
+    else if (command == "irqbench") {
+        std::string filename;
+        uint64_t period = 0;
+        iss >> filename >> period;
+        if (filename.empty() || period == 0) {
+            displayError("You must specify a filename and a timer period. Usage: irqbench <file> <period>");
+        }
+        else {
+            handleInterruptBenchmarkCommand(filename, period);
+        }
+    }
+    else if (command == "memprofile") {
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to profile. Usage: memprofile <file>");
+        }
+        else {
+            handleMemoryProfileCommand(filename);
+        }
+    }
+    else if (command == "memmap") {
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            displayError("You must specify a filename. Usage: memmap <file>");
+        }
+        else {
+            handleMemoryMapCommand(filename);
+        }
+    }
+    else if (command == "check") {
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            displayError("You must specify a filename to check. Usage: check <file>");
+        }
+        else {
+            handleCheckCommand(filename);
+        }
+    }
+    else if (command == "xref") {
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            displayError("You must specify a filename. Usage: xref <file>");
+        }
+        else {
+            handleXrefCommand(filename);
+        }
+    }
+    else if (command == "xquery") {
+        std::string filename, name;
+        iss >> filename >> name;
+        if (name.empty()) {
+            displayError("You must specify a filename and a symbol. Usage: xquery <file> <symbol>");
+        }
+        else {
+            handleXqueryCommand(filename, name);
+        }
+    }
+    else if (command == "watch") {
+        std::string filename;
+        uint64_t maxRebuilds = Watcher::UNLIMITED;
+        iss >> filename >> maxRebuilds;
+        if (filename.empty()) {
+            displayError("You must specify a filename to watch. Usage: watch <file> [rebuilds]");
+        }
+        else {
+            handleWatchCommand(filename, maxRebuilds);
+        }
+    }
+    else if (command == "serve") {
+        std::string socketPath;
+        unsigned threads = AssemblerDaemon::DEFAULT_THREADS;
+        iss >> socketPath >> threads;
+        if (socketPath.empty()) {
+            displayError("You must specify a socket path. Usage: serve <socket> [threads]");
+        }
+        else {
+            handleServeCommand(socketPath, threads);
+        }
+    }
+    else if (command == "request") {
+        std::string socketPath, request;
+        iss >> socketPath;
+        std::getline(iss >> std::ws, request);
+        if (socketPath.empty() || request.empty()) {
+            displayError("You must specify a socket and a request. Usage: request <socket> <request>");
+        }
+        else {
+            handleRequestCommand(socketPath, request);
+        }
+    }
+    else if (command == "bench") {
+        std::string directory;
+        unsigned repeats = DEFAULT_BENCH_REPEATS;
+        iss >> directory >> repeats;
+        if (directory.empty()) {
+            displayError("You must specify a benchmark directory. Usage: bench <directory> [repeats]");
+        }
+        else {
+            handleBenchCommand(directory, repeats);
+        }
+    }
+    else if (command == "trace") {
+        std::string filename;
+        uint32_t fileRecords = Tracer::DEFAULT_FILE_RECORDS;
+        iss >> filename >> fileRecords;
+        if (filename.empty()) {
+            displayError("You must specify a filename to trace. Usage: trace <file> [records]");
+        }
+        else {
+            handleTraceCommand(filename, fileRecords);
+        }
+    }
+    else if (command == "tracedump") {
+        std::string filename;
+        uint64_t count = DEFAULT_TRACE_DUMP;
+        iss >> filename >> count;
+        if (filename.empty()) {
+            displayError("You must specify a traced filename. Usage: tracedump <file> [count]");
+        }
+        else {
+            handleTraceDumpCommand(filename, count);
+        }
+    }
+    else if (command == "debug") {
+        std::string filename, point;
+        std::vector<std::string> points;
+        iss >> filename;
+        while (iss >> point) {
+            points.push_back(point);
+        }
+        if (filename.empty()) {
+            displayError("You must specify a filename to debug. Usage: debug <file> [b|r|w|rw:<location>]...");
+        }
+        else {
+            handleDebugCommand(filename, points, DEFAULT_DEBUG_STOPS);
+        }
+    }
+    else {
+        displayError("Unknown command: " + command);
+    }
+}
+
+// A command given on the command line runs once without the prompt, so a
+// build tool can call "request" as a thin client and check the exit status
+int main(int argc, char *argv[]) {
+    std::string input;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            input += (i > 1 ? " " : "") + std::string(argv[i]);
+        }
+        processCommand(input);
+        return exitStatus;
+    }
+
+    std::cout << "Welcome to the Assembly Tokenizer and Parser CLI!" << std::endl;
+    std::cout << "Type 'exit' to quit, 'list' to list files, 'tokenize <filename>' to tokenize an assembly file, or 'parse <filename>' to parse a file." << std::endl;
+
+    while (true) {
+        std::cout << "$ ";  // Prompt for user input
+        std::getline(std::cin, input);
+
+        if (!input.empty()) {
+            processCommand(input);
+        }
+    }
+
+    return 0;
+}